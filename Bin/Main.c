@@ -1,30 +1,102 @@
 // sockets
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
 
 #include <Misra.h>
+#include <Beam/Balance.h>
+#include <Beam/Cache.h>
+#include <Beam/Cgroup.h>
+#include <Beam/Clock.h>
+#include <Beam/Config.h>
+#include <Beam/ConnLimit.h>
+#include <Beam/DataRate.h>
+#include <Beam/DocIndex.h>
+#include <Beam/HotCache.h>
 #include <Beam/Http.h>
+#include <Beam/IoPool.h>
+#include <Beam/LoadShed.h>
+#include <Beam/Numa.h>
+#include <Beam/Pressure.h>
+#include <Beam/RateLimit.h>
+#include <Beam/Server.h>
+#include <Beam/Shm.h>
 
 #define PORT 3000
 
+// shared by everyone serving requests, keyed by client
+static RateLimiter rate_limiter;
+static ConnLimiter conn_limiter;
+static IoPool      io_pool;
+static Balancer    balancer;
+
+// file content shared by all workers, mapped before any of them starts
+static Cache cache;
+
+// cold files being read into cache by I/O pool, misses beyond this many wait for a later one
+#define CACHE_FILLS_MAX 64
+static _Atomic(u32) cache_fills;
+
+// what our cgroup lets us use, defaults are sized for that rather than the host
+static CgroupLimits limits;
+
+// CPUs and nodes workers are pinned to, when they are
+static NumaTopology topology;
+static bool         pin_workers;
+
+// copies of hot content on every node, by node id, none unless configured
+static Cache *replicas;
+static u32    nreplicas;
+
+// replica of node serving thread is pinned to, NULL to go straight to shared cache
+static _Thread_local Cache *local_replica;
+
+// memory pressure of our cgroup, caches shrink and grow back with it
+static Pressure pressure;
+
+// files under document root as found at startup
+static DocIndex doc_index;
+static bool     index_strict; // files not in index are 404 without looking at disk
+
+// where hottest cache entries are kept across restarts, NULL to start cold every time
+static const char *cache_snapshot;
+static u32         cache_snapshot_entries;
+
+// counters of every worker, in shared memory when workers are processes
+static Stats *worker_stats;
+static u32    nworkers;
+
+// set by SIGTERM and SIGINT in master process
+static volatile sig_atomic_t stopping;
+
+// directory files are served from, NULL to just say hello
+static const char *doc_root;
+
+// url counters are served at, NULL to not serve them at all
+static const char *stats_path;
+
 // code.brightprogrammer.in
 // serve directory
 
 ///
-/// I guarantee that I'll send a response if atleast I get a valid connfd.
+/// I guarantee that I'll queue a response if atleast I get a valid conn.
 ///
-/// msg[in]    : A custom message to be sent.
-/// connfd[in] : Connection socket file descriptor.
+/// msg[in]      : A custom message to be sent.
+/// conn[in,out] : Connection to respond on.
 ///
-void SendInternalServerErrorResponse(const char *msg, int connfd) {
+void SendInternalServerErrorResponse(const char *msg, Conn *conn) {
     Str response = StrInit();
+    Str body     = StrInit();
 
     StrWriteFmt(
-        &response,
-
-        // http response
-        "HTTP/1.1 500 Internal Server Error\r\nContent-Type: text/html; "
-        "charset=UTF-8\r\nContent-Length: 12\r\n\r\n"
+        &body,
 
         // html body
         "<html><head><title>500</title></head><body>{}</body></html>",
@@ -33,41 +105,433 @@ void SendInternalServerErrorResponse(const char *msg, int connfd) {
         msg ? msg : "internal server error, beam is sorry :-("
     );
 
-    send(connfd, response.data, response.length, 0);
+    StrWriteFmt(
+        &response,
+
+        // http response
+        "HTTP/1.1 500 Internal Server Error\r\nContent-Type: text/html; "
+        "charset=UTF-8\r\nContent-Length: {}\r\nConnection: close\r\n\r\n{}",
 
+        body.length,
+        body
+    );
+
+    // connection cannot be trusted to be in a sane state anymore
+    if (ConnQueueStr(conn, &response)) {
+        conn->close_after_write = true;
+    }
+
+    StrDeinit(&body);
     StrDeinit(&response);
 }
 
 ///
-/// Send a html response
+/// Queue a html response
 ///
-/// Function guarantees that an http response gets sent if atleast connfd is correct.
+/// Function guarantees that an http response gets queued if atleast conn is correct.
 /// Even if html file fails to load, or any other error occurs, an internal server
-/// error response gets sent automatically.
+/// error response gets queued automatically.
+///
+/// html[in]     : Str object containing html response.
+/// code[in]     : HTTP response code.
+/// conn[in,out] : Connection to respond on.
 ///
-/// html[in]   : Str object containing html response.
-/// code[in]   : HTTP response code.
-/// connfd[in] : Connection socket file descriptor.
+/// SUCCESS: true
+/// FAILURE: false
 ///
-void RespondWithHtml(Str *html, HttpResponseCode code, int connfd) {
-    if (!html || connfd < 0) {
+bool RespondWithHtml(Str *html, HttpResponseCode code, Conn *conn) {
+    if (!html || !conn) {
         LOG_ERROR("Invalid html or connection");
-        SendInternalServerErrorResponse(NULL, connfd);
-        return;
+        SendInternalServerErrorResponse(NULL, conn);
+        return false;
     }
 
     HttpResponse response = HttpResponseInit();
     HttpRespondWithHtml(&response, code, html);
-    HttpRespondTo(&response, connfd);
+
+    bool queued = ConnQueueResponse(conn, &response);
     HttpResponseDeinit(&response);
+
+    if (!queued) {
+        SendInternalServerErrorResponse(NULL, conn);
+    }
+    return queued;
 }
 
-void ServerMain(int connfd, HttpRequest *request) {
-    Str html = StrInitFromZstr("hello");
-    RespondWithHtml(&html, HTTP_RESPONSE_CODE_OK, connfd);
+///
+/// Respond with a short html page describing an error.
+///
+/// code[in]     : HTTP response code.
+/// conn[in,out] : Connection to respond on.
+///
+static void respond_with_error(HttpResponseCode code, Conn *conn) {
+    Str html = StrInit();
+    StrWriteFmt(
+        &html,
+        "<html><head><title>{}</title></head><body>{}</body></html>",
+        (u32)code,
+        HttpResponseCodeToZstr(code)
+    );
+    RespondWithHtml(&html, code, conn);
     StrDeinit(&html);
 }
 
+///
+/// Map request url to a path under document root.
+/// Query and fragment are ignored, directories map to their index.html.
+///
+/// url[in]   : Request target.
+/// path[out] : Filesystem path.
+/// size[in]  : Capacity of `path`.
+///
+/// SUCCESS: true
+/// FAILURE: false when url tries to escape document root or path does not fit.
+///
+static bool url_to_path(Str *url, char *path, u64 size) {
+    u64 length = url->length;
+    for (u64 i = 0; i < url->length; i++) {
+        if (url->data[i] == '?' || url->data[i] == '#') {
+            length = i;
+            break;
+        }
+    }
+
+    if (!length || url->data[0] != '/') {
+        return false;
+    }
+
+    // no ".." path segments
+    for (u64 i = 0; i + 1 < length; i++) {
+        bool at_segment = !i || url->data[i - 1] == '/';
+        bool dots       = url->data[i] == '.' && url->data[i + 1] == '.';
+        bool ends       = i + 2 == length || url->data[i + 2] == '/';
+        if (at_segment && dots && ends) {
+            return false;
+        }
+    }
+
+    const char *index = url->data[length - 1] == '/' ? "index.html" : "";
+    int n = snprintf(path, size, "%s%.*s%s", doc_root, (int)length, url->data, index);
+    return n > 0 && (u64)n < size;
+}
+
+///
+/// Report counters of event loop serving this connection as plain text.
+///
+/// conn[in,out] : Connection to respond on.
+///
+static void respond_with_stats(Conn *conn) {
+    // other workers keep counting while being read, so totals are only roughly consistent
+    Stats total = StatsInit();
+    for (u32 i = 0; i < nworkers; i++) {
+        StatsAdd(&total, &worker_stats[i]);
+    }
+
+    Str text = StrInit();
+    StatsRender(&total, &text);
+    CacheRender(&cache, total.cache_hits, total.cache_misses, &text);
+    if (pressure.keep_pct) {
+        StrWriteFmt(&text, "memory_keep_pct {}\n", atomic_load_explicit(pressure.keep_pct, memory_order_relaxed));
+    }
+
+    HttpResponse response = HttpResponseInit();
+    HttpRespondWithHtml(&response, HTTP_RESPONSE_CODE_OK, &text);
+    response.content_type = HTTP_CONTENT_TYPE_TEXT_PLAIN;
+
+    if (!ConnQueueResponse(conn, &response)) {
+        SendInternalServerErrorResponse(NULL, conn);
+    }
+
+    HttpResponseDeinit(&response);
+    StrDeinit(&text);
+}
+
+// file read into shared cache by I/O pool, allocated along with its path
+typedef struct {
+    IoJob          job;
+    CacheValidator valid;
+    char           path[];
+} CacheFill;
+
+// I/O pool side of a cache fill, miss that started it went out with sendfile() meanwhile
+static void cache_fill_run(IoJob *job) {
+    CacheFill *fill = (CacheFill *)job;
+    Str        data = StrInit();
+
+    u64 done = 0;
+    if (!job->error) {
+        StrReserve(&data, fill->valid.size);
+        while (done < fill->valid.size) {
+            i64 n = pread(job->fd, data.data + done, fill->valid.size - done, (off_t)done);
+            if (n <= 0 && !(n == -1 && errno == EINTR)) {
+                break;
+            }
+            done += n > 0 ? (u64)n : 0;
+        }
+    }
+
+    // file that shrank or can't be read is left to sendfile(), pool thread can wait for other writers
+    if (!job->error && done == fill->valid.size) {
+        CachePut(&cache, fill->path, &fill->valid, data.data, done, true);
+    }
+
+    StrDeinit(&data);
+    close(job->fd);
+    free(fill);
+    atomic_fetch_sub_explicit(&cache_fills, 1, memory_order_relaxed);
+}
+
+///
+/// Have I/O pool read a file into shared cache, without event loop waiting
+/// for it.
+///
+/// fd[in]    : File to read, duplicated for pool.
+/// path[in]  : Path file was opened from.
+/// valid[in] : Validators of file.
+///
+/// SUCCESS: true when pool took read over.
+/// FAILURE: false when pool isn't running or has enough cold files to read already.
+///
+static bool cache_fill(i32 fd, const char *path, const CacheValidator *valid) {
+    if (atomic_fetch_add_explicit(&cache_fills, 1, memory_order_relaxed) >= CACHE_FILLS_MAX) {
+        atomic_fetch_sub_explicit(&cache_fills, 1, memory_order_relaxed);
+        return false;
+    }
+
+    u64        size = strlen(path) + 1;
+    CacheFill *fill = calloc(1, sizeof(CacheFill) + size);
+    i32        copy = fill ? dup(fd) : -1;
+    if (copy >= 0) {
+        fill->job.kind = IO_JOB_CALL;
+        fill->job.fd   = copy;
+        fill->job.run  = cache_fill_run;
+        fill->valid    = *valid;
+        memcpy(fill->path, path, size);
+        if (IoPoolSubmit(&io_pool, &fill->job)) {
+            return true;
+        }
+        close(copy);
+    }
+    free(fill);
+
+    atomic_fetch_sub_explicit(&cache_fills, 1, memory_order_relaxed);
+    return false;
+}
+
+///
+/// Swap file body of a response for its content from shared cache. A file
+/// not there yet keeps sending from file while I/O pool reads it into
+/// cache for later requests, so event loop never reads it in itself.
+/// Responses too big to cache keep sending from file.
+///
+/// response[in,out] : Response with a whole file as body.
+/// path[in]         : Path file was opened from.
+/// stats[in,out]    : Counters of serving event loop, may be NULL.
+///
+static void serve_cached(HttpResponse *response, const char *path, Stats *stats) {
+    if (!cache.header || response->file_size > cache.config.max_object) {
+        return;
+    }
+
+    CacheValidator valid = {
+        .file_id  = response->file_id,
+        .mtime_ns = response->file_mtime_ns,
+        .size     = response->file_size,
+    };
+
+    if (local_replica && CacheGet(local_replica, path, &valid, &response->body)) {
+        if (stats) {
+            stats->cache_replica_hits++;
+        }
+    } else if (CacheGet(&cache, path, &valid, &response->body)) {
+        if (stats) {
+            stats->cache_hits++;
+        }
+        // looked up at least twice now, worth a copy on this node
+        if (local_replica) {
+            CachePut(local_replica, path, &valid, response->body.data, response->body.length, false);
+        }
+    } else {
+        if (stats) {
+            stats->cache_misses++;
+        }
+        // pages sendfile() faults in go through I/O pool like any other miss
+        if (cache_fill(response->file_fd, path, &valid) && stats) {
+            stats->cache_stores++;
+        }
+        return;
+    }
+
+    close(response->file_fd);
+    response->file_fd = -1;
+}
+
+///
+/// Tag a file response with its ETag, or turn it into a 304 when client
+/// already has that version. ETag comes from index while file is still the
+/// one that was indexed.
+///
+/// response[in,out] : Response with a file as body.
+/// entry[in]        : Index entry of file, may be NULL.
+/// request[in]      : Request being answered.
+///
+/// SUCCESS: true when response became a 304.
+/// FAILURE: false
+///
+static bool tag_response(HttpResponse *response, const DocEntry *entry, HttpRequest *request) {
+    DocEtag etag = {0};
+    if (entry && entry->file_id == response->file_id && entry->mtime_ns == response->file_mtime_ns &&
+        entry->size == response->file_size) {
+        etag = entry->etag;
+    } else {
+        etag = DocEtagMake(response->file_id, response->file_mtime_ns, response->file_size);
+    }
+
+    HttpHeader *match = HttpHeadersFind(&request->headers, "If-None-Match");
+    if (match && match->value.data && (strstr(match->value.data, etag.value) || !strcmp(match->value.data, "*"))) {
+        close(response->file_fd);
+        response->file_fd     = -1;
+        response->status_code = HTTP_RESPONSE_CODE_NOT_MODIFIED;
+        return true;
+    }
+
+    HttpHeader header = HttpHeaderInit();
+    header.key        = StrInitFromZstr("ETag");
+    header.value      = StrInitFromZstr(etag.value);
+    VecPushBack(&response->headers, header);
+    return false;
+}
+
+///
+/// Queue a whole file response and keep its rendered bytes in hot cache of
+/// serving loop, so the same url is answered from there next time.
+///
+/// conn[in,out]     : Connection request arrived on, with a hot cache.
+/// url[in]          : Request url.
+/// response[in,out] : Response with file content in memory.
+/// generation[in]   : Generation of shared cache looked up at.
+/// now[in]          : When request was looked up.
+///
+/// SUCCESS: true
+/// FAILURE: false when response couldn't be queued.
+///
+static bool queue_hot(Conn *conn, const Str *url, HttpResponse *response, u64 generation, u64 now) {
+    Str rendered = StrInit();
+    if (!HttpResponseRender(response, &rendered)) {
+        StrDeinit(&rendered);
+        return false;
+    }
+
+    if (HotCachePut(conn->hot_cache, url->data, url->length, generation, now, &rendered) && conn->stats) {
+        conn->stats->hot_stores++;
+    }
+    return ConnQueueStr(conn, &rendered);
+}
+
+///
+/// Serve a parsed request.
+/// Response is queued on connection and flushed by the event loop.
+///
+/// conn[in,out] : Connection request arrived on.
+/// request[in]  : Parsed request.
+///
+void ServerMain(Conn *conn, HttpRequest *request) {
+    // counters say a lot about us, they're only there for whoever asked for them at a url of their choosing
+    if (stats_path && conn->stats && request->method == HTTP_REQUEST_METHOD_GET && request->url.data &&
+        !strcmp(request->url.data, stats_path)) {
+        respond_with_stats(conn);
+        return;
+    }
+
+    if (!doc_root) {
+        Str html = StrInitFromZstr("hello");
+        RespondWithHtml(&html, HTTP_RESPONSE_CODE_OK, conn);
+        StrDeinit(&html);
+        return;
+    }
+
+    if (request->method != HTTP_REQUEST_METHOD_GET) {
+        respond_with_error(HTTP_RESPONSE_CODE_METHOD_NOT_ALLOWED, conn);
+        return;
+    }
+
+    // hottest urls are answered from memory of this loop, conditional and partial requests take the long way
+    HttpHeader *range      = HttpHeadersFind(&request->headers, "Range");
+    bool        hot        = conn->hot_cache && request->url.data && !range &&
+                             !HttpHeadersFind(&request->headers, "If-None-Match");
+    u64         generation = 0;
+    u64         now        = 0;
+    if (hot) {
+        generation = CacheGeneration(&cache);
+        now        = ClockNowNs();
+        Str copy   = StrInit();
+        if (HotCacheGet(conn->hot_cache, request->url.data, request->url.length, generation, now, &copy)) {
+            if (conn->stats) {
+                conn->stats->hot_hits++;
+            }
+            if (!ConnQueueStr(conn, &copy)) {
+                SendInternalServerErrorResponse(NULL, conn);
+            }
+            return;
+        }
+        StrDeinit(&copy);
+    }
+
+    char path[PATH_MAX];
+    if (!url_to_path(&request->url, path, sizeof(path))) {
+        respond_with_error(HTTP_RESPONSE_CODE_NOT_FOUND, conn);
+        return;
+    }
+
+    const DocEntry *entry = DocIndexFind(&doc_index, path);
+    if (!entry && index_strict && doc_index.table) {
+        respond_with_error(HTTP_RESPONSE_CODE_NOT_FOUND, conn);
+        return;
+    }
+
+    HttpContentType type     = entry ? entry->content_type : HttpContentTypeFromPath(path);
+    HttpResponse    response = HttpResponseInit();
+    if (HttpRespondWithFile(&response, HTTP_RESPONSE_CODE_OK, type, path)) {
+        bool unchanged = tag_response(&response, entry, request);
+        if (!unchanged && range && range->value.data) {
+            HttpResponseSetRange(&response, range->value.data);
+        } else if (!unchanged) {
+            serve_cached(&response, path, conn->stats);
+        }
+
+        // content that made it into memory is worth keeping rendered
+        bool queued = false;
+        if (hot && response.file_fd < 0 && response.status_code == HTTP_RESPONSE_CODE_OK) {
+            queued = queue_hot(conn, &request->url, &response, generation, now);
+        } else {
+            queued = ConnQueueResponse(conn, &response);
+        }
+        if (!queued) {
+            SendInternalServerErrorResponse(NULL, conn);
+        }
+    } else {
+        respond_with_error(HTTP_RESPONSE_CODE_NOT_FOUND, conn);
+    }
+    HttpResponseDeinit(&response);
+}
+
+///
+/// Build rate limiter configuration from BEAM_RATE_LIMIT_* knobs.
+/// Limiting stays disabled unless a request or byte rate is configured.
+///
+static RateLimitConfig rate_limit_config(void) {
+    RateLimitConfig config  = RateLimitConfigInit();
+    config.requests_per_sec = ConfigGetU64("BEAM_RATE_LIMIT_RPS", config.requests_per_sec);
+    config.request_burst    = ConfigGetU64("BEAM_RATE_LIMIT_BURST", config.request_burst);
+    config.bytes_per_sec    = ConfigGetU64("BEAM_RATE_LIMIT_BPS", config.bytes_per_sec);
+    config.byte_burst       = ConfigGetU64("BEAM_RATE_LIMIT_BYTE_BURST", config.byte_burst);
+    config.shard_count      = (u32)ConfigGetU64("BEAM_RATE_LIMIT_SHARDS", config.shard_count);
+    config.shard_slots      = (u32)ConfigGetU64("BEAM_RATE_LIMIT_SHARD_SLOTS", config.shard_slots);
+    config.v6_prefix_bits   = (u32)ConfigGetU64("BEAM_RATE_LIMIT_V6_PREFIX", config.v6_prefix_bits);
+    config.trusted_header   = ConfigGetZstr("BEAM_RATE_LIMIT_TRUSTED_HEADER", config.trusted_header);
+    return config;
+}
+
 // int main(int argc, char *argv[]) {
 //     if(argc < 2) {
 //         fprintf(stderr, "Usage: %s <input_file>\n", argv[0]);
@@ -97,9 +561,243 @@ void ServerMain(int connfd, HttpRequest *request) {
 // }
 
 
-int main() {
-    LogInit(true);
+///
+/// Build connection limiter configuration from BEAM_CONN_LIMIT_* knobs.
+/// Limiting stays disabled unless a per-client limit is configured.
+///
+static ConnLimitConfig conn_limit_config(void) {
+    ConnLimitConfig config = ConnLimitConfigInit();
+    config.max_per_client  = (u32)ConfigGetU64("BEAM_CONN_LIMIT_PER_CLIENT", config.max_per_client);
+    config.v6_prefix_bits  = (u32)ConfigGetU64("BEAM_CONN_LIMIT_V6_PREFIX", config.v6_prefix_bits);
+    config.table_slots     = (u32)ConfigGetU64("BEAM_CONN_LIMIT_SLOTS", config.table_slots);
+    return config;
+}
+
+///
+/// Build load shedding configuration from BEAM_LOAD_SHED_* knobs.
+/// Shedding stays disabled unless a target queueing delay is configured.
+///
+static LoadShedConfig load_shed_config(void) {
+    LoadShedConfig config      = LoadShedConfigInit();
+    u64            target_us   = ConfigGetU64("BEAM_LOAD_SHED_TARGET_US", config.target_ns / NSEC_PER_USEC);
+    u64            interval_us = ConfigGetU64("BEAM_LOAD_SHED_INTERVAL_US", config.interval_ns / NSEC_PER_USEC);
+    config.target_ns           = target_us * NSEC_PER_USEC;
+    config.interval_ns         = interval_us * NSEC_PER_USEC;
+    return config;
+}
+
+///
+/// Build minimum data-rate configuration from BEAM_MIN_DATA_RATE_* knobs.
+/// Enforcement stays disabled unless a throughput floor is configured.
+///
+static DataRateConfig data_rate_config(void) {
+    DataRateConfig config    = DataRateConfigInit();
+    u64            window_ms = ConfigGetU64("BEAM_MIN_DATA_RATE_WINDOW_MS", config.window_ns / NSEC_PER_MSEC);
+
+    config.min_bytes_per_sec = ConfigGetU64("BEAM_MIN_DATA_RATE_BPS", config.min_bytes_per_sec);
+    config.window_ns         = window_ms ? window_ms * NSEC_PER_MSEC : config.window_ns;
+    return config;
+}
+
+///
+/// Build file readahead policy configuration from BEAM_PREFETCH_* knobs.
+/// Setting BEAM_PREFETCH_SLOTS to 0 leaves readahead to kernel defaults.
+///
+static PrefetchConfig prefetch_config(void) {
+    PrefetchConfig config = PrefetchConfigInit();
+    config.window_min     = ConfigGetU64("BEAM_PREFETCH_WINDOW_MIN", config.window_min);
+    config.window_max     = ConfigGetU64("BEAM_PREFETCH_WINDOW_MAX", config.window_max);
+    config.dontneed_min   = ConfigGetU64("BEAM_PREFETCH_DONTNEED_MIN", config.dontneed_min);
+    config.table_slots    = (u32)ConfigGetU64("BEAM_PREFETCH_SLOTS", config.table_slots);
+    return config;
+}
+
+///
+/// Build hot response cache configuration from BEAM_HOT_CACHE_* knobs.
+/// Setting BEAM_HOT_CACHE_SLOTS to 0 serves every request from shared cache.
+///
+static HotCacheConfig hot_cache_config(void) {
+    HotCacheConfig config = HotCacheConfigInit();
+    u64            ms     = ConfigGetU64("BEAM_HOT_CACHE_REVALIDATE_MS", config.revalidate_ns / NSEC_PER_MSEC);
+    config.slots          = (u32)ConfigGetU64("BEAM_HOT_CACHE_SLOTS", config.slots);
+    config.max_response   = ConfigGetU64("BEAM_HOT_CACHE_MAX_RESPONSE", config.max_response);
+    config.revalidate_ns  = ms * NSEC_PER_MSEC;
+    return config;
+}
+
+///
+/// Build busy poll configuration from BEAM_BUSY_POLL_* knobs.
+/// Everything stays off unless BEAM_BUSY_POLL_US or BEAM_BUSY_POLL_SPIN_US is set.
+///
+static BusyPollConfig busy_poll_config(void) {
+    BusyPollConfig config = BusyPollConfigInit();
+    u64            spin   = ConfigGetU64("BEAM_BUSY_POLL_SPIN_US", config.spin_ns / NSEC_PER_USEC);
+    config.poll_us        = (u32)ConfigGetU64("BEAM_BUSY_POLL_US", config.poll_us);
+    config.poll_budget    = (u32)ConfigGetU64("BEAM_BUSY_POLL_BUDGET", config.poll_budget);
+    config.spin_ns        = spin * NSEC_PER_USEC;
+    return config;
+}
+
+///
+/// Build connection rebalancing configuration from BEAM_BALANCE_* knobs.
+///
+static BalanceConfig balance_config(void) {
+    BalanceConfig config = BalanceConfigInit();
+    config.ratio_pct     = (u32)ConfigGetU64("BEAM_BALANCE_RATIO_PCT", config.ratio_pct);
+    config.min_gap       = (u32)ConfigGetU64("BEAM_BALANCE_MIN_GAP", config.min_gap);
+    config.queue_slots   = (u32)ConfigGetU64("BEAM_BALANCE_QUEUE_SLOTS", config.queue_slots);
+    return config;
+}
+
+///
+/// Build shared content cache configuration from BEAM_CACHE_* knobs.
+/// Setting BEAM_CACHE_SIZE to 0 serves every file straight from disk,
+/// BEAM_CACHE_POLICY picks "tinylfu" (default) or plain "lru" eviction.
+/// Under a cgroup memory limit, cache takes a quarter of it by default.
+///
+static CacheConfig cache_config(void) {
+    CacheConfig config   = CacheConfigInit();
+    config.size          = limits.memory ? limits.memory / 4 : config.size;
+    config.size          = ConfigGetU64("BEAM_CACHE_SIZE", config.size);
+    config.slots         = (u32)ConfigGetU64("BEAM_CACHE_SLOTS", config.slots);
+    config.max_object    = ConfigGetU64("BEAM_CACHE_MAX_OBJECT", config.max_object);
+    config.hugepages     = ConfigGetU64("BEAM_CACHE_HUGEPAGES", config.hugepages);
+    config.block_size    = (u32)ConfigGetU64("BEAM_CACHE_BLOCK_SIZE", config.block_size);
+    config.window_pct    = (u32)ConfigGetU64("BEAM_CACHE_WINDOW_PCT", config.window_pct);
+    config.protected_pct = (u32)ConfigGetU64("BEAM_CACHE_PROTECTED_PCT", config.protected_pct);
+    if (!strcmp(ConfigGetZstr("BEAM_CACHE_POLICY", "tinylfu"), "lru")) {
+        config.policy = CACHE_POLICY_LRU;
+    }
+    return config;
+}
 
+///
+/// Build memory pressure monitor configuration from BEAM_PRESSURE_* knobs.
+/// Setting BEAM_PRESSURE_LEVELS to 0 keeps caches at full size no matter what.
+///
+static PressureConfig pressure_config(void) {
+    PressureConfig config = PressureConfigInit();
+    u64            relax  = ConfigGetU64("BEAM_PRESSURE_RELAX_MS", config.relax_ns / NSEC_PER_MSEC);
+    config.stall_us       = ConfigGetU64("BEAM_PRESSURE_STALL_US", config.stall_us);
+    config.window_us      = ConfigGetU64("BEAM_PRESSURE_WINDOW_US", config.window_us);
+    config.levels         = (u32)ConfigGetU64("BEAM_PRESSURE_LEVELS", config.levels);
+    config.floor_pct      = (u32)ConfigGetU64("BEAM_PRESSURE_FLOOR_PCT", config.floor_pct);
+    config.relax_ns       = relax * NSEC_PER_MSEC;
+    return config;
+}
+
+///
+/// Shrink or grow shared content cache with memory pressure. Caches and
+/// buffers of event loops follow on their own, from published share.
+///
+/// keep_pct[in] : Share of full size caches may use.
+/// arg[in]      : Unused.
+///
+static void on_pressure(u32 keep_pct, void *arg) {
+    (void)arg;
+    u64 size = CacheResize(&cache, cache.config.size / 100 * keep_pct);
+    for (u32 i = 0; i < nreplicas; i++) {
+        CacheResize(&replicas[i], replicas[i].config.size / 100 * keep_pct);
+    }
+    WriteFmtLn("Memory pressure: caches at {}% of full size, content cache {} MB", keep_pct, size >> 20);
+}
+
+///
+/// Mappings one address space may have, per vm.max_map_count.
+///
+/// SUCCESS: Limit
+/// FAILURE: 0 when it can't be read.
+///
+static u64 max_map_count(void) {
+    FILE *f = fopen("/proc/sys/vm/max_map_count", "re");
+    if (!f) {
+        return 0;
+    }
+
+    u64 count = 0;
+    if (1 != fscanf(f, "%lu", &count)) {
+        count = 0;
+    }
+    fclose(f);
+    return count;
+}
+
+///
+/// Build event loop configuration from BEAM_* knobs.
+/// Per-connection output rate stays uncapped unless BEAM_CONN_RATE_BPS is set.
+/// Under a cgroup memory limit, connection slabs and O_DIRECT buffers of all
+/// workers are kept to an eighth and a sixteenth of it by default. Both ask
+/// for huge pages unless BEAM_HUGEPAGES is 0, BEAM_TLB_COUNTERS=1 shows what
+/// that saves as TLB misses in stats. Connections are capped so that input
+/// rings of all loops sharing an address space fit under vm.max_map_count.
+///
+/// workers[in]   : Number of event loops this configuration is for.
+/// processes[in] : Loops run in processes of their own rather than threads.
+///
+static ServerConfig server_config(u32 workers, bool processes) {
+    ServerConfig config = ServerConfigInit();
+    if (limits.memory) {
+        u64 conns   = limits.memory / 8 / workers / (config.input_size + sizeof(Conn));
+        u64 buffers = limits.memory / 16 / workers / config.direct_io_buffer;
+
+        // a slab too small to be useful is worse than going over a bit, streams need two buffers or none
+        buffers                  = buffers < 2 ? 0 : buffers;
+        config.max_conns         = (u32)(conns < 64 ? 64 : conns < config.max_conns ? conns : config.max_conns);
+        config.direct_io_buffers = (u32)(buffers < config.direct_io_buffers ? buffers : config.direct_io_buffers);
+    }
+
+    u64 keep_ms              = ConfigGetU64("BEAM_KEEP_ALIVE_MS", config.keep_alive_ns / NSEC_PER_MSEC);
+    u64 idle_ms              = ConfigGetU64("BEAM_IDLE_TIMEOUT_MS", config.idle_timeout_ns / NSEC_PER_MSEC);
+    config.max_conns         = (u32)ConfigGetU64("BEAM_MAX_CONNS", config.max_conns);
+    config.max_events        = (u32)ConfigGetU64("BEAM_MAX_EVENTS", config.max_events);
+    config.keep_alive_ns     = keep_ms * NSEC_PER_MSEC;
+    config.idle_timeout_ns   = idle_ms * NSEC_PER_MSEC;
+    config.write_quantum     = ConfigGetU64("BEAM_WRITE_QUANTUM", config.write_quantum);
+    config.conn_rate         = ConfigGetU64("BEAM_CONN_RATE_BPS", config.conn_rate);
+    config.conn_rate_after   = ConfigGetU64("BEAM_CONN_RATE_AFTER", config.conn_rate_after);
+    config.handler           = ServerMain;
+    config.rate_limiter      = &rate_limiter;
+    config.conn_limiter      = &conn_limiter;
+    config.io_pool           = &io_pool;
+    config.io_readahead      = ConfigGetU64("BEAM_IO_READAHEAD", config.io_readahead);
+    config.direct_io_min     = ConfigGetU64("BEAM_DIRECT_IO_MIN", config.direct_io_min);
+    config.direct_io_buffer  = ConfigGetU64("BEAM_DIRECT_IO_BUFFER", config.direct_io_buffer);
+    config.direct_io_buffers = (u32)ConfigGetU64("BEAM_DIRECT_IO_BUFFERS", config.direct_io_buffers);
+    config.zerocopy_min      = ConfigGetU64("BEAM_ZEROCOPY_MIN", config.zerocopy_min);
+    config.load_shed         = load_shed_config();
+    config.data_rate         = data_rate_config();
+    config.prefetch          = prefetch_config();
+    config.busy_poll         = busy_poll_config();
+    config.hot_cache         = hot_cache_config();
+    config.memory_keep_pct   = pressure.keep_pct;
+    config.hugepages         = ConfigGetU64("BEAM_HUGEPAGES", config.hugepages);
+    config.tlb_counters      = ConfigGetU64("BEAM_TLB_COUNTERS", config.tlb_counters);
+
+    // input ring of a slab entry stays mapped once made, past the limit connections would just be dropped.
+    // An eighth is left over for everything else : libraries, stacks, caches, malloc arenas.
+    u64 maps = max_map_count();
+    if (maps) {
+        u64 fit = (maps - maps / 8) / RING_MAPPINGS / (processes ? 1 : workers);
+        fit     = fit ? fit : 1;
+        if (fit < config.max_conns) {
+            WriteFmtLn(
+                "vm.max_map_count {} leaves room for {} connections per worker, not {}",
+                maps,
+                fit,
+                config.max_conns
+            );
+            config.max_conns = (u32)fit;
+        }
+    }
+
+    return config;
+}
+
+///
+/// Create a socket listening on PORT. With `reuseport` several of them can
+/// be bound to the same port, kernel spreads connections across them.
+///
+static i32 listen_socket(bool reuseport) {
     // create main socket that the server listens on
     i32 sockfd = socket(AF_INET6, SOCK_STREAM, 0);
     if (-1 == sockfd) {
@@ -113,6 +811,11 @@ int main() {
         LOG_SYS_FATAL("setsockopt() failed");
     }
 
+    if (reuseport && -1 == setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, (const void *)&LVAL(1L), sizeof(int))) {
+        close(sockfd);
+        LOG_SYS_FATAL("setsockopt(SO_REUSEPORT) failed");
+    }
+
     // bind socket to an addres
     struct sockaddr_in6 server_addr = {0};
     server_addr.sin6_family         = AF_INET6;
@@ -125,52 +828,472 @@ int main() {
     }
 
     // listen for incoming connections on the socket
-    res = listen(sockfd, 10);
+    res = listen(sockfd, SOMAXCONN);
     if (-1 == res) {
         close(sockfd);
         LOG_SYS_FATAL("listen() failed ");
     }
-    WriteFmtLn("Listening on port {}...\n", PORT);
 
-    Str buf = StrInit();
-    StrReserve(&buf, UINT16_MAX - 1);
+    return sockfd;
+}
+
+static void *worker_main(void *arg) {
+    Server *server = arg;
+    if (!ServerRun(server)) {
+        LOG_ERROR("event loop stopped");
+    }
+    return NULL;
+}
+
+///
+/// Pin calling thread to CPU picked for a worker, when workers are pinned,
+/// and serve from content replica of its node. Whatever it allocates and
+/// touches afterwards is on that node.
+///
+/// index[in] : Which worker this is.
+///
+static void place_worker(u32 index) {
+    if (!pin_workers) {
+        return;
+    }
 
-    HttpRequest req = HttpRequestInit();
-    while (true) {
-        struct sockaddr_storage client_addr = {0};
-        socklen_t               addrlen     = sizeof(client_addr);
-        int                     connfd      = accept(sockfd, (struct sockaddr *)&client_addr, &addrlen);
-        if (-1 == connfd) {
-            close(sockfd);
-            LOG_SYS_ERROR("listen() failed");
+    i32 node = NumaPinWorker(&topology, index);
+    if (node >= 0 && (u32)node < nreplicas && replicas[node].header) {
+        local_replica = &replicas[node];
+    }
+}
+
+typedef struct {
+    Server       server;
+    ServerConfig config; // shared configuration, with `worker` and `stats` of this one
+    i32          fd;
+} WorkerThread;
+
+// event loop is set up on its own thread, so slabs and buffers are first touched on its node
+static void *worker_thread(void *arg) {
+    WorkerThread *worker = arg;
+    place_worker(worker->config.worker);
+    if (!ServerInit(&worker->server, &worker->config, worker->fd)) {
+        LOG_FATAL("failed to initialize server");
+    }
+    return worker_main(&worker->server);
+}
+
+///
+/// Write cache snapshot, when one is configured.
+///
+static void save_snapshot(void) {
+    if (cache_snapshot && cache.header && !CacheSave(&cache, cache_snapshot, cache_snapshot_entries)) {
+        LOG_ERROR("cache snapshot not saved, next start will be cold");
+    }
+}
+
+static void *warm_main(void *arg) {
+    u32 threads = (u32)(uintptr_t)arg;
+    i64 loaded  = CacheWarm(&cache, cache_snapshot, threads);
+    if (loaded > 0) {
+        WriteFmtLn("Warmed cache up with {} files from snapshot", (u64)loaded);
+    }
+    return NULL;
+}
+
+///
+/// Wait for SIGTERM or SIGINT, which every other thread has blocked, save
+/// cache snapshot and exit. Worker threads have no graceful stop of their own.
+///
+static void *shutdown_main(void *arg) {
+    sigset_t *signals = arg;
+    int       sig     = 0;
+    while (sigwait(signals, &sig)) {}
+    save_snapshot();
+    _exit(EXIT_SUCCESS);
+}
+
+static void start_io_pool(void) {
+    IoPoolConfig io_config = IoPoolConfigInit();
+    io_config.threads      = (u32)ConfigGetU64("BEAM_IO_THREADS", io_config.threads);
+    if (!IoPoolInit(&io_pool, &io_config)) {
+        LOG_FATAL("failed to start I/O pool");
+    }
+}
+
+///
+/// Run every worker as a thread of this process, first one on main thread.
+///
+/// config[in] : Server configuration shared by all workers.
+/// fds[in]    : Listening socket of each worker.
+///
+static void run_threads(ServerConfig *config, i32 *fds) {
+    start_io_pool();
+
+    WorkerThread *workers = calloc(nworkers, sizeof(WorkerThread));
+    pthread_t    *threads = calloc(nworkers, sizeof(pthread_t));
+    if (!workers || !threads) {
+        LOG_FATAL("failed to allocate workers");
+    }
+
+    for (u32 i = 0; i < nworkers; i++) {
+        workers[i].config        = *config;
+        workers[i].config.worker = i;
+        workers[i].config.stats  = &worker_stats[i];
+        workers[i].fd            = fds[i];
+    }
+
+    for (u32 i = 1; i < nworkers; i++) {
+        if (pthread_create(&threads[i], NULL, worker_thread, &workers[i])) {
+            LOG_FATAL("failed to start worker");
         }
+    }
 
-        i64 recv_size = recv(connfd, buf.data, buf.capacity, 0);
-        if (-1 == recv_size) {
-            close(connfd);
-            LOG_SYS_ERROR("recv() failed");
-            continue;
+    // main thread goes last, threads started after pinning it would inherit its CPU
+    worker_thread(&workers[0]);
+    for (u32 i = 1; i < nworkers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (u32 i = 0; i < nworkers; i++) {
+        ServerDeinit(&workers[i].server);
+    }
+    free(threads);
+    free(workers);
+    IoPoolDeinit(&io_pool);
+}
+
+///
+/// Body of a forked worker process. Never returns.
+///
+/// config[in] : Server configuration shared by all workers.
+/// fds[in]    : Listening socket of each worker.
+/// index[in]  : Which worker this is.
+///
+static void worker_process(ServerConfig *config, i32 *fds, u32 index) {
+    // nobody would restart or reap us without master
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+
+    for (u32 i = 0; i < nworkers; i++) {
+        if (fds[i] != fds[index]) {
+            close(fds[i]);
         }
-        buf.length = (u64)recv_size;
+    }
+
+    // threads don't survive fork(), so every worker starts its own, before pinning so they aren't
+    start_io_pool();
+    place_worker(index);
+
+    Server server;
+    config->worker = index;
+    config->stats  = &worker_stats[index];
+    if (!ServerInit(&server, config, fds[index])) {
+        LOG_ERROR("failed to initialize server");
+        _exit(EXIT_FAILURE);
+    }
 
-        LOG_INFO("REQUEST : \n{}", buf);
+    worker_main(&server);
+    _exit(EXIT_FAILURE);
+}
 
-        if (!HttpRequestParse(&req, buf.data)) {
-            LOG_ERROR("failed to parse http request");
-            LOG_ERROR("request was : \n{}", buf);
+static pid_t spawn_worker(ServerConfig *config, i32 *fds, u32 index) {
+    pid_t pid = fork();
+    if (-1 == pid) {
+        LOG_SYS_ERROR("fork() failed");
+    } else if (!pid) {
+        worker_process(config, fds, index);
+    }
+    return pid;
+}
+
+static void master_signal(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+///
+/// Fork a process per worker and restart any of them that dies, until told
+/// to stop. Listening sockets stay open in master, so connections queued on
+/// a crashed worker's socket wait for its replacement instead of being lost.
+///
+/// config[in] : Server configuration shared by all workers.
+/// fds[in]    : Listening socket of each worker.
+///
+static void run_processes(ServerConfig *config, i32 *fds) {
+    pid_t *pids    = calloc(nworkers, sizeof(pid_t));
+    u64   *started = calloc(nworkers, sizeof(u64));
+    if (!pids || !started) {
+        LOG_FATAL("failed to allocate workers");
+    }
+
+    // no SA_RESTART : waitpid() below has to notice
+    struct sigaction action = {.sa_handler = master_signal};
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+
+    for (u32 i = 0; i < nworkers; i++) {
+        pids[i]    = spawn_worker(config, fds, i);
+        started[i] = ClockNowNs();
+    }
+
+    while (!stopping) {
+        i32   status = 0;
+        pid_t pid    = waitpid(-1, &status, 0);
+        if (-1 == pid) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_SYS_ERROR("waitpid() failed");
+            break;
+        }
+
+        u32 i = 0;
+        while (i < nworkers && pids[i] != pid) {
+            i++;
+        }
+        if (i == nworkers) {
             continue;
         }
 
-        ServerMain(connfd, &req);
+        if (WIFSIGNALED(status)) {
+            LOG_ERROR("worker {} killed by signal {}, restarting it", i, WTERMSIG(status));
+        } else {
+            LOG_ERROR("worker {} exited with status {}, restarting it", i, WEXITSTATUS(status));
+        }
+
+        // one dying right away would otherwise be forked again in a tight loop
+        if (ClockNowNs() - started[i] < NSEC_PER_SEC) {
+            sleep(1);
+        }
+
+        // its sockets were closed by kernel, nobody else will release them
+        ConnLimitReleaseHolder(&conn_limiter, i);
+
+        // counters live on in shared memory, replacement keeps adding to them
+        worker_stats[i].restarts++;
+        pids[i]    = spawn_worker(config, fds, i);
+        started[i] = ClockNowNs();
+    }
+
+    for (u32 i = 0; i < nworkers; i++) {
+        if (pids[i] > 0) {
+            kill(pids[i], SIGTERM);
+        }
+    }
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR) {}
+
+    free(started);
+    free(pids);
+}
 
-        HttpRequestDeinit(&req);
+int main() {
+    LogInit(true);
 
-        close(connfd);
-        break;
+    // BEAM_PROCESSES=1 : workers are processes forked and watched over by this one
+    bool processes = ConfigGetU64("BEAM_PROCESSES", 0);
+
+    // shared by every worker, so in shared memory when those are processes
+    RateLimitConfig rate_config = rate_limit_config();
+    rate_config.shared          = processes;
+    if (!RateLimiterInit(&rate_limiter, &rate_config)) {
+        LOG_FATAL("failed to initialize rate limiter");
     }
 
-    close(sockfd);
-    StrDeinit(&buf);
+    doc_root   = ConfigGetZstr("BEAM_DOC_ROOT", NULL);
+    stats_path = ConfigGetZstr("BEAM_STATS_PATH", NULL);
+
+    // a container sees the host's CPUs and memory, but may only use what its cgroup allows
+    char cgroup[PATH_MAX];
+    bool in_cgroup = CgroupFind(cgroup, sizeof(cgroup));
+    if (in_cgroup && (CgroupReadLimits(&limits, cgroup)->cpus || limits.memory)) {
+        WriteFmtLn(
+            "Sizing for cgroup limits: {} CPUs, {} MB memory (0 is unlimited)",
+            limits.cpus,
+            limits.memory >> 20
+        );
+    }
+
+    // pinning keeps memory of a worker on its node, which only matters with more than one of them
+    if (NumaTopologyRead(&topology)) {
+        pin_workers = ConfigGetU64("BEAM_PIN_WORKERS", topology.nodes > 1);
+        if (topology.nodes > 1) {
+            WriteFmtLn("{} NUMA nodes, workers {}pinned", topology.nodes, pin_workers ? "" : "not ");
+        }
+    }
+
+    // mapped once here, so forked and restarted workers all serve from the same copy
+    CacheConfig cache_cfg = cache_config();
+    if (doc_root && cache_cfg.size && !CacheCreate(&cache, &cache_cfg)) {
+        LOG_ERROR("content cache disabled");
+    }
+
+    // a smaller copy per node takes hot files off the interconnect, needs workers pinned to know their node
+    u64 replica_size = ConfigGetU64("BEAM_CACHE_REPLICA_SIZE", 0);
+    if (cache.header && replica_size && pin_workers) {
+        nreplicas = topology.max_node + 1;
+        replicas  = calloc(nreplicas, sizeof(Cache));
+        for (u32 i = 0; replicas && i < topology.count; i++) {
+            u32         node        = topology.cpu_node[i];
+            CacheConfig replica_cfg = cache_cfg;
+            replica_cfg.size        = replica_size;
+            replica_cfg.numa_node   = (i32)node;
+            if (!replicas[node].header && !CacheCreate(&replicas[node], &replica_cfg)) {
+                LOG_ERROR("content replica of node {} disabled", node);
+            }
+        }
+        nreplicas = replicas ? nreplicas : 0;
+    }
+    // walked before accepting, small files land in cache on the way
+    DocIndexConfig index_cfg = DocIndexConfigInit();
+    index_cfg.threads        = (u32)ConfigGetU64("BEAM_INDEX_THREADS", index_cfg.threads);
+    index_cfg.preload_max    = ConfigGetU64("BEAM_INDEX_PRELOAD_MAX", index_cfg.preload_max);
+    index_cfg.cache          = &cache;
+    index_strict             = ConfigGetU64("BEAM_INDEX_STRICT", 0);
+    if (doc_root && index_cfg.threads) {
+        u64 started = ClockNowNs();
+        if (DocIndexBuild(&doc_index, &index_cfg, doc_root)) {
+            WriteFmtLn(
+                "Indexed {} files ({} preloaded) in {} ms",
+                doc_index.count,
+                doc_index.preloaded,
+                (ClockNowNs() - started) / NSEC_PER_MSEC
+            );
+        } else {
+            LOG_ERROR("document root not indexed");
+        }
+    }
+
+    // before forking, workers read published share from shared memory
+    PressureConfig pressure_cfg = pressure_config();
+    pressure_cfg.on_change      = on_pressure;
+    if (pressure_cfg.levels && in_cgroup && !PressureStart(&pressure, &pressure_cfg, cgroup)) {
+        LOG_ERROR("memory pressure not watched, caches stay at full size");
+    }
+
+    cache_snapshot         = cache.header ? ConfigGetZstr("BEAM_CACHE_SNAPSHOT", NULL) : NULL;
+    cache_snapshot_entries = (u32)ConfigGetU64("BEAM_CACHE_SNAPSHOT_ENTRIES", 65536);
+
+    // threads only stop by being killed, a thread of our own catches that to save snapshot first.
+    // worker processes must not inherit blocked signals, master saves once they are gone
+    static sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGTERM);
+    sigaddset(&stop_signals, SIGINT);
+    pthread_t shutdown_thread;
+    if (cache_snapshot && !processes) {
+        pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+        if (pthread_create(&shutdown_thread, NULL, shutdown_main, &stop_signals)) {
+            LOG_FATAL("failed to start shutdown thread");
+        }
+    }
+
+    // workers start accepting right away, files are read back in alongside
+    pthread_t warm_thread;
+    u64       warm_threads = ConfigGetU64("BEAM_CACHE_WARM_THREADS", 4);
+    if (cache_snapshot) {
+        if (pthread_create(&warm_thread, NULL, warm_main, (void *)(uintptr_t)warm_threads)) {
+            LOG_ERROR("failed to start cache warming, starting cold");
+        } else {
+            pthread_detach(warm_thread);
+        }
+    }
+
+    // one worker per CPU we may actually use by default, each with its own listening socket
+    i64 cpus    = sysconf(_SC_NPROCESSORS_ONLN);
+    cpus        = limits.cpus && (!cpus || limits.cpus < cpus) ? limits.cpus : cpus;
+    u32 workers = (u32)ConfigGetU64("BEAM_WORKERS", cpus > 0 ? (u64)cpus : 1);
+    workers     = workers ? workers : 1;
+
+    // a worker process dying leaves its connections counted unless they are known to be its own
+    ConnLimitConfig conn_config = conn_limit_config();
+    conn_config.shared          = processes;
+    conn_config.holders         = processes ? workers : 0;
+    if (!ConnLimiterInit(&conn_limiter, &conn_config)) {
+        LOG_FATAL("failed to initialize connection limiter");
+    }
+
+    ServerConfig server_cfg = server_config(workers, processes);
+
+    // BEAM_BALANCE_RATIO_PCT=0 leaves connections wherever kernel put them,
+    // and sockets can't be queued for another process the way they can for a thread
+    BalanceConfig balance_cfg = balance_config();
+    if (workers > 1 && balance_cfg.ratio_pct && !processes) {
+        if (!BalancerInit(&balancer, &balance_cfg, workers)) {
+            LOG_FATAL("failed to initialize connection balancer");
+        }
+        server_cfg.balancer = &balancer;
+    }
+
+    // peers going away mid-write show up as EPIPE instead of killing us
+    signal(SIGPIPE, SIG_IGN);
+
+    nworkers     = workers;
+    worker_stats = processes ? ShmAlloc(workers * sizeof(Stats)) : calloc(workers, sizeof(Stats));
+    i32 *fds     = calloc(workers, sizeof(i32));
+    if (!worker_stats || !fds) {
+        LOG_FATAL("failed to allocate workers");
+    }
+
+    // "reuseport" : a listening socket per worker, kernel picks one by address hash
+    // "exclusive" : one socket shared by all, kernel wakes a single idle worker for it
+    const char *mode      = ConfigGetZstr("BEAM_ACCEPT_MODE", "reuseport");
+    bool        exclusive = workers > 1 && !strcmp(mode, "exclusive");
+    if (strcmp(mode, "reuseport") && strcmp(mode, "exclusive")) {
+        LOG_FATAL("BEAM_ACCEPT_MODE must be reuseport or exclusive");
+    }
+
+    // a woken worker taking the whole backlog would undo what waking only one achieves
+    server_cfg.listen_exclusive = exclusive;
+    server_cfg.accept_batch     = (u32)ConfigGetU64("BEAM_ACCEPT_BATCH", exclusive ? 1 : 0);
+
+    for (u32 i = 0; i < workers; i++) {
+        fds[i] = exclusive && i ? fds[0] : listen_socket(workers > 1 && !exclusive);
+
+        // accepted sockets inherit this, and receive timestamps give us queueing delay
+        if (server_cfg.load_shed.target_ns && !LoadShedEnableTimestamps(fds[i])) {
+            LOG_ERROR("load shedding disabled, no receive timestamps");
+            server_cfg.load_shed.target_ns = 0;
+        }
+    }
+    WriteFmtLn(
+        "Listening on port {} with {} worker {} ({})...\n",
+        PORT,
+        workers,
+        processes ? "processes" : "threads",
+        exclusive ? "exclusive" : "reuseport"
+    );
+
+    if (processes) {
+        run_processes(&server_cfg, fds);
+        save_snapshot();
+    } else {
+        run_threads(&server_cfg, fds);
+    }
+
+    for (u32 i = 0; i < workers; i++) {
+        if (!exclusive || !i) {
+            close(fds[i]);
+        }
+    }
+    free(fds);
+    if (processes) {
+        ShmFree(worker_stats, workers * sizeof(Stats));
+    } else {
+        free(worker_stats);
+    }
+    if (server_cfg.balancer) {
+        BalancerDeinit(&balancer);
+    }
+    if (pressure.keep_pct) {
+        PressureStop(&pressure);
+    }
+    DocIndexDeinit(&doc_index);
+    for (u32 i = 0; i < nreplicas; i++) {
+        CacheDeinit(&replicas[i]);
+    }
+    free(replicas);
+    CacheDeinit(&cache);
+    NumaTopologyDeinit(&topology);
+    RateLimiterDeinit(&rate_limiter);
+    ConnLimiterDeinit(&conn_limiter);
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,41 @@
+/// file      : addr.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Client address helpers used to key per-client admission state.
+
+#ifndef BEAM_ADDR_H
+#define BEAM_ADDR_H
+
+#include <sys/socket.h>
+
+#include <Misra.h>
+
+///
+/// Hash a client address into a 64-bit key.
+/// IPv4 and IPv4-mapped IPv6 addresses of the same host hash identically.
+///
+/// addr[in]           : Peer address, as filled in by accept().
+/// v6_prefix_bits[in] : Leading bits of an IPv6 address that take part in the key.
+///                      128 keys on the full address, 64 keys on the /64 prefix.
+///                      Ignored for IPv4 peers.
+///
+/// SUCCESS: Non-zero key.
+/// FAILURE: 0 when address family is neither AF_INET nor AF_INET6.
+///
+u64 AddrHash(const struct sockaddr_storage *addr, u32 v6_prefix_bits);
+
+///
+/// Parse a textual IPv4/IPv6 address, as found in forwarding headers.
+/// Surrounding whitespace and a bracketed IPv6 form ("[::1]") are accepted.
+///
+/// addr[out] : Parsed address.
+/// in[in]    : Address text, not necessarily zero-terminated.
+/// len[in]   : Length of `in`.
+///
+/// SUCCESS: true
+/// FAILURE: false
+///
+bool AddrParse(struct sockaddr_storage *addr, const char *in, u64 len);
+
+#endif // BEAM_ADDR_H
@@ -0,0 +1,130 @@
+/// file      : balance.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Connection rebalancing between workers.
+///
+/// SO_REUSEPORT spreads new connections by hash of their addresses, without
+/// looking at how busy each worker is. Long lived keep-alive connections
+/// then pile up unevenly. Here every worker publishes its load (connections
+/// open, queueing delay of requests) and a worker noticeably busier than its
+/// lightest peer hands freshly accepted sockets over to that peer before
+/// reading a single byte from them.
+///
+/// Handoff queues are bounded and lock-free, any worker can push onto any
+/// other worker's queue. Owner is woken up through an eventfd.
+
+#ifndef BEAM_BALANCE_H
+#define BEAM_BALANCE_H
+
+#include <sys/socket.h>
+
+#include <Misra.h>
+
+typedef struct {
+    u32 ratio_pct;   // hand off when own load exceeds lightest peer's by this percentage
+    u32 min_gap;     // ... and by at least this many connections, so small numbers don't bounce around
+    u32 queue_slots; // capacity of each handoff queue, power of two
+} BalanceConfig;
+
+#ifdef __cplusplus
+#    define BalanceConfigInit() (BalanceConfig {.ratio_pct = 125, .min_gap = 8, .queue_slots = 1024})
+#else
+#    define BalanceConfigInit() ((BalanceConfig) {.ratio_pct = 125, .min_gap = 8, .queue_slots = 1024})
+#endif
+
+typedef struct BalanceWorker BalanceWorker;
+
+///
+/// Published load and handoff queues of a set of workers. Shared by all of them.
+///
+typedef struct {
+    BalanceConfig  config;
+    BalanceWorker *workers;
+    u32            count;
+} Balancer;
+
+///
+/// Allocate load slots and handoff queues.
+///
+/// balancer[out] : Balancer to be initialized.
+/// config[in]    : Balancer configuration. Copied.
+/// workers[in]   : Number of workers.
+///
+/// SUCCESS: `balancer`
+/// FAILURE: NULL
+///
+Balancer *BalancerInit(Balancer *balancer, const BalanceConfig *config, u32 workers);
+
+///
+/// Free everything, closing sockets still waiting in handoff queues.
+/// No worker may be using balancer anymore.
+///
+/// balancer[in,out] : Balancer to be deinited.
+///
+/// SUCCESS: Returns with resetted balancer.
+/// FAILURE: Does not return.
+///
+void BalancerDeinit(Balancer *balancer);
+
+///
+/// Publish load of a worker.
+///
+/// balancer[in,out] : Balancer.
+/// worker[in]       : Index of publishing worker.
+/// conns[in]        : Connections open.
+/// delay_ns[in]     : Recent queueing delay of requests, 0 when not measured.
+///
+void BalancePublish(Balancer *balancer, u32 worker, u32 conns, u64 delay_ns);
+
+///
+/// Pick a peer to hand a new connection to. Connections already waiting in
+/// a peer's queue count towards its load.
+///
+/// balancer[in] : Balancer.
+/// worker[in]   : Index of worker that accepted connection.
+///
+/// SUCCESS: Index of a lighter peer.
+/// FAILURE: -1 when connection should stay.
+///
+i32 BalancePick(Balancer *balancer, u32 worker);
+
+///
+/// Queue an accepted socket for another worker and wake it up.
+///
+/// balancer[in,out] : Balancer.
+/// worker[in]       : Index of receiving worker.
+/// fd[in]           : Accepted socket, owned by receiver on success.
+/// addr[in]         : Peer address.
+///
+/// SUCCESS: true
+/// FAILURE: false when queue is full, `fd` stays with caller.
+///
+bool BalanceHandoff(Balancer *balancer, u32 worker, i32 fd, const struct sockaddr_storage *addr);
+
+///
+/// Take next socket handed to a worker. Only called by that worker.
+///
+/// balancer[in,out] : Balancer.
+/// worker[in]       : Index of receiving worker.
+/// fd[out]          : Handed socket.
+/// addr[out]        : Peer address.
+///
+/// SUCCESS: true
+/// FAILURE: false when queue is empty.
+///
+bool BalanceTake(Balancer *balancer, u32 worker, i32 *fd, struct sockaddr_storage *addr);
+
+///
+/// Eventfd becoming readable when sockets are handed to a worker. Reading
+/// it is up to BalanceTake(), caller only registers it for events.
+///
+/// balancer[in] : Balancer.
+/// worker[in]   : Index of worker.
+///
+/// SUCCESS: File descriptor.
+/// FAILURE: Does not fail.
+///
+i32 BalanceEventFd(Balancer *balancer, u32 worker);
+
+#endif // BEAM_BALANCE_H
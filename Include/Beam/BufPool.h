@@ -0,0 +1,97 @@
+/// file      : bufpool.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Fixed pool of equally sized, aligned buffers.
+///
+/// Buffers are carved out of a single allocation made up front, aligned so
+/// they can be used for O_DIRECT reads, and backed by huge pages when kernel
+/// has any. Pool is owned by one thread, other threads may only fill buffers
+/// they were handed.
+
+#ifndef BEAM_BUF_POOL_H
+#define BEAM_BUF_POOL_H
+
+#include <Misra.h>
+
+typedef struct {
+    u8  *mem;         // backing allocation
+    u8 **free;        // stack of unused buffers
+    u32  nfree;       // number of unused buffers
+    u32  count;       // total number of buffers
+    u32  limit;       // buffers that may be in use at once, `count` unless shrunk
+    u64  buffer_size; // size of each buffer
+} BufPool;
+
+#ifdef __cplusplus
+#    define BufPoolInit() (BufPool {0})
+#else
+#    define BufPoolInit() ((BufPool) {0})
+#endif
+
+///
+/// Allocate buffers.
+///
+/// pool[out]       : Pool to be initialized.
+/// buffer_size[in] : Size of each buffer, multiple of `align`.
+/// count[in]       : Number of buffers.
+/// align[in]       : Alignment of each buffer, power of two, at most a page.
+/// huge[in]        : Try backing buffers with huge pages.
+///
+/// SUCCESS: `pool`
+/// FAILURE: NULL
+///
+BufPool *BufPoolCreate(BufPool *pool, u64 buffer_size, u32 count, u64 align, bool huge);
+
+///
+/// Free all buffers. None of them may be in use anymore.
+///
+/// pool[in,out] : Pool to be deinited.
+///
+/// SUCCESS: Returns with resetted pool.
+/// FAILURE: Does not return.
+///
+void BufPoolDeinit(BufPool *pool);
+
+///
+/// Take an unused buffer out of pool.
+///
+/// pool[in,out] : Pool.
+///
+/// SUCCESS: Buffer of `pool->buffer_size` bytes.
+/// FAILURE: NULL when all buffers are in use.
+///
+u8 *BufPoolGet(BufPool *pool);
+
+///
+/// Number of buffers that can be taken right now.
+///
+/// pool[in] : Pool.
+///
+/// SUCCESS: Buffers BufPoolGet() would hand out in a row.
+/// FAILURE: Does not fail.
+///
+u32 BufPoolAvailable(const BufPool *pool);
+
+///
+/// Cap how many buffers may be in use at once, e.g. under memory pressure.
+/// Memory of unused buffers over cap goes back to kernel and comes back
+/// zeroed once they're used again. Buffers in use stay untouched.
+///
+/// pool[in,out] : Pool.
+/// limit[in]    : Buffers that may be in use at once, clamped to pool size.
+///
+/// SUCCESS: Returns with resized pool.
+/// FAILURE: Does not return.
+///
+void BufPoolResize(BufPool *pool, u32 limit);
+
+///
+/// Give a buffer back to pool.
+///
+/// pool[in,out] : Pool buffer was taken from.
+/// buf[in]      : Buffer.
+///
+void BufPoolPut(BufPool *pool, u8 *buf);
+
+#endif // BEAM_BUF_POOL_H
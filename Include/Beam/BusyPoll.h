@@ -0,0 +1,100 @@
+/// file      : busypoll.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Busy polling and adaptive spinning, for when wakeup latency matters more
+/// than CPU time.
+///
+/// Going to sleep in epoll_wait() and being woken up again by an interrupt
+/// costs tens of microseconds, which is most of what a small response takes.
+/// Two things help with that :
+///
+/// - Kernel busy polling (SO_BUSY_POLL, SO_PREFER_BUSY_POLL) makes the kernel
+///   poll device queues itself instead of waiting for interrupts.
+/// - Spinning : before blocking, the loop keeps asking epoll without a timeout
+///   for a little while, in case something arrives right away.
+///
+/// Spinning adapts to load. A spin that comes back empty halves how long the
+/// next one may take, down to nothing when idle, so a quiet server sleeps
+/// like any other. A sleep ended by an event soon enough that spinning would
+/// have caught it doubles the budget again, up to the configured maximum.
+
+#ifndef BEAM_BUSY_POLL_H
+#define BEAM_BUSY_POLL_H
+
+#include <Misra.h>
+
+typedef struct {
+    u32 poll_us;     // SO_BUSY_POLL on listening socket and epoll instance, 0 leaves kernel defaults
+    u32 poll_budget; // packets per busy poll, 0 for kernel default
+    u64 spin_ns;     // longest spin before blocking in epoll_wait(), 0 never spins
+    u64 spin_min_ns; // shorter spins aren't worth it, budget below this is dropped to zero
+} BusyPollConfig;
+
+#ifdef __cplusplus
+#    define BusyPollConfigInit() (BusyPollConfig {.poll_us = 0, .poll_budget = 0, .spin_ns = 0, .spin_min_ns = 2000})
+#else
+#    define BusyPollConfigInit() ((BusyPollConfig) {.poll_us = 0, .poll_budget = 0, .spin_ns = 0, .spin_min_ns = 2000})
+#endif
+
+///
+/// Adaptive spin budget. Owned by a single thread, not safe for concurrent use.
+///
+typedef struct {
+    BusyPollConfig config;
+    u64            budget_ns; // how long next spin may take
+} BusySpin;
+
+#ifdef __cplusplus
+#    define BusySpinInit(cfg) (BusySpin {.config = (cfg), .budget_ns = (cfg).spin_ns})
+#else
+#    define BusySpinInit(cfg) ((BusySpin) {.config = (cfg), .budget_ns = (cfg).spin_ns})
+#endif
+
+///
+/// Turn kernel busy polling on for a socket. Sockets accepted from a listening
+/// socket inherit the setting. Values above system defaults need CAP_NET_ADMIN.
+///
+/// sockfd[in] : Socket to busy poll.
+/// config[in] : Busy poll configuration.
+///
+/// SUCCESS: true
+/// FAILURE: false
+///
+bool BusyPollEnable(int sockfd, const BusyPollConfig *config);
+
+///
+/// Turn kernel busy polling on for an epoll instance, where kernel supports
+/// per-instance parameters. Without them, only `net.core.busy_poll` applies.
+///
+/// epfd[in]   : Epoll instance.
+/// config[in] : Busy poll configuration.
+///
+/// SUCCESS: true
+/// FAILURE: false
+///
+bool BusyPollEnableEpoll(int epfd, const BusyPollConfig *config);
+
+///
+/// Record outcome of a spin.
+///
+/// spin[in,out] : Spin budget.
+/// found[in]    : Whether spinning came back with events.
+///
+/// SUCCESS: Returns with updated budget.
+/// FAILURE: Does not fail.
+///
+void BusySpinSpun(BusySpin *spin, bool found);
+
+///
+/// Record a blocking wait that ended with events.
+///
+/// spin[in,out] : Spin budget.
+/// slept_ns[in] : How long the wait took.
+///
+/// SUCCESS: Returns with updated budget.
+/// FAILURE: Does not fail.
+///
+void BusySpinWoke(BusySpin *spin, u64 slept_ns);
+
+#endif // BEAM_BUSY_POLL_H
@@ -0,0 +1,267 @@
+/// file      : cache.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Static content cache shared by all workers.
+///
+/// Whole region is one memfd mapping (huge pages when kernel has any to
+/// spare) made before workers are forked, so every worker process serves
+/// from a single copy and a restarted worker comes up warm. Nothing in it
+/// is a pointer : everything refers to everything else by index, the region
+/// can be mapped at a different address in every process. On NUMA hosts
+/// region is interleaved over all nodes, or placed on one node for a replica
+/// serving workers of that node.
+///
+/// Region layout :
+///
+/// - Header, with writer lock, policy lists and read buffers.
+/// - Slot index, open-addressed by hash of file path. Each slot is guarded
+///   by a seqlock : writers make sequence odd while changing it, readers
+///   retry or give up when sequence was odd or changed under them.
+/// - Frequency sketch of recently looked up paths.
+/// - Block chains : entries (path followed by content) are stored in fixed
+///   size blocks, each block naming the next one.
+///
+/// Lookups never lock. They copy content out and then check that slot didn't
+/// change while copying, so they never hand out bytes of a block that was
+/// freed and reused meanwhile. Writers take a process-shared robust mutex,
+/// a worker dying while holding it gets the cache flushed by whoever takes
+/// it next.
+///
+/// Eviction follows W-TinyLFU : new entries go into a small window LRU, what
+/// falls out of it is admitted into main LRU only if looked up more often
+/// than what main would evict to make room. Main is segmented, entries hit
+/// while on probation are promoted to a protected segment. One-off lookups
+/// (crawlers walking every page) churn through window without pushing hot
+/// pages out. Lookups being lock-free, hits are recorded in lossy buffers
+/// that writers replay into LRU order.
+///
+/// A generation number goes up whenever a cached file is replaced by a
+/// different version of it. Workers keeping copies of their own compare it
+/// to the one their copies were made at.
+///
+/// Slots count lookups they served. Hottest entries can be written to a
+/// snapshot on shutdown and read back in on next start, so a restart
+/// doesn't begin with an empty cache.
+
+#ifndef BEAM_CACHE_H
+#define BEAM_CACHE_H
+
+#include <stdatomic.h>
+
+#include <Misra.h>
+
+typedef enum {
+    CACHE_POLICY_LRU,     // one LRU, anything looked up is cached
+    CACHE_POLICY_TINYLFU, // window LRU, frequency admission, segmented main LRU
+} CachePolicy;
+
+typedef struct {
+    u64         size;          // bytes of content blocks, 0 disables caching
+    u32         slots;         // number of index slots, power of two
+    u64         max_object;    // bigger files are never cached
+    bool        hugepages;     // try backing region with huge pages first
+    CachePolicy policy;        // eviction policy
+    u32         block_size;    // bytes of one content block, power of two
+    u32         window_pct;    // share of size taken by window, at least max_object
+    u32         protected_pct; // share of main that can be protected
+    i32         numa_node;     // NUMA node region is placed on, -1 interleaves it over all nodes
+} CacheConfig;
+
+#ifdef __cplusplus
+#    define CacheConfigInit()                                                                                          \
+        (CacheConfig {                                                                                                 \
+            .size          = 67108864ull,                                                                              \
+            .slots         = 16384,                                                                                    \
+            .max_object    = 1048576,                                                                                  \
+            .hugepages     = true,                                                                                     \
+            .policy        = CACHE_POLICY_TINYLFU,                                                                     \
+            .block_size    = 4096,                                                                                     \
+            .window_pct    = 1,                                                                                        \
+            .protected_pct = 80,                                                                                       \
+            .numa_node     = -1                                                                                        \
+        })
+#else
+#    define CacheConfigInit()                                                                                          \
+        ((CacheConfig) {.size          = 67108864ull,                                                                  \
+                        .slots         = 16384,                                                                        \
+                        .max_object    = 1048576,                                                                      \
+                        .hugepages     = true,                                                                         \
+                        .policy        = CACHE_POLICY_TINYLFU,                                                         \
+                        .block_size    = 4096,                                                                         \
+                        .window_pct    = 1,                                                                            \
+                        .protected_pct = 80,                                                                           \
+                        .numa_node     = -1})
+#endif
+
+typedef struct CacheHeader CacheHeader;
+typedef struct CacheSlot   CacheSlot;
+
+///
+/// Mapping of shared region. Safe for concurrent use by any number of
+/// threads and processes.
+///
+typedef struct {
+    CacheConfig   config;
+    CacheHeader  *header;
+    CacheSlot    *slots;
+    _Atomic(u8)  *sketch;   // frequency counters, 4 rows
+    _Atomic(u32) *next;     // block following each block in its chain
+    char         *blocks;   // content blocks
+    u64           map_size; // bytes mapped, header and index included
+    bool          huge;     // region is backed by huge pages
+} Cache;
+
+#ifdef __cplusplus
+#    define CacheInit()                                                                                                \
+        (Cache {                                                                                                       \
+            .config   = CacheConfigInit(),                                                                             \
+            .header   = NULL,                                                                                          \
+            .slots    = NULL,                                                                                          \
+            .sketch   = NULL,                                                                                          \
+            .next     = NULL,                                                                                          \
+            .blocks   = NULL,                                                                                          \
+            .map_size = 0,                                                                                             \
+            .huge     = false                                                                                          \
+        })
+#else
+#    define CacheInit()                                                                                                \
+        ((Cache) {.config   = CacheConfigInit(),                                                                       \
+                  .header   = NULL,                                                                                    \
+                  .slots    = NULL,                                                                                    \
+                  .sketch   = NULL,                                                                                    \
+                  .next     = NULL,                                                                                    \
+                  .blocks   = NULL,                                                                                    \
+                  .map_size = 0,                                                                                       \
+                  .huge     = false})
+#endif
+
+///
+/// What a cached file must still match to be served. Anything changed on disk
+/// makes a lookup miss.
+///
+typedef struct {
+    u64 file_id;  // device and inode
+    u64 mtime_ns; // last modification
+    u64 size;     // file size
+} CacheValidator;
+
+///
+/// Create and map shared region. Workers forked afterwards share it.
+///
+/// cache[out] : Cache to be initialized.
+/// config[in] : Cache configuration. Copied.
+///
+/// SUCCESS: `cache`
+/// FAILURE: NULL
+///
+Cache *CacheCreate(Cache *cache, const CacheConfig *config);
+
+///
+/// Unmap shared region. Region goes away once last process unmaps it.
+///
+/// cache[in,out] : Cache to be deinited.
+///
+/// SUCCESS: Returns with resetted cache.
+/// FAILURE: Does not return.
+///
+void CacheDeinit(Cache *cache);
+
+///
+/// Look a file up and append its content to `out`.
+///
+/// cache[in,out] : Cache.
+/// path[in]      : File path, as cached.
+/// valid[in]     : What cached file has to match.
+/// out[in,out]   : Content is appended here. Left as it was on a miss.
+///
+/// SUCCESS: true on a hit.
+/// FAILURE: false on a miss.
+///
+bool CacheGet(Cache *cache, const char *path, const CacheValidator *valid, Str *out);
+
+///
+/// Store content of a file as most recently used entry of window, evicting
+/// per policy to make room. Gives up when file is too big, or when another
+/// writer holds cache and caller chose not to wait.
+///
+/// cache[in,out] : Cache.
+/// path[in]      : File path.
+/// valid[in]     : Validators of file content was read from.
+/// data[in]      : Content.
+/// size[in]      : Number of bytes.
+/// wait[in]      : Wait for other writers instead of giving up.
+///
+/// SUCCESS: true when stored.
+/// FAILURE: false
+///
+bool CachePut(Cache *cache, const char *path, const CacheValidator *valid, const char *data, u64 size, bool wait);
+
+///
+/// Write hottest entries to a snapshot file : path, lookups served and
+/// validators of each, no content. Workers may keep serving meanwhile.
+/// File is replaced atomically.
+///
+/// cache[in]       : Cache.
+/// path[in]        : Snapshot file.
+/// max_entries[in] : Entries kept, by number of lookups served.
+///
+/// SUCCESS: true
+/// FAILURE: false, previous snapshot is left as it was.
+///
+bool CacheSave(Cache *cache, const char *path, u32 max_entries);
+
+///
+/// Read files listed in a snapshot back into cache, several at a time.
+/// Files unchanged since snapshot keep their lookup counts, changed ones
+/// are loaded afresh and missing ones skipped. Blocks until done.
+///
+/// cache[in,out] : Cache.
+/// path[in]      : Snapshot file.
+/// threads[in]   : Files read in parallel.
+///
+/// SUCCESS: Number of entries loaded, 0 when there's no snapshot yet.
+/// FAILURE: -1 when snapshot can't be read.
+///
+i64 CacheWarm(Cache *cache, const char *path, u32 threads);
+
+///
+/// Change how much of the mapped region content may take, e.g. to give
+/// memory back under pressure and take it again later. Shrinking evicts
+/// whatever lies past new size and returns those pages to kernel, in every
+/// process at once. Size is clamped between what one biggest entry takes and
+/// what cache was created with.
+///
+/// cache[in,out] : Cache.
+/// size[in]      : Bytes of content blocks to allow.
+///
+/// SUCCESS: Bytes of content blocks now allowed.
+/// FAILURE: 0 when caching is disabled or cache can't be locked anymore.
+///
+u64 CacheResize(Cache *cache, u64 size);
+
+///
+/// Generation of cached content, changes whenever a cached file is replaced
+/// by a different version. Copies made at an older generation may be stale.
+///
+/// cache[in] : Cache.
+///
+/// SUCCESS: Current generation, 0 when caching is disabled.
+/// FAILURE: Does not fail.
+///
+u64 CacheGeneration(Cache *cache);
+
+///
+/// Render policy and its counters as "name value" lines, hit ratio included.
+///
+/// cache[in]  : Cache.
+/// hits[in]   : Lookups that hit, as counted by workers.
+/// misses[in] : Lookups that missed.
+/// out[out]   : Text is appended here.
+///
+/// SUCCESS: `out`
+/// FAILURE: Does not fail.
+///
+Str *CacheRender(Cache *cache, u64 hits, u64 misses, Str *out);
+
+#endif // BEAM_CACHE_H
@@ -0,0 +1,53 @@
+/// file      : cgroup.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Control group (v2) this process runs in.
+///
+/// In a container, limits that matter are those of its cgroup, not those of
+/// the host : a container given 2 CPUs on a 64 core host shouldn't size
+/// itself for 64. Only the unified hierarchy is looked at, mounted where
+/// systemd and container runtimes put it.
+
+#ifndef BEAM_CGROUP_H
+#define BEAM_CGROUP_H
+
+#include <Misra.h>
+
+// where unified hierarchy is mounted
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
+typedef struct {
+    u32 cpus;   // CPUs worth of time we may take, quota rounded up and capped by cpuset, 0 for no limit
+    u64 memory; // bytes we may use, lowest memory.max or memory.high up the hierarchy, 0 for no limit
+} CgroupLimits;
+
+#ifdef __cplusplus
+#    define CgroupLimitsInit() (CgroupLimits {.cpus = 0, .memory = 0})
+#else
+#    define CgroupLimitsInit() ((CgroupLimits) {.cpus = 0, .memory = 0})
+#endif
+
+///
+/// Find directory of cgroup this process is in.
+///
+/// dir[out]  : Directory path is written here.
+/// size[in]  : Bytes available in `dir`.
+///
+/// SUCCESS: `dir`
+/// FAILURE: NULL when not in a cgroup v2 hierarchy, or it isn't mounted.
+///
+char *CgroupFind(char *dir, u64 size);
+
+///
+/// Read CPU and memory limits applying to a cgroup, its ancestors' included.
+///
+/// limits[out] : Limits found, zero for whatever isn't limited.
+/// dir[in]     : Cgroup directory, as found by CgroupFind().
+///
+/// SUCCESS: `limits`
+/// FAILURE: Does not fail, unreadable files limit nothing.
+///
+CgroupLimits *CgroupReadLimits(CgroupLimits *limits, const char *dir);
+
+#endif // BEAM_CGROUP_H
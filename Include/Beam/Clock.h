@@ -0,0 +1,45 @@
+/// file      : clock.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Cheap monotonic time source shared by beam's hot paths.
+
+#ifndef BEAM_CLOCK_H
+#define BEAM_CLOCK_H
+
+#include <time.h>
+
+#include <Misra.h>
+
+#define NSEC_PER_USEC 1000ull
+#define NSEC_PER_MSEC 1000000ull
+#define NSEC_PER_SEC  1000000000ull
+
+///
+/// Get current monotonic time in nanoseconds.
+/// Only differences between two values returned by this are meaningful.
+///
+/// SUCCESS: Monotonic timestamp in nanoseconds.
+/// FAILURE: Does not fail.
+///
+static inline u64 ClockNowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * NSEC_PER_SEC + (u64)ts.tv_nsec;
+}
+
+///
+/// Get time it takes to move `units` of something at `per_sec` units per second.
+/// Does not overflow for large `units`.
+///
+/// units[in]   : Amount of things to be moved (bytes, requests, ...).
+/// per_sec[in] : Non-zero rate in units per second.
+///
+/// SUCCESS: Duration in nanoseconds.
+/// FAILURE: Does not fail.
+///
+static inline u64 ClockRateIntervalNs(u64 units, u64 per_sec) {
+    return (units / per_sec) * NSEC_PER_SEC + ((units % per_sec) * NSEC_PER_SEC) / per_sec;
+}
+
+#endif // BEAM_CLOCK_H
@@ -0,0 +1,36 @@
+/// file      : config.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Runtime configuration knobs for beam.
+/// Every knob is read from a `BEAM_*` environment variable and falls back
+/// to a compiled-in default when the variable is absent or malformed.
+
+#ifndef BEAM_CONFIG_H
+#define BEAM_CONFIG_H
+
+#include <Misra.h>
+
+///
+/// Read an unsigned integer knob.
+///
+/// name[in]     : Environment variable name (eg: "BEAM_RATE_LIMIT_RPS").
+/// fallback[in] : Value to use when variable is not set or not a number.
+///
+/// SUCCESS: Parsed value or `fallback`.
+/// FAILURE: Does not fail.
+///
+u64 ConfigGetU64(const char *name, u64 fallback);
+
+///
+/// Read a string knob.
+///
+/// name[in]     : Environment variable name.
+/// fallback[in] : Value to use when variable is not set or empty.
+///
+/// SUCCESS: Zero-terminated value owned by the environment, or `fallback`.
+/// FAILURE: Does not fail.
+///
+const char *ConfigGetZstr(const char *name, const char *fallback);
+
+#endif // BEAM_CONFIG_H
@@ -0,0 +1,323 @@
+/// file      : conn.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Client connections : input buffer, output queue and per-connection accounting.
+/// Connections are owned by a Server and recycled through its connection slab.
+
+#ifndef BEAM_CONN_H
+#define BEAM_CONN_H
+
+#include <sys/socket.h>
+
+#include <Misra.h>
+#include <Beam/BufPool.h>
+#include <Beam/ConnLimit.h>
+#include <Beam/DataRate.h>
+#include <Beam/HotCache.h>
+#include <Beam/Http.h>
+#include <Beam/Prefetch.h>
+#include <Beam/Ring.h>
+#include <Beam/Stats.h>
+
+// O_DIRECT reads must start at a multiple of this, stream buffers are aligned to it
+#define CONN_DIRECT_ALIGN 4096
+
+typedef enum {
+    CONN_CHUNK_STATIC, // bytes outliving the connection (pre-rendered responses)
+    CONN_CHUNK_MEMORY, // bytes owned by the chunk
+    CONN_CHUNK_FILE,   // file range, sent with sendfile()
+    CONN_CHUNK_DIRECT  // file range read with O_DIRECT, bypassing page cache
+} ConnChunkKind;
+
+///
+/// Double-buffered reads of a DIRECT chunk. While one buffer is being sent the
+/// other one is filled by the I/O pool.
+///
+typedef struct {
+    BufPool *pool;    // where buffers go back to
+    u8      *buf[2];
+    u64      pos[2];  // file offset of first byte in buffer
+    u64      len[2];  // valid bytes in buffer, 0 when empty
+    bool     busy[2]; // being filled, owned by read job until it completes
+    u32      cur;     // buffer being sent
+    u64      next;    // file offset of next read, aligned
+    i32      error;   // errno of a failed read, 0 if none
+} ConnStream;
+
+///
+/// Buffer lent to kernel by MSG_ZEROCOPY sends. Pages keep going out from it
+/// until kernel reports every send using it complete on socket error queue.
+///
+typedef struct ConnLent ConnLent;
+
+///
+/// Socket of a closed connection, kept open without being served until kernel
+/// gives back buffers lent to it, so that they aren't reused while still going
+/// out.
+///
+typedef struct ConnOrphan ConnOrphan;
+
+typedef struct {
+    ConnChunkKind kind;
+    Str           buf;       // MEMORY : owned bytes, moved to `lent` once sent with MSG_ZEROCOPY
+    const char   *data;      // STATIC, MEMORY : bytes to be sent
+    i32           fd;        // FILE : file to send from, closed along with chunk
+    u64           offset;    // STATIC, MEMORY : bytes already sent. FILE : next file offset to send
+    u64           end;       // STATIC, MEMORY : number of bytes. FILE : file offset to stop at
+    u64           start;     // FILE : file offset chunk started at
+    u64           cached;    // FILE : file offset up to which pages are known to be in page cache
+    u64           readahead; // FILE : bytes queued for reading on a page cache miss, 0 for just what is waited for
+    bool          dontneed;  // FILE : drop sent range from page cache once done, holds a shared flock() till then
+    ConnStream   *stream;    // DIRECT : read buffers
+    ConnLent     *lent;      // MEMORY : owner of bytes once lent to kernel, NULL before
+} ConnChunk;
+
+///
+/// FIFO of chunks waiting to be written, kept as a ring that grows on demand.
+///
+typedef struct {
+    ConnChunk *chunks;
+    u32        head;     // index of oldest chunk
+    u32        count;    // number of queued chunks
+    u32        capacity; // power of two
+    u64        bytes;    // bytes left to be sent across all chunks
+} ConnQueue;
+
+typedef enum {
+    CONN_LIST_NONE,
+    CONN_LIST_PENDING,   // needs a visit in next event loop iteration
+    CONN_LIST_THROTTLED, // has output but is over its rate cap
+    CONN_LIST_READY      // being visited in current event loop iteration
+} ConnListId;
+
+typedef struct Conn Conn;
+
+struct Conn {
+    i32                     fd;
+    u64                     id;                // unique among connections of a server, tells reused slab entries apart
+    struct sockaddr_storage addr;
+    ConnLimitSlot          *limit_slot;        // per-client connection counter, released on close
+    u64                     client_key;        // rate limit key of last admitted request
+    Ring                    in;                // received but not yet consumed bytes
+    u64                     discard;           // request body bytes still to be skipped
+    u64                     sojourn;           // how long request being received waited in kernel
+    ConnQueue               out;               // bytes waiting to be written
+    DataRateMeter           upload;            // throughput of request being received
+    DataRateMeter           download;          // throughput of output queue being drained
+    u64                     burst_sent;        // bytes sent since output queue was last empty
+    u64                     throttle_tat;      // when connection may send again under its rate cap
+    u64                     last_active;       // last time anything was received or sent
+    bool                    readable;          // socket may have unread data
+    bool                    writable;          // socket may have buffer space
+    bool                    peer_closed;       // peer won't send anything more
+    bool                    close_after_write; // close once output queue drains
+    bool                    offload_io;        // check file chunks for page cache misses before sending
+    bool                    io_wait;           // front file chunk is being read into page cache or buffers
+    BufPool                *direct_pool;       // aligned buffers for DIRECT chunks, NULL to never bypass page cache
+    u64                     direct_min;        // file ranges at least this long bypass page cache
+    Prefetch               *prefetch;          // readahead policy for file responses, NULL for kernel defaults
+    HotCache               *hot_cache;         // rendered responses of owning server, NULL to not keep any
+    u64                     zerocopy_min;      // in-memory sends this big go out with MSG_ZEROCOPY, 0 always copies
+    u32                     zerocopy_next;     // sequence number kernel gives next MSG_ZEROCOPY send
+    ConnLent               *lent;              // buffers lent to kernel, waiting for completion
+    bool                    lingering;         // write side shut down, waiting for lent buffers to come back
+    Stats                  *stats;             // counters of owning server, NULL to not count
+
+    // event loop bookkeeping, owned by Server
+    Conn      *next;       // open connections, or free slab entries
+    Conn      *prev;
+    Conn      *run_next;   // pending or throttled list
+    Conn      *run_prev;
+    ConnListId run_list;
+    bool       backlogged; // stopped serving requests until output queue drains
+};
+
+typedef struct {
+    Conn *head;
+    Conn *tail;
+} ConnList;
+
+///
+/// Start using a slab entry for a freshly accepted connection.
+/// Input buffer allocated by a previous user of the slab entry is reused.
+///
+/// conn[in,out]   : Slab entry.
+/// fd[in]         : Accepted, non-blocking socket.
+/// addr[in]       : Peer address.
+/// input_size[in] : Size of input buffer, caps request head size.
+/// now[in]        : Current monotonic time.
+///
+/// SUCCESS: `conn`
+/// FAILURE: NULL
+///
+Conn *ConnOpen(Conn *conn, i32 fd, const struct sockaddr_storage *addr, u64 input_size, u64 now);
+
+///
+/// Close connection socket and drop everything queued on it.
+/// Slab entry keeps its buffers for the next connection. When kernel may
+/// still be sending from lent buffers, socket is shut down instead and moves
+/// to `orphans` along with them, caller takes it out of epoll beforehand.
+///
+/// conn[in,out]    : Connection.
+/// reset[in]       : Reset connection instead of closing it gracefully.
+/// orphans[in,out] : Where sockets with lent buffers go, NULL leaks such buffers instead.
+/// now[in]         : Current monotonic time.
+///
+void ConnClose(Conn *conn, bool reset, ConnOrphan **orphans, u64 now);
+
+///
+/// Free buffers held by a slab entry.
+///
+/// conn[in,out] : Closed connection.
+///
+void ConnDeinit(Conn *conn);
+
+///
+/// Read everything socket has for us, up to space left in input buffer.
+/// Receive timestamp of first bytes of a new request is recorded in `conn->sojourn`.
+///
+/// conn[in,out] : Connection.
+/// now[in]      : Current monotonic time.
+///
+/// SUCCESS: Number of bytes read, possibly 0.
+/// FAILURE: -1 on socket error.
+///
+i64 ConnRead(Conn *conn, u64 now);
+
+///
+/// Drop bytes from start of input buffer.
+///
+/// conn[in,out] : Connection.
+/// n[in]        : Number of bytes to drop.
+///
+void ConnConsume(Conn *conn, u64 n);
+
+///
+/// Write queued output, at most `budget` bytes.
+/// Consecutive in-memory chunks, such as heads and bodies of several pipelined
+/// responses, go out together in one sendmsg(). With `zerocopy_min` set, a
+/// send carrying that many bytes of one chunk lends its buffers to kernel with
+/// MSG_ZEROCOPY instead of having them copied.
+/// With `offload_io` set, stops in front of file pages missing from page cache
+/// and sets `io_wait` instead of blocking on disk.
+///
+/// conn[in,out] : Connection.
+/// budget[in]   : Maximum number of bytes to write.
+///
+/// SUCCESS: Number of bytes written, possibly 0.
+/// FAILURE: -1 on socket error.
+///
+i64 ConnWrite(Conn *conn, u64 budget);
+
+///
+/// Take MSG_ZEROCOPY completions off socket error queue and free buffers
+/// kernel is done with.
+///
+/// conn[in,out] : Connection.
+///
+/// SUCCESS: Number of completions taken, possibly 0.
+/// FAILURE: -1 on socket error.
+///
+i64 ConnReapZerocopy(Conn *conn);
+
+///
+/// Whether kernel may still be sending from buffers lent to it. Closing
+/// connection before then resets it, dropping whatever wasn't sent yet.
+///
+/// conn[in] : Connection.
+///
+/// SUCCESS: true if some lent buffer is still in use.
+/// FAILURE: Does not fail.
+///
+bool ConnLending(Conn *conn);
+
+///
+/// Take MSG_ZEROCOPY completions of orphaned sockets, freeing buffers kernel
+/// is done with and closing sockets that have nothing lent anymore. Sockets
+/// orphaned for too long are closed all the same, their buffers are leaked
+/// rather than risk sending them to a peer reusing them.
+///
+/// orphans[in,out] : Orphaned sockets.
+/// now[in]         : Current monotonic time.
+/// timeout_ns[in]  : How long completions are waited for, 0 gives up on all of them.
+///
+/// SUCCESS: Number of sockets still orphaned.
+/// FAILURE: Does not fail.
+///
+u32 ConnOrphansReap(ConnOrphan **orphans, u64 now, u64 timeout_ns);
+
+///
+/// Queue static bytes that outlive the connection. Nothing is copied.
+///
+/// conn[in,out] : Connection.
+/// data[in]     : Bytes to send.
+/// size[in]     : Number of bytes.
+///
+/// SUCCESS: true
+/// FAILURE: false
+///
+bool ConnQueueStatic(Conn *conn, const char *data, u64 size);
+
+///
+/// Queue bytes of a string, taking ownership of its buffer.
+///
+/// conn[in,out] : Connection.
+/// s[in,out]    : String to send, left empty.
+///
+/// SUCCESS: true
+/// FAILURE: false
+///
+bool ConnQueueStr(Conn *conn, Str *s);
+
+///
+/// Queue a file range, taking ownership of the file descriptor.
+/// Ranges of at least `direct_min` bytes are streamed with O_DIRECT through
+/// buffers from `direct_pool` while any are left, so huge read-once files
+/// don't push everything else out of page cache.
+///
+/// conn[in,out] : Connection.
+/// fd[in]       : File to send from, closed when done.
+/// offset[in]   : File offset to start from.
+/// length[in]   : Number of bytes to send.
+///
+/// SUCCESS: true
+/// FAILURE: false, `fd` is closed.
+///
+bool ConnQueueFile(Conn *conn, i32 fd, u64 offset, u64 length);
+
+///
+/// Oldest chunk in output queue, the one being sent.
+///
+/// conn[in] : Connection.
+///
+/// SUCCESS: Front chunk.
+/// FAILURE: NULL when output queue is empty.
+///
+ConnChunk *ConnFront(Conn *conn);
+
+///
+/// Render and queue a response. File bodies are moved out of `response`.
+/// File bodies sent through page cache are prefetched as `prefetch` advises.
+/// A response asking to close connection makes connection close once it's sent.
+///
+/// conn[in,out]     : Connection.
+/// response[in,out] : Prepared response.
+///
+/// SUCCESS: true
+/// FAILURE: false
+///
+bool ConnQueueResponse(Conn *conn, HttpResponse *response);
+
+///
+/// Queue a pre-rendered response and close connection once it's sent.
+///
+/// conn[in,out] : Connection.
+/// code[in]     : Status code with a pre-rendered response.
+///
+/// SUCCESS: true
+/// FAILURE: false
+///
+bool ConnQueueCanned(Conn *conn, HttpResponseCode code);
+
+#endif // BEAM_CONN_H
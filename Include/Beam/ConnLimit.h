@@ -0,0 +1,113 @@
+/// file      : connlimit.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Per-client cap on simultaneous connections, checked right after accept().
+///
+/// Counters live in an open-addressed table of 64-bit words, each packing a
+/// 48-bit client tag with a 16-bit connection count. Packing both in one word
+/// lets a slot be recycled for another client (once its count drops to zero)
+/// with a single compare-and-swap, so the table never needs a lock.
+///
+/// A worker process killed never releases what it held, its sockets are just
+/// closed by kernel. With holders configured, each worker also keeps its own
+/// count per slot, and whoever reaps a dead worker hands its counts back.
+
+#ifndef BEAM_CONN_LIMIT_H
+#define BEAM_CONN_LIMIT_H
+
+#include <stdatomic.h>
+#include <sys/socket.h>
+
+#include <Misra.h>
+
+typedef struct {
+    u32  max_per_client; // simultaneous connections allowed per client, 0 disables limiting (at most 65535)
+    u32  v6_prefix_bits; // IPv6 clients are keyed on this many leading bits
+    u32  table_slots;    // number of counters, power of two
+    bool shared;         // table in memory shared with forked worker processes
+    u32  holders;        // workers whose counts are kept apart, to be released if one dies, 0 keeps none
+} ConnLimitConfig;
+
+#ifdef __cplusplus
+#    define ConnLimitConfigInit()                                                                                      \
+        (ConnLimitConfig {                                                                                             \
+            .max_per_client = 0,                                                                                       \
+            .v6_prefix_bits = 64,                                                                                      \
+            .table_slots    = 65536,                                                                                   \
+            .shared         = false,                                                                                   \
+            .holders        = 0                                                                                        \
+        })
+#else
+#    define ConnLimitConfigInit()                                                                                      \
+        ((ConnLimitConfig) {.max_per_client = 0,                                                                       \
+                            .v6_prefix_bits = 64,                                                                      \
+                            .table_slots    = 65536,                                                                   \
+                            .shared         = false,                                                                   \
+                            .holders        = 0})
+#endif
+
+typedef struct ConnLimitSlot ConnLimitSlot;
+
+typedef struct {
+    ConnLimitConfig config;
+    ConnLimitSlot  *slots;
+    _Atomic(u16)   *held; // count of every holder in every slot, `holders` rows of `table_slots`
+} ConnLimiter;
+
+///
+/// Allocate counter table for given configuration.
+///
+/// limiter[out] : Limiter to be initialized.
+/// config[in]   : Limit and table geometry. Copied.
+///
+/// SUCCESS: `limiter`
+/// FAILURE: NULL
+///
+ConnLimiter *ConnLimiterInit(ConnLimiter *limiter, const ConnLimitConfig *config);
+
+///
+/// Free counter table.
+///
+/// limiter[in,out] : Limiter to be deinited.
+///
+/// SUCCESS: Returns with resetted limiter.
+/// FAILURE: Does not return.
+///
+void ConnLimiterDeinit(ConnLimiter *limiter);
+
+///
+/// Account for a freshly accepted connection from `peer`.
+/// Must be called before any per-connection state is allocated so
+/// rejected connections cost nothing more than the accept itself.
+///
+/// limiter[in,out] : Limiter.
+/// holder[in]      : Worker taking connection on, counted apart when below `holders`.
+/// peer[in]        : Peer address as returned by accept().
+/// slot[out]       : Counter to hand back to ConnLimitRelease when connection closes.
+///                   Set to NULL when connection is not being tracked.
+///
+/// SUCCESS: true when connection may proceed.
+/// FAILURE: false when client already has too many connections open.
+///
+bool ConnLimitAcquire(ConnLimiter *limiter, u32 holder, const struct sockaddr_storage *peer, ConnLimitSlot **slot);
+
+///
+/// Account for a closed connection.
+///
+/// limiter[in,out] : Limiter.
+/// holder[in]      : Worker connection was acquired by.
+/// slot[in]        : Counter returned by ConnLimitAcquire, may be NULL.
+///
+void ConnLimitRelease(ConnLimiter *limiter, u32 holder, ConnLimitSlot *slot);
+
+///
+/// Release every connection a worker still holds, once it's gone for good
+/// and nothing else will. Its replacement starts from nothing.
+///
+/// limiter[in,out] : Limiter.
+/// holder[in]      : Worker that died.
+///
+void ConnLimitReleaseHolder(ConnLimiter *limiter, u32 holder);
+
+#endif // BEAM_CONN_LIMIT_H
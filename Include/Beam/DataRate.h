@@ -0,0 +1,65 @@
+/// file      : datarate.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Minimum data-rate enforcement against slow-send and slow-read clients.
+///
+/// A meter estimates throughput over a sliding window from two adjacent fixed
+/// windows (current one, weighted previous one), which costs a couple of adds per
+/// recv/send. Transfers whose rate over a full window stays under the configured
+/// floor are aborted, so a slow client cannot hold on to a connection forever.
+
+#ifndef BEAM_DATA_RATE_H
+#define BEAM_DATA_RATE_H
+
+#include <Misra.h>
+
+typedef struct {
+    u64 min_bytes_per_sec; // throughput floor in both directions, 0 disables enforcement
+    u64 window_ns;         // sliding window throughput is measured over
+} DataRateConfig;
+
+#ifdef __cplusplus
+#    define DataRateConfigInit() (DataRateConfig {.min_bytes_per_sec = 0, .window_ns = 10000000000ull})
+#else
+#    define DataRateConfigInit() ((DataRateConfig) {.min_bytes_per_sec = 0, .window_ns = 10000000000ull})
+#endif
+
+typedef struct {
+    u64 started;      // when transfer started, nothing is judged before a full window passed
+    u64 window_start; // start of current fixed window
+    u64 window_bytes; // bytes moved in current fixed window
+    u64 prev_bytes;   // bytes moved in previous fixed window
+} DataRateMeter;
+
+#ifdef __cplusplus
+#    define DataRateMeterInit(now)                                                                                     \
+        (DataRateMeter {.started = (now), .window_start = (now), .window_bytes = 0, .prev_bytes = 0})
+#else
+#    define DataRateMeterInit(now)                                                                                     \
+        ((DataRateMeter) {.started = (now), .window_start = (now), .window_bytes = 0, .prev_bytes = 0})
+#endif
+
+///
+/// Account bytes moved on a connection.
+///
+/// meter[in,out] : Meter of the transfer.
+/// config[in]    : Enforcement configuration.
+/// nbytes[in]    : Bytes just received or sent.
+/// now[in]       : Current monotonic time.
+///
+void DataRateMeterUpdate(DataRateMeter *meter, const DataRateConfig *config, u64 nbytes, u64 now);
+
+///
+/// Check whether transfer has fallen under the throughput floor.
+///
+/// meter[in,out] : Meter of the transfer.
+/// config[in]    : Enforcement configuration.
+/// now[in]       : Current monotonic time.
+///
+/// SUCCESS: true when transfer is too slow and connection should be dropped.
+/// FAILURE: false
+///
+bool DataRateMeterTooSlow(DataRateMeter *meter, const DataRateConfig *config, u64 now);
+
+#endif // BEAM_DATA_RATE_H
@@ -0,0 +1,140 @@
+/// file      : docindex.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Index of files under document root, built once at startup.
+///
+/// A pool of threads walks the tree, each taking directories off a shared
+/// queue, listing them with getdents64() and looking at files with statx()
+/// relative to the directory fd, so no path is resolved twice. Trees with
+/// hundreds of thousands of files are walked about as fast as disk allows.
+///
+/// What's built :
+///
+/// - Path index : every regular file with its size, modification time,
+///   content type and ETag, found by full path without touching disk.
+/// - Negative filter : a bloom filter of every indexed path. Most lookups
+///   for files that don't exist are answered by a couple of bit tests.
+/// - Optionally, small files are read straight into content cache while
+///   walking.
+///
+/// Index is immutable once built and can be read by any number of threads.
+/// Files created afterwards are not in it, and metadata of changed files is
+/// stale : callers compare against what they open before trusting it.
+
+#ifndef BEAM_DOCINDEX_H
+#define BEAM_DOCINDEX_H
+
+#include <Misra.h>
+#include <Beam/Cache.h>
+#include <Beam/Http.h>
+
+typedef struct {
+    u32    threads;     // walking threads, 0 disables indexing
+    u64    preload_max; // files up to this size are read into cache, 0 preloads nothing
+    Cache *cache;       // cache to preload into, NULL preloads nothing
+} DocIndexConfig;
+
+#ifdef __cplusplus
+#    define DocIndexConfigInit() (DocIndexConfig {.threads = 8, .preload_max = 0, .cache = NULL})
+#else
+#    define DocIndexConfigInit() ((DocIndexConfig) {.threads = 8, .preload_max = 0, .cache = NULL})
+#endif
+
+///
+/// ETag of a file version, quoted as it goes in headers.
+///
+typedef struct {
+    char value[20];
+} DocEtag;
+
+typedef struct {
+    char           *path; // full path, as built from document root
+    u64             size;
+    u64             mtime_ns;
+    u64             file_id; // device and inode, as in HttpResponse
+    HttpContentType content_type;
+    DocEtag         etag;
+} DocEntry;
+
+typedef struct {
+    DocIndexConfig config;
+    DocEntry      *entries;
+    u64            count;
+    u32           *table; // entry index + 1 by path hash, 0 for an empty slot
+    u64            table_mask;
+    u64           *bloom;
+    u64            bloom_mask; // bits in filter - 1
+    u64            preloaded;  // files read into cache while walking
+} DocIndex;
+
+#ifdef __cplusplus
+#    define DocIndexInit()                                                                                             \
+        (DocIndex {                                                                                                    \
+            .config     = DocIndexConfigInit(),                                                                        \
+            .entries    = NULL,                                                                                        \
+            .count      = 0,                                                                                           \
+            .table      = NULL,                                                                                        \
+            .table_mask = 0,                                                                                           \
+            .bloom      = NULL,                                                                                        \
+            .bloom_mask = 0,                                                                                           \
+            .preloaded  = 0                                                                                            \
+        })
+#else
+#    define DocIndexInit()                                                                                             \
+        ((DocIndex) {.config     = DocIndexConfigInit(),                                                               \
+                     .entries    = NULL,                                                                               \
+                     .count      = 0,                                                                                  \
+                     .table      = NULL,                                                                               \
+                     .table_mask = 0,                                                                                  \
+                     .bloom      = NULL,                                                                               \
+                     .bloom_mask = 0,                                                                                  \
+                     .preloaded  = 0})
+#endif
+
+///
+/// Walk document root and build index. Blocks until whole tree is walked.
+///
+/// index[out] : Index to be built.
+/// config[in] : Index configuration. Copied.
+/// root[in]   : Document root, paths are built by appending "/name" to it.
+///
+/// SUCCESS: `index`
+/// FAILURE: NULL
+///
+DocIndex *DocIndexBuild(DocIndex *index, const DocIndexConfig *config, const char *root);
+
+///
+/// Free index.
+///
+/// index[in,out] : Index to be deinited.
+///
+/// SUCCESS: Returns with resetted index.
+/// FAILURE: Does not return.
+///
+void DocIndexDeinit(DocIndex *index);
+
+///
+/// Find a file by full path.
+///
+/// index[in] : Index.
+/// path[in]  : Full path.
+///
+/// SUCCESS: Entry of file.
+/// FAILURE: NULL when file wasn't there at startup.
+///
+const DocEntry *DocIndexFind(const DocIndex *index, const char *path);
+
+///
+/// Make ETag of a file version from its validators.
+///
+/// file_id[in]  : Device and inode.
+/// mtime_ns[in] : Last modification.
+/// size[in]     : File size.
+///
+/// SUCCESS: ETag
+/// FAILURE: Does not fail.
+///
+DocEtag DocEtagMake(u64 file_id, u64 mtime_ns, u64 size);
+
+#endif // BEAM_DOCINDEX_H
@@ -0,0 +1,113 @@
+/// file      : hotcache.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Worker-local cache of rendered responses, in front of shared content cache.
+///
+/// Even lock-free lookups in shared cache pull its lines from whichever core
+/// wrote them last. The few dozen hottest urls are kept here instead, status
+/// line and headers included, in a small direct-mapped table by url hash, so
+/// serving them touches nothing but memory of serving thread.
+///
+/// Entries remember generation of shared cache they were made at, any file
+/// replaced in shared cache since invalidates all of them. Files changed on
+/// disk without anyone reading them into shared cache again aren't noticed
+/// that way, so entries are also dropped once old enough and the next lookup
+/// goes through the usual path, checking the file.
+
+#ifndef BEAM_HOTCACHE_H
+#define BEAM_HOTCACHE_H
+
+#include <Misra.h>
+
+typedef struct {
+    u32 slots;         // number of entries, power of two, 0 disables caching
+    u64 max_response;  // bigger responses are never cached, headers included
+    u64 revalidate_ns; // entries older than this are looked up again
+} HotCacheConfig;
+
+#ifdef __cplusplus
+#    define HotCacheConfigInit()                                                                                       \
+        (HotCacheConfig {.slots = 64, .max_response = 65536, .revalidate_ns = 1000000000ull})
+#else
+#    define HotCacheConfigInit()                                                                                       \
+        ((HotCacheConfig) {.slots = 64, .max_response = 65536, .revalidate_ns = 1000000000ull})
+#endif
+
+typedef struct HotCacheEntry HotCacheEntry;
+
+///
+/// Rendered responses of hottest urls. Owned by a single thread.
+///
+typedef struct {
+    HotCacheConfig config;
+    HotCacheEntry *entries;
+    u32            mask;
+} HotCache;
+
+///
+/// Allocate entry table.
+///
+/// hot[out]   : Cache to be initialized.
+/// config[in] : Cache configuration. Copied.
+///
+/// SUCCESS: `hot`
+/// FAILURE: NULL
+///
+HotCache *HotCacheInit(HotCache *hot, const HotCacheConfig *config);
+
+///
+/// Free entry table and responses in it.
+///
+/// hot[in,out] : Cache to be deinited.
+///
+/// SUCCESS: Returns with resetted cache.
+/// FAILURE: Does not return.
+///
+void HotCacheDeinit(HotCache *hot);
+
+///
+/// Use only part of entry table, e.g. under memory pressure, or all of it
+/// again. Entries left out are freed. Entries may land elsewhere once
+/// table grows, they are looked up again then.
+///
+/// hot[in,out] : Cache.
+/// pct[in]     : Share of configured slots to use, rounded down to a power of two, at least one.
+///
+/// SUCCESS: Returns with resized cache.
+/// FAILURE: Does not return.
+///
+void HotCacheResize(HotCache *hot, u32 pct);
+
+///
+/// Look a url up and append a copy of its rendered response to `out`.
+///
+/// hot[in,out]    : Cache.
+/// url[in]        : Request url.
+/// len[in]        : Bytes of url.
+/// generation[in] : Current generation of shared cache.
+/// now[in]        : Current time, in nanoseconds.
+/// out[in,out]    : Response is appended here. Left as it was on a miss.
+///
+/// SUCCESS: true on a hit.
+/// FAILURE: false on a miss, stale entries are dropped.
+///
+bool HotCacheGet(HotCache *hot, const char *url, u64 len, u64 generation, u64 now, Str *out);
+
+///
+/// Keep a rendered response of a url, replacing whatever shared its entry.
+/// Responses bigger than `max_response` are ignored.
+///
+/// hot[in,out]    : Cache.
+/// url[in]        : Request url.
+/// len[in]        : Bytes of url.
+/// generation[in] : Generation of shared cache response was made at.
+/// now[in]        : Current time, in nanoseconds.
+/// response[in]   : Rendered response. Copied.
+///
+/// SUCCESS: true when kept.
+/// FAILURE: false when response is too big.
+///
+bool HotCachePut(HotCache *hot, const char *url, u64 len, u64 generation, u64 now, const Str *response);
+
+#endif // BEAM_HOTCACHE_H
@@ -181,27 +181,53 @@ typedef struct {
                         .headers = VecInitWithDeepCopy(NULL, HttpHeaderDeinit)})
 #endif
 
+///
+/// Body of a response comes either from `body` or, for file responses,
+/// from `file_length` bytes of `file_fd` starting at `file_offset`.
+/// File bodies are never read into memory, they're sent with sendfile().
+///
 typedef struct {
     HttpContentType  content_type;
     HttpResponseCode status_code;
     HttpHeaders      headers;
     Str              body;
+    i32              file_fd;       // file to send body from, -1 when body is in memory
+    u64              file_offset;   // offset in file where body starts
+    u64              file_length;   // number of body bytes in file
+    u64              file_size;     // size of whole file, for Content-Range
+    u64              file_id;       // identifies file across opens (device and inode)
+    u64              file_mtime_ns; // last modification of file
+    bool             close;         // ask client to close connection after this response
 } HttpResponse;
 
 #ifdef __cplusplus
 #    define HttpResponseInit()                                                                                         \
         (HttpResponse {                                                                                                \
-            .content_type = HTTP_CONTENT_TYPE_INVALID,                                                                 \
-            .status_code  = HTTP_RESPONSE_CODE_INVALID,                                                                \
-            .headers      = VecInitWithDeepCopy(NULL, HttpHeaderDeinit),                                               \
-            .body         = StrInit()                                                                                  \
+            .content_type  = HTTP_CONTENT_TYPE_INVALID,                                                                \
+            .status_code   = HTTP_RESPONSE_CODE_INVALID,                                                               \
+            .headers       = VecInitWithDeepCopy(NULL, HttpHeaderDeinit),                                              \
+            .body          = StrInit(),                                                                                \
+            .file_fd       = -1,                                                                                       \
+            .file_offset   = 0,                                                                                        \
+            .file_length   = 0,                                                                                        \
+            .file_size     = 0,                                                                                        \
+            .file_id       = 0,                                                                                        \
+            .file_mtime_ns = 0,                                                                                        \
+            .close         = false                                                                                     \
         })
 #else
 #    define HttpResponseInit()                                                                                         \
-        ((HttpResponse) {.content_type = HTTP_CONTENT_TYPE_INVALID,                                                    \
-                         .status_code  = HTTP_RESPONSE_CODE_INVALID,                                                   \
-                         .headers      = VecInitWithDeepCopy(NULL, HttpHeaderDeinit),                                  \
-                         .body         = StrInit()})
+        ((HttpResponse) {.content_type  = HTTP_CONTENT_TYPE_INVALID,                                                   \
+                         .status_code   = HTTP_RESPONSE_CODE_INVALID,                                                  \
+                         .headers       = VecInitWithDeepCopy(NULL, HttpHeaderDeinit),                                 \
+                         .body          = StrInit(),                                                                   \
+                         .file_fd       = -1,                                                                          \
+                         .file_offset   = 0,                                                                           \
+                         .file_length   = 0,                                                                           \
+                         .file_size     = 0,                                                                           \
+                         .file_id       = 0,                                                                           \
+                         .file_mtime_ns = 0,                                                                           \
+                         .close         = false})
 #endif
 
 ///
@@ -215,16 +241,38 @@ typedef struct {
 void HttpHeaderDeinit(HttpHeader *header);
 
 ///
-/// Find http header with given name.
+/// Find http header with given name. Names are matched ignoring case.
 ///
 /// headers[in] : Vector of headers to look in.
 /// key[in]     : Header key to look for.
 ///
-/// SUCCESS: A non-null value pointing to a header with matching name.
+/// SUCCESS: A non-null value pointing to first header with matching name.
 /// FAILURE: NULL
 ///
 HttpHeader *HttpHeadersFind(HttpHeaders *headers, const char *key);
 
+///
+/// Count http headers with given name. Names are matched ignoring case.
+///
+/// headers[in] : Vector of headers to look in.
+/// key[in]     : Header key to look for.
+///
+/// SUCCESS: Number of headers with matching name.
+/// FAILURE: 0
+///
+u32 HttpHeadersCount(HttpHeaders *headers, const char *key);
+
+///
+/// Parse value of a Content-Length header strictly.
+///
+/// value[in]   : Header value, may be NULL.
+/// length[out] : Body length.
+///
+/// SUCCESS: true when value is a decimal number fitting in 64 bits and nothing else.
+/// FAILURE: false
+///
+bool HttpParseContentLength(const char *value, u64 *length);
+
 ///
 /// Parse http request (method, url, headers, body)
 ///
@@ -266,6 +314,16 @@ const char *HttpResponseCodeToZstr(HttpResponseCode code);
 ///
 const char *HttpContentTypeToZstr(HttpContentType content_type);
 
+///
+/// Guess content type of a file from extension in its path.
+///
+/// path[in] : Zero-terminated file path or url path.
+///
+/// SUCCESS: Content type matching extension.
+/// FAILURE: HTTP_CONTENT_TYPE_APPLICATION_OCTET_STREAM for unknown extensions.
+///
+HttpContentType HttpContentTypeFromPath(const char *path);
+
 ///
 /// Init response from html
 ///
@@ -280,6 +338,7 @@ HttpResponse *HttpRespondWithHtml(HttpResponse *response, HttpResponseCode statu
 
 ///
 /// Init this response for file at given path.
+/// File is opened and kept open until response is deinited, contents are not read.
 ///
 /// response[in,out] : Response to be initialized.
 /// status[in]       : Http response code.
@@ -296,6 +355,43 @@ HttpResponse *HttpRespondWithFile(
     const char      *filepath
 );
 
+///
+/// Narrow a file response down to the byte range asked for in a Range header.
+/// Only single ranges are honoured, anything else is ignored and whole file is
+/// sent, as HTTP allows. Ranges starting past end of file turn the response
+/// into a 416.
+///
+/// response[in,out] : Response prepared with HttpRespondWithFile().
+/// range[in]        : Value of Range request header.
+///
+/// SUCCESS: `response`
+/// FAILURE: NULL
+///
+HttpResponse *HttpResponseSetRange(HttpResponse *response, const char *range);
+
+///
+/// Render status line and headers of prepared http response into a buffer.
+///
+/// response[in] : Prepared response to be rendered.
+/// out[out]     : Rendered bytes are appended here.
+///
+/// SUCCESS: `out`
+/// FAILURE: NULL
+///
+Str *HttpResponseRenderHead(HttpResponse *response, Str *out);
+
+///
+/// Render prepared http response (status line, headers and in-memory body) into a buffer.
+/// File bodies are not rendered, they must be sent separately after rendered bytes.
+///
+/// response[in] : Prepared response to be rendered.
+/// out[out]     : Rendered bytes are appended here.
+///
+/// SUCCESS: `out`
+/// FAILURE: NULL
+///
+Str *HttpResponseRender(HttpResponse *response, Str *out);
+
 ///
 /// Send prepared http response.
 ///
@@ -307,6 +403,31 @@ HttpResponse *HttpRespondWithFile(
 ///
 HttpResponse *HttpRespondTo(HttpResponse *response, int connfd);
 
+///
+/// Get pre-rendered response for given status code.
+///
+/// code[in]  : Status code to respond with.
+/// size[out] : Size of pre-rendered response.
+///
+/// SUCCESS: Static, pre-rendered response bytes.
+/// FAILURE: NULL when `code` has no pre-rendered response.
+///
+const char *HttpCannedResponse(HttpResponseCode code, u64 *size);
+
+///
+/// Send a pre-rendered response for given status code.
+/// Meant for rejection paths (rate limiting, load shedding) where building
+/// an HttpResponse would cost more than the request being rejected.
+/// Pre-rendered responses always ask the client to close the connection.
+///
+/// code[in]   : Status code to respond with.
+/// connfd[in] : Socket file descriptor to call send upon.
+///
+/// SUCCESS: true
+/// FAILURE: false when `code` has no pre-rendered response or send fails.
+///
+bool HttpRespondCanned(HttpResponseCode code, int connfd);
+
 ///
 /// Free all resources occupued by provided http response.
 ///
@@ -0,0 +1,40 @@
+/// file      : hugepage.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Private memory backed by huge pages where kernel has any.
+///
+/// Big long-lived regions touched all over (connection slabs, buffer pools)
+/// cost a TLB entry per 4KB page otherwise. Explicit hugetlb pages are tried
+/// first, then regular pages the kernel is asked to collapse into
+/// transparent huge pages.
+
+#ifndef BEAM_HUGEPAGE_H
+#define BEAM_HUGEPAGE_H
+
+#include <Misra.h>
+
+// size of huge pages asked for, the default one on x86-64 and arm64
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024ull)
+
+///
+/// Map zeroed private memory, page aligned. Regions of at least one huge page
+/// are rounded up to whole huge pages.
+///
+/// size[in]  : Number of bytes.
+/// huge[in]  : Try huge pages at all.
+///
+/// SUCCESS: Mapped memory.
+/// FAILURE: NULL
+///
+void *HugePageAlloc(u64 size, bool huge);
+
+///
+/// Unmap memory returned by HugePageAlloc().
+///
+/// mem[in]  : Mapped memory, may be NULL.
+/// size[in] : Size it was allocated with.
+///
+void HugePageFree(void *mem, u64 size);
+
+#endif // BEAM_HUGEPAGE_H
@@ -0,0 +1,153 @@
+/// file      : iopool.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Thread pool for file I/O that would block an event loop.
+///
+/// Event loops never wait on disk. When a file range about to be sent is not
+/// in page cache, a job is handed to the pool, whose threads queue the range
+/// with readahead(), along with whatever is worth having ahead of it, and then
+/// read through the range, so it's in page cache by the time job completes.
+/// Streams bypassing page cache have their reads into caller's buffers done
+/// here as well. Finished jobs are pushed on the completion list of whoever
+/// submitted them and an eventfd is signalled, so the submitting event loop
+/// wakes up and resumes the connection that waited. Other blocking work,
+/// like reading a file into the content cache, can be handed over as a call
+/// that nobody waits for.
+
+#ifndef BEAM_IO_POOL_H
+#define BEAM_IO_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include <Misra.h>
+
+typedef struct IoJob         IoJob;
+typedef struct IoCompletions IoCompletions;
+
+///
+/// Finished jobs of one submitter. Pushed to by pool threads, drained by submitter.
+///
+struct IoCompletions {
+    _Atomic(IoJob *) head;
+    i32              event_fd; // readable when there are finished jobs
+};
+
+typedef enum {
+    IO_JOB_READAHEAD, // bring range into page cache, done once all of it is there
+    IO_JOB_READ,      // read range into `buf`
+    IO_JOB_CALL       // call `run` on a pool thread
+} IoJobKind;
+
+///
+/// Blocking work done by a CALL job, on a pool thread.
+///
+typedef void (*IoJobCall)(IoJob *job);
+
+struct IoJob {
+    IoJobKind      kind;
+    i32            fd;     // file to read from, owned by job
+    u64            offset; // start of range to read
+    u64            length; // length of range to read
+    u64            ahead;  // READAHEAD : bytes after range queued for reading as well, not waited for
+    u8            *buf;    // READ : destination, `length` bytes
+    i64            result; // READ : bytes read, -1 on error
+    i32            error;  // READ, CALL : errno of failed read
+    void          *data;   // submitter's context
+    u64            tag;    // submitter's context, e.g. to detect reuse of `data`
+    IoJobCall      run;    // CALL : work to be done, `error` is ECANCELED when pool stopped first
+    IoCompletions *done;   // where job is pushed when finished, NULL for CALL jobs `run` frees itself
+    IoJob         *next;
+};
+
+typedef struct {
+    u32 threads; // number of I/O threads, 0 disables offloading
+} IoPoolConfig;
+
+#ifdef __cplusplus
+#    define IoPoolConfigInit() (IoPoolConfig {.threads = 4})
+#else
+#    define IoPoolConfigInit() ((IoPoolConfig) {.threads = 4})
+#endif
+
+typedef struct {
+    IoPoolConfig    config;
+    pthread_t      *threads;
+    u32             nthreads; // number of threads actually started
+    pthread_mutex_t lock;
+    pthread_cond_t  ready;
+    IoJob          *head; // submitted jobs, oldest first
+    IoJob          *tail;
+    bool            stopping;
+} IoPool;
+
+///
+/// Start I/O threads.
+///
+/// pool[out]  : Pool to be initialized.
+/// config[in] : Pool configuration. Copied.
+///
+/// SUCCESS: `pool`
+/// FAILURE: NULL
+///
+IoPool *IoPoolInit(IoPool *pool, const IoPoolConfig *config);
+
+///
+/// Stop I/O threads. Jobs not yet picked up are completed without being run.
+///
+/// pool[in,out] : Pool to be deinited.
+///
+/// SUCCESS: Returns with resetted pool.
+/// FAILURE: Does not return.
+///
+void IoPoolDeinit(IoPool *pool);
+
+///
+/// Hand a job to the pool. Job must stay alive until it shows up in `job->done`,
+/// or for a CALL job without `done`, until `run` has been called.
+///
+/// pool[in,out] : Pool.
+/// job[in]      : Job to be run.
+///
+/// SUCCESS: true
+/// FAILURE: false when pool is not running, job stays owned by caller.
+///
+bool IoPoolSubmit(IoPool *pool, IoJob *job);
+
+///
+/// Run a job on calling thread, for when it can't be handed to pool.
+/// Job is not pushed on its completion list.
+///
+/// job[in,out] : Job to be run.
+///
+void IoJobRun(IoJob *job);
+
+///
+/// Prepare an empty completion list.
+///
+/// done[out] : Completion list to be initialized.
+///
+/// SUCCESS: `done`
+/// FAILURE: NULL
+///
+IoCompletions *IoCompletionsInit(IoCompletions *done);
+
+///
+/// Release completion list. All submitted jobs must have been taken back first.
+///
+/// done[in,out] : Completion list to be deinited.
+///
+void IoCompletionsDeinit(IoCompletions *done);
+
+///
+/// Take all finished jobs. Clears readiness of `done->event_fd`.
+///
+/// done[in,out] : Completion list.
+///
+/// SUCCESS: Linked list of finished jobs, NULL if there are none.
+/// FAILURE: Does not fail.
+///
+IoJob *IoCompletionsTake(IoCompletions *done);
+
+#endif // BEAM_IO_POOL_H
@@ -0,0 +1,82 @@
+/// file      : loadshed.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Adaptive load shedding driven by queueing delay.
+///
+/// Sojourn time is how long a request sat in kernel buffers before beam got
+/// around to reading it. When it stays above a target for a whole interval the
+/// server is overloaded and requests are shed CoDel style : the first one right
+/// away, then at intervals shrinking with the square root of the number shed,
+/// until sojourn falls back under target. Shed requests get a pre-rendered 503.
+
+#ifndef BEAM_LOAD_SHED_H
+#define BEAM_LOAD_SHED_H
+
+#include <sys/socket.h>
+
+#include <Misra.h>
+
+typedef struct {
+    u64 target_ns;   // acceptable standing queueing delay, 0 disables shedding
+    u64 interval_ns; // how long delay must stay above target before shedding starts
+} LoadShedConfig;
+
+#ifdef __cplusplus
+#    define LoadShedConfigInit() (LoadShedConfig {.target_ns = 0, .interval_ns = 100000000ull})
+#else
+#    define LoadShedConfigInit() ((LoadShedConfig) {.target_ns = 0, .interval_ns = 100000000ull})
+#endif
+
+///
+/// CoDel state. Owned by a single thread, not safe for concurrent use.
+///
+typedef struct {
+    LoadShedConfig config;
+    u64            first_above; // when delay will have been above target for an interval, 0 when below target
+    u64            drop_next;   // when next request gets shed while shedding
+    u32            count;       // requests shed since shedding started
+    u32            last_count;  // `count` when previous shedding episode started
+    bool           shedding;
+} LoadShed;
+
+#ifdef __cplusplus
+#    define LoadShedInit(cfg) (LoadShed {.config = (cfg)})
+#else
+#    define LoadShedInit(cfg) ((LoadShed) {.config = (cfg)})
+#endif
+
+///
+/// Ask kernel to timestamp received data on given socket.
+/// Sockets accepted from a listening socket inherit the setting.
+///
+/// sockfd[in] : Socket to enable receive timestamps on.
+///
+/// SUCCESS: true
+/// FAILURE: false
+///
+bool LoadShedEnableTimestamps(int sockfd);
+
+///
+/// Compute how long received data waited before being read.
+///
+/// msg[in] : Message header filled in by recvmsg, with room for control messages.
+///
+/// SUCCESS: Sojourn time in nanoseconds.
+/// FAILURE: 0 when message carries no receive timestamp.
+///
+u64 LoadShedSojourn(struct msghdr *msg);
+
+///
+/// Feed sojourn time of a request to the controller and decide its fate.
+///
+/// shed[in,out]   : Controller state.
+/// sojourn_ns[in] : Sojourn time of the request, from LoadShedSojourn.
+/// now_ns[in]     : Current monotonic time.
+///
+/// SUCCESS: true when request should be served.
+/// FAILURE: false when request must be shed with SERVICE_UNAVAILABLE.
+///
+bool LoadShedAdmit(LoadShed *shed, u64 sojourn_ns, u64 now_ns);
+
+#endif // BEAM_LOAD_SHED_H
@@ -0,0 +1,81 @@
+/// file      : numa.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// NUMA topology, worker placement and memory binding.
+///
+/// On multi-socket hosts memory of another socket costs a trip across the
+/// interconnect. Workers are pinned to CPUs spread evenly over nodes and set
+/// up their connection slabs, buffers and caches from the pinned thread, so
+/// first touch puts those pages on the local node. Regions shared by every
+/// worker are placed explicitly instead.
+///
+/// Topology comes from sysfs and memory policies are set with raw syscalls,
+/// nothing beyond the kernel is needed. Hosts without NUMA look like one node.
+
+#ifndef BEAM_NUMA_H
+#define BEAM_NUMA_H
+
+#include <Misra.h>
+
+typedef struct {
+    u32  nodes;    // nodes having CPUs we may run on
+    u32  max_node; // highest id among them, node ids may have holes
+    u32  count;    // CPUs we may run on
+    u32 *cpus;     // those CPUs, taking turns between nodes
+    u32 *cpu_node; // node of each entry of `cpus`
+} NumaTopology;
+
+#ifdef __cplusplus
+#    define NumaTopologyInit() (NumaTopology {0})
+#else
+#    define NumaTopologyInit() ((NumaTopology) {0})
+#endif
+
+///
+/// Read which CPUs we may run on and which node each of them is on.
+///
+/// topo[out] : Topology to be initialized.
+///
+/// SUCCESS: `topo`
+/// FAILURE: NULL when CPU affinity can't be read.
+///
+NumaTopology *NumaTopologyRead(NumaTopology *topo);
+
+///
+/// Free topology.
+///
+/// topo[in,out] : Topology to be deinited.
+///
+/// SUCCESS: Returns with resetted topology.
+/// FAILURE: Does not return.
+///
+void NumaTopologyDeinit(NumaTopology *topo);
+
+///
+/// Pin calling thread to CPU picked for a worker. Consecutive workers land
+/// on different nodes, so every node gets its share of them.
+///
+/// topo[in]   : Topology.
+/// worker[in] : Worker index, wraps around when there are more workers than CPUs.
+///
+/// SUCCESS: Node calling thread now runs on.
+/// FAILURE: -1 when thread can't be pinned.
+///
+i32 NumaPinWorker(const NumaTopology *topo, u32 worker);
+
+///
+/// Place a fresh mapping on a node, or interleave it over all nodes with
+/// memory. Must come before its pages are first touched. Shared mappings
+/// keep their policy in every process mapping them.
+///
+/// mem[in]  : Page aligned start of mapping.
+/// size[in] : Bytes of mapping.
+/// node[in] : Node to prefer, -1 to interleave.
+///
+/// SUCCESS: true, also when host has a single node and there's nothing to do.
+/// FAILURE: false
+///
+bool NumaBind(void *mem, u64 size, i32 node);
+
+#endif // BEAM_NUMA_H
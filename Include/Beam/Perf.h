@@ -0,0 +1,61 @@
+/// file      : perf.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Hardware TLB miss counters of calling thread, through perf_event_open().
+///
+/// Counted in user space only, so they work under the usual
+/// `kernel.perf_event_paranoid` of 2. Hosts without a PMU (most VMs, some
+/// containers) have none to open, counting then just stays off.
+
+#ifndef BEAM_PERF_H
+#define BEAM_PERF_H
+
+#include <Misra.h>
+
+typedef struct {
+    i32 dtlb_fd; // data TLB read misses, -1 when unavailable
+    i32 itlb_fd; // instruction TLB misses, -1 when unavailable
+    u64 dtlb;    // data TLB misses at last read
+    u64 itlb;    // instruction TLB misses at last read
+} TlbCounters;
+
+#ifdef __cplusplus
+#    define TlbCountersInit() (TlbCounters {.dtlb_fd = -1, .itlb_fd = -1, .dtlb = 0, .itlb = 0})
+#else
+#    define TlbCountersInit() ((TlbCounters) {.dtlb_fd = -1, .itlb_fd = -1, .dtlb = 0, .itlb = 0})
+#endif
+
+///
+/// Start counting TLB misses of calling thread.
+///
+/// counters[out] : Counters to be opened.
+///
+/// SUCCESS: true when at least one counter could be opened.
+/// FAILURE: false, `counters` is left closed.
+///
+bool TlbCountersOpen(TlbCounters *counters);
+
+///
+/// Stop counting.
+///
+/// counters[in,out] : Counters to be closed.
+///
+/// SUCCESS: Returns with resetted counters.
+/// FAILURE: Does not return.
+///
+void TlbCountersClose(TlbCounters *counters);
+
+///
+/// Read misses counted since last read.
+///
+/// counters[in,out] : Counters.
+/// dtlb[out]        : Data TLB misses since last read.
+/// itlb[out]        : Instruction TLB misses since last read.
+///
+/// SUCCESS: Returns with deltas written, 0 for counters not open.
+/// FAILURE: Does not return.
+///
+void TlbCountersRead(TlbCounters *counters, u64 *dtlb, u64 *itlb);
+
+#endif // BEAM_PERF_H
@@ -0,0 +1,104 @@
+/// file      : prefetch.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Readahead policy for file responses.
+///
+/// Kernel readahead only sees one open file at a time and knows nothing about
+/// HTTP ranges. Here every file response is recorded against the file it came
+/// from, and advice is picked from the access pattern seen so far :
+///
+/// - Whole files are read sequentially and prefetched up to a window.
+/// - Ranges continuing where the previous one ended (video players, resumed
+///   downloads) are sequential too, prefetch runs a couple of ranges ahead.
+/// - Ranges jumping around (seeking) get exactly what was asked for, with
+///   kernel readahead turned off for that open file so seeks don't drag in
+///   megabytes nobody will read.
+///
+/// Big files are dropped from page cache once streamed so that they don't
+/// push out small, hot content. Only the last one to finish streaming a file
+/// drops it, so that nobody else streaming it loses pages under their feet.
+
+#ifndef BEAM_PREFETCH_H
+#define BEAM_PREFETCH_H
+
+#include <Misra.h>
+
+typedef struct {
+    u64 window_min;   // smallest prefetch, in bytes
+    u64 window_max;   // largest prefetch, in bytes
+    u64 dontneed_min; // files at least this big are dropped from page cache once sent, 0 never drops
+    u32 table_slots;  // number of files whose access pattern is remembered, power of two
+} PrefetchConfig;
+
+#ifdef __cplusplus
+#    define PrefetchConfigInit()                                                                                       \
+        (PrefetchConfig {                                                                                              \
+            .window_min   = 131072,                                                                                    \
+            .window_max   = 8388608,                                                                                   \
+            .dontneed_min = 268435456ull,                                                                              \
+            .table_slots  = 4096                                                                                       \
+        })
+#else
+#    define PrefetchConfigInit()                                                                                       \
+        ((PrefetchConfig) {.window_min   = 131072,                                                                     \
+                           .window_max   = 8388608,                                                                    \
+                           .dontneed_min = 268435456ull,                                                               \
+                           .table_slots  = 4096})
+#endif
+
+typedef struct PrefetchEntry PrefetchEntry;
+
+///
+/// Access patterns of recently served files. Owned by a single thread.
+///
+typedef struct {
+    PrefetchConfig config;
+    PrefetchEntry *table;
+    u32            mask;
+} Prefetch;
+
+typedef struct {
+    u64  window;   // bytes worth reading in ahead of sending, starting at range offset
+    bool dontneed; // drop sent range from page cache afterwards, unless file is still being streamed
+} PrefetchAdvice;
+
+///
+/// Allocate access pattern table.
+///
+/// prefetch[out] : Policy to be initialized.
+/// config[in]    : Policy configuration. Copied.
+///
+/// SUCCESS: `prefetch`
+/// FAILURE: NULL
+///
+Prefetch *PrefetchInit(Prefetch *prefetch, const PrefetchConfig *config);
+
+///
+/// Free access pattern table.
+///
+/// prefetch[in,out] : Policy to be deinited.
+///
+/// SUCCESS: Returns with resetted policy.
+/// FAILURE: Does not return.
+///
+void PrefetchDeinit(Prefetch *prefetch);
+
+///
+/// Record a file response about to be sent and advise kernel accordingly.
+/// Only the access pattern hint is issued on `fd` here, reading the window in
+/// is left to caller, which can do it off its own thread.
+///
+/// prefetch[in,out] : Policy.
+/// fd[in]           : Open file response is sent from.
+/// file_id[in]      : Identifies file across opens.
+/// file_size[in]    : Size of whole file.
+/// offset[in]       : First byte being sent.
+/// length[in]       : Number of bytes being sent.
+///
+/// SUCCESS: How much to read in ahead and what to do once sent.
+/// FAILURE: Does not fail.
+///
+PrefetchAdvice PrefetchAdvise(Prefetch *prefetch, i32 fd, u64 file_id, u64 file_size, u64 offset, u64 length);
+
+#endif // BEAM_PREFETCH_H
@@ -0,0 +1,101 @@
+/// file      : pressure.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Memory pressure of our cgroup, and how much caches may hold because of it.
+///
+/// A thread of its own waits on two cgroup v2 notifications :
+///
+/// - A PSI trigger on `memory.pressure`, firing when tasks of cgroup were
+///   stalled on memory for longer than a threshold within a window.
+/// - Changes to `memory.events`, counting every time cgroup went over
+///   `memory.high` (and got throttled) or hit `memory.max`.
+///
+/// Either one raises pressure level a step, at most once per window. Every
+/// level takes a step from full size down towards a floor, and what caches
+/// may keep is published as a percentage of their full size. Once nothing
+/// fired for a while, level drops a step and caches may grow again, so a
+/// short spike doesn't leave them small forever.
+///
+/// Published share is in shared memory, forked workers read it as well.
+
+#ifndef BEAM_PRESSURE_H
+#define BEAM_PRESSURE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include <Misra.h>
+
+///
+/// Called on monitor thread whenever share caches may keep changes.
+///
+typedef void (*PressureCallback)(u32 keep_pct, void *arg);
+
+typedef struct {
+    u64              stall_us;  // memory stall within window that counts as pressure
+    u64              window_us; // PSI trigger window, unprivileged triggers need multiples of 2s
+    u32              levels;    // steps from full size to floor, 0 disables monitoring
+    u32              floor_pct; // share caches keep at highest level
+    u64              relax_ns;  // quiet time before caches grow back a step
+    PressureCallback on_change; // may be NULL
+    void            *arg;       // passed to `on_change`
+} PressureConfig;
+
+#ifdef __cplusplus
+#    define PressureConfigInit()                                                                                       \
+        (PressureConfig {                                                                                              \
+            .stall_us  = 100000,                                                                                       \
+            .window_us = 2000000,                                                                                      \
+            .levels    = 3,                                                                                            \
+            .floor_pct = 25,                                                                                           \
+            .relax_ns  = 10000000000ull,                                                                               \
+            .on_change = NULL,                                                                                         \
+            .arg       = NULL                                                                                          \
+        })
+#else
+#    define PressureConfigInit()                                                                                       \
+        ((PressureConfig) {.stall_us  = 100000,                                                                        \
+                           .window_us = 2000000,                                                                       \
+                           .levels    = 3,                                                                             \
+                           .floor_pct = 25,                                                                            \
+                           .relax_ns  = 10000000000ull,                                                                \
+                           .on_change = NULL,                                                                          \
+                           .arg       = NULL})
+#endif
+
+typedef struct {
+    PressureConfig config;
+    _Atomic(u32)  *keep_pct;  // share of full size caches may use, 100 without pressure, in shared memory
+    i32            psi_fd;    // `memory.pressure` with a trigger on it, -1 without PSI
+    i32            events_fd; // `memory.events`, -1 when cgroup has none
+    i32            stop_fd;   // eventfd telling monitor thread to stop
+    u64            breaches;  // `memory.high` and `memory.max` events counted so far
+    u32            level;     // current step, monitor thread only
+    pthread_t      thread;
+} Pressure;
+
+///
+/// Subscribe to memory pressure notifications of a cgroup and start
+/// watching them. Must be started before workers are forked.
+///
+/// pressure[out] : Monitor to be initialized.
+/// config[in]    : Monitor configuration. Copied.
+/// cgroup[in]    : Cgroup directory, as found by CgroupFind().
+///
+/// SUCCESS: `pressure`
+/// FAILURE: NULL when cgroup offers neither notification.
+///
+Pressure *PressureStart(Pressure *pressure, const PressureConfig *config, const char *cgroup);
+
+///
+/// Stop watching and unsubscribe. Nobody may read published share anymore.
+///
+/// pressure[in,out] : Monitor to be stopped.
+///
+/// SUCCESS: Returns with resetted monitor.
+/// FAILURE: Does not return.
+///
+void PressureStop(Pressure *pressure);
+
+#endif // BEAM_PRESSURE_H
@@ -0,0 +1,138 @@
+/// file      : ratelimit.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Per-client request-rate and bandwidth limits.
+///
+/// Every client owns a pair of token buckets (one counting requests, one counting
+/// response bytes) stored in a sharded, open-addressed table. Buckets are kept in
+/// GCRA form (a single "theoretical arrival time" per bucket) so refill is lazy and
+/// every update is one compare-and-swap. When a shard's probe window is full, the
+/// least recently seen bucket in that window is recycled (approximate LRU).
+
+#ifndef BEAM_RATE_LIMIT_H
+#define BEAM_RATE_LIMIT_H
+
+#include <sys/socket.h>
+
+#include <Misra.h>
+#include <Beam/Http.h>
+
+typedef struct {
+    u64         requests_per_sec; // sustained request rate, 0 disables request limiting
+    u64         request_burst;    // requests allowed back to back after being idle
+    u64         bytes_per_sec;    // sustained response bandwidth, 0 disables bandwidth limiting
+    u64         byte_burst;       // bytes allowed back to back after being idle
+    u32         shard_count;      // number of shards, power of two
+    u32         shard_slots;      // buckets per shard, power of two
+    u32         v6_prefix_bits;   // IPv6 clients are keyed on this many leading bits
+    const char *trusted_header;   // key on this forwarding header when present, NULL to key on peer address
+    bool        shared;           // table in memory shared with forked worker processes
+} RateLimitConfig;
+
+#ifdef __cplusplus
+#    define RateLimitConfigInit()                                                                                      \
+        (RateLimitConfig {                                                                                             \
+            .requests_per_sec = 0,                                                                                     \
+            .request_burst    = 0,                                                                                     \
+            .bytes_per_sec    = 0,                                                                                     \
+            .byte_burst       = 0,                                                                                     \
+            .shard_count      = 16,                                                                                    \
+            .shard_slots      = 4096,                                                                                  \
+            .v6_prefix_bits   = 64,                                                                                    \
+            .trusted_header   = NULL,                                                                                  \
+            .shared           = false                                                                                  \
+        })
+#else
+#    define RateLimitConfigInit()                                                                                      \
+        ((RateLimitConfig) {.requests_per_sec = 0,                                                                     \
+                            .request_burst    = 0,                                                                     \
+                            .bytes_per_sec    = 0,                                                                     \
+                            .byte_burst       = 0,                                                                     \
+                            .shard_count      = 16,                                                                    \
+                            .shard_slots      = 4096,                                                                  \
+                            .v6_prefix_bits   = 64,                                                                    \
+                            .trusted_header   = NULL,                                                                  \
+                            .shared           = false})
+#endif
+
+typedef struct RateBucket RateBucket;
+
+typedef struct {
+    RateLimitConfig config;
+    RateBucket     *buckets;           // shard_count * shard_slots buckets, shard major
+    u64             request_interval;  // ns one request costs
+    u64             request_tolerance; // ns of debt allowed before rejecting
+    u64             byte_tolerance;    // ns of debt allowed before rejecting
+} RateLimiter;
+
+///
+/// Allocate bucket table for given configuration.
+///
+/// limiter[out] : Limiter to be initialized.
+/// config[in]   : Limits and table geometry. Copied.
+///
+/// SUCCESS: `limiter`
+/// FAILURE: NULL
+///
+RateLimiter *RateLimiterInit(RateLimiter *limiter, const RateLimitConfig *config);
+
+///
+/// Free bucket table.
+///
+/// limiter[in,out] : Limiter to be deinited.
+///
+/// SUCCESS: Returns with resetted limiter.
+/// FAILURE: Does not return.
+///
+void RateLimiterDeinit(RateLimiter *limiter);
+
+///
+/// Check whether limiter has any limit configured.
+///
+/// limiter[in] : Limiter to check.
+///
+/// SUCCESS: true if at least one of request or bandwidth limit is active.
+/// FAILURE: false
+///
+bool RateLimiterEnabled(const RateLimiter *limiter);
+
+///
+/// Compute key identifying the client that sent given request.
+/// The configured trusted forwarding header takes precedence over peer address.
+/// Only the last (closest to us) address in the header is trusted.
+///
+/// limiter[in] : Limiter whose configuration decides how clients are keyed.
+/// request[in] : Parsed request, may be NULL when not yet parsed.
+/// peer[in]    : Peer address as returned by accept().
+///
+/// SUCCESS: Non-zero client key.
+/// FAILURE: 0 when no usable address is found.
+///
+u64 RateLimitKey(const RateLimiter *limiter, HttpRequest *request, const struct sockaddr_storage *peer);
+
+///
+/// Charge one request to client and check it is still within limits.
+/// A client is rejected if either its request bucket is empty or it is
+/// still in debt on its bandwidth bucket.
+///
+/// limiter[in,out] : Limiter.
+/// key[in]         : Client key from RateLimitKey.
+///
+/// SUCCESS: true when request may be served.
+/// FAILURE: false when client must be answered with TOO_MANY_REQUESTS.
+///
+bool RateLimitAdmit(RateLimiter *limiter, u64 key);
+
+///
+/// Charge bytes sent to a client against its bandwidth bucket.
+/// Bytes are always charged; excess turns into debt that later
+/// requests from the same client have to wait out.
+///
+/// limiter[in,out] : Limiter.
+/// key[in]         : Client key from RateLimitKey.
+/// nbytes[in]      : Number of response bytes sent.
+///
+void RateLimitChargeBytes(RateLimiter *limiter, u64 key, u64 nbytes);
+
+#endif // BEAM_RATE_LIMIT_H
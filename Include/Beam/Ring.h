@@ -0,0 +1,92 @@
+/// file      : ring.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Mirrored ("magic") ring buffer.
+///
+/// Same memfd pages are mapped twice, back to back. Bytes wrapping around the
+/// end of the ring show up again right after it, so both the data held and
+/// the free space after it are always one contiguous range of memory. Nothing
+/// ever has to be moved to the front to make room or to hand a parser a
+/// contiguous view of a request that wrapped around.
+
+#ifndef BEAM_RING_H
+#define BEAM_RING_H
+
+#include <Misra.h>
+
+// mappings a ring takes for as long as it lives, counted against vm.max_map_count
+#define RING_MAPPINGS 2
+
+typedef struct {
+    char *base;   // start of first mapping, second one follows at `base + size`
+    u64   size;   // bytes in one mapping, multiple of page size
+    u64   head;   // offset of first byte held, always below `size`
+    u64   length; // number of bytes held
+} Ring;
+
+#ifdef __cplusplus
+#    define RingInit() (Ring {.base = NULL, .size = 0, .head = 0, .length = 0})
+#else
+#    define RingInit() ((Ring) {.base = NULL, .size = 0, .head = 0, .length = 0})
+#endif
+
+///
+/// Map ring memory. One byte is always kept free, so that held bytes can be
+/// zero-terminated.
+///
+/// ring[in,out] : Ring to allocate memory for.
+/// min_size[in] : Number of bytes ring must be able to hold. Rounded up to pages.
+///
+/// SUCCESS: `ring`
+/// FAILURE: NULL
+///
+Ring *RingCreate(Ring *ring, u64 min_size);
+
+///
+/// Unmap ring memory.
+///
+/// ring[in,out] : Ring to be deinited.
+///
+/// SUCCESS: Returns with resetted ring.
+/// FAILURE: Does not return.
+///
+void RingDeinit(Ring *ring);
+
+///
+/// Bytes held, contiguous even when they wrap around.
+///
+static inline char *RingData(Ring *ring) {
+    return ring->base + ring->head;
+}
+
+///
+/// Free space right after held bytes, contiguous as well.
+///
+static inline char *RingTail(Ring *ring) {
+    return ring->base + ring->head + ring->length;
+}
+
+///
+/// Number of bytes that can still be appended.
+///
+static inline u64 RingSpace(Ring *ring) {
+    return ring->size - 1 - ring->length;
+}
+
+///
+/// Account for `n` bytes written at RingTail().
+///
+static inline void RingCommit(Ring *ring, u64 n) {
+    ring->length += n;
+}
+
+///
+/// Drop `n` bytes from front.
+///
+static inline void RingConsume(Ring *ring, u64 n) {
+    ring->length -= n;
+    ring->head    = ring->length ? (ring->head + n) % ring->size : 0;
+}
+
+#endif // BEAM_RING_H
@@ -0,0 +1,212 @@
+/// file      : server.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Event loop serving connections accepted on a listening socket.
+///
+/// Several loops can run side by side, either each with its own SO_REUSEPORT
+/// socket, or all sharing one registered with EPOLLEXCLUSIVE so that a new
+/// connection wakes a single waiting loop instead of all of them.
+///
+/// Sockets are non-blocking and registered edge-triggered once, for both
+/// directions. Each loop iteration runs in phases : take a batch of events,
+/// read and dispatch requests of every connection that has any, then flush
+/// every output queue that has something in it. Output is flushed fairly : a
+/// connection writes at most a quantum per loop iteration and then goes to the
+/// back of the line, so one huge sendfile cannot starve small responses queued
+/// behind it. File pages missing from page cache are read in by an I/O pool
+/// while the loop serves others.
+
+#ifndef BEAM_SERVER_H
+#define BEAM_SERVER_H
+
+#include <stdatomic.h>
+#include <sys/epoll.h>
+
+#include <Misra.h>
+#include <Beam/Balance.h>
+#include <Beam/BufPool.h>
+#include <Beam/BusyPoll.h>
+#include <Beam/Conn.h>
+#include <Beam/ConnLimit.h>
+#include <Beam/DataRate.h>
+#include <Beam/HotCache.h>
+#include <Beam/Http.h>
+#include <Beam/IoPool.h>
+#include <Beam/LoadShed.h>
+#include <Beam/Perf.h>
+#include <Beam/Prefetch.h>
+#include <Beam/RateLimit.h>
+#include <Beam/Stats.h>
+
+///
+/// Called for every admitted request. Handler queues its response on `conn`.
+///
+typedef void (*ServerHandler)(Conn *conn, HttpRequest *request);
+
+typedef struct {
+    u32            max_conns;         // size of connection slab, connections beyond this are dropped
+    u32            max_events;        // max events taken from epoll per loop iteration
+    u64            input_size;        // per-connection input buffer, caps size of request head
+    u64            keep_alive_ns;     // idle connections are closed after this long
+    u64            idle_timeout_ns;   // connections mid request or response are closed after this long without progress
+    u64            write_quantum;     // max bytes written to one connection per loop iteration
+    u64            conn_rate;         // per-connection output cap in bytes/sec, 0 for no cap
+    u64            conn_rate_after;   // bytes of each response burst sent before cap applies
+    ServerHandler  handler;           // serves admitted requests
+    RateLimiter   *rate_limiter;      // shared per-client rate limits, may be NULL
+    ConnLimiter   *conn_limiter;      // shared per-client connection caps, may be NULL
+    IoPool        *io_pool;           // reads in files missing from page cache, may be NULL
+    Balancer      *balancer;          // evens out connections across workers, may be NULL
+    u32            worker;            // index of this loop in `balancer`
+    bool           listen_exclusive;  // listening socket is shared with other loops, wake only one of them
+    u32            accept_batch;      // max connections accepted per wakeup, 0 until none are left
+    Stats         *stats;             // where loop counts, e.g. in shared memory, NULL for counters of its own
+    u64            io_readahead;      // bytes read in per page cache miss
+    u64            direct_io_min;     // file ranges at least this long bypass page cache, 0 never bypasses
+    u64            direct_io_buffer;  // size of each O_DIRECT read
+    u32            direct_io_buffers; // number of O_DIRECT read buffers, two per streaming connection
+    u64            zerocopy_min;      // in-memory sends this big lend buffers to kernel, 0 always copies
+    LoadShedConfig load_shed;
+    DataRateConfig data_rate;
+    PrefetchConfig prefetch;          // file readahead policy, no table slots leaves it to kernel
+    BusyPollConfig busy_poll;         // kernel busy polling and spinning before sleep, all off by default
+    HotCacheConfig hot_cache;         // rendered responses of hottest urls kept by this loop, no slots keeps none
+    _Atomic(u32)  *memory_keep_pct;   // share of their full size caches and buffers may use, NULL to ignore pressure
+    bool           hugepages;         // try backing connection slab and read buffers with huge pages
+    bool           tlb_counters;      // count TLB misses of thread running ServerInit() in stats, where possible
+} ServerConfig;
+
+#ifdef __cplusplus
+#    define ServerConfigInit()                                                                                         \
+        (ServerConfig {                                                                                                \
+            .max_conns         = 4096,                                                                                 \
+            .max_events        = 1024,                                                                                 \
+            .input_size        = 16384,                                                                                \
+            .keep_alive_ns     = 5000000000ull,                                                                        \
+            .idle_timeout_ns   = 30000000000ull,                                                                       \
+            .write_quantum     = 262144,                                                                               \
+            .conn_rate         = 0,                                                                                    \
+            .conn_rate_after   = 0,                                                                                    \
+            .handler           = NULL,                                                                                 \
+            .rate_limiter      = NULL,                                                                                 \
+            .conn_limiter      = NULL,                                                                                 \
+            .io_pool           = NULL,                                                                                 \
+            .balancer          = NULL,                                                                                 \
+            .worker            = 0,                                                                                    \
+            .listen_exclusive  = false,                                                                                \
+            .accept_batch      = 0,                                                                                    \
+            .stats             = NULL,                                                                                 \
+            .io_readahead      = 2097152,                                                                              \
+            .direct_io_min     = 1073741824ull,                                                                        \
+            .direct_io_buffer  = 1048576,                                                                              \
+            .direct_io_buffers = 32,                                                                                   \
+            .zerocopy_min      = 262144,                                                                               \
+            .load_shed         = LoadShedConfigInit(),                                                                 \
+            .data_rate         = DataRateConfigInit(),                                                                 \
+            .prefetch          = PrefetchConfigInit(),                                                                 \
+            .busy_poll         = BusyPollConfigInit(),                                                                 \
+            .hot_cache         = HotCacheConfigInit(),                                                                 \
+            .memory_keep_pct   = NULL,                                                                                 \
+            .hugepages         = true,                                                                                 \
+            .tlb_counters      = false                                                                                 \
+        })
+#else
+#    define ServerConfigInit()                                                                                         \
+        ((ServerConfig) {.max_conns         = 4096,                                                                    \
+                         .max_events        = 1024,                                                                    \
+                         .input_size        = 16384,                                                                   \
+                         .keep_alive_ns     = 5000000000ull,                                                           \
+                         .idle_timeout_ns   = 30000000000ull,                                                          \
+                         .write_quantum     = 262144,                                                                  \
+                         .conn_rate         = 0,                                                                       \
+                         .conn_rate_after   = 0,                                                                       \
+                         .handler           = NULL,                                                                    \
+                         .rate_limiter      = NULL,                                                                    \
+                         .conn_limiter      = NULL,                                                                    \
+                         .io_pool           = NULL,                                                                    \
+                         .balancer          = NULL,                                                                    \
+                         .worker            = 0,                                                                       \
+                         .listen_exclusive  = false,                                                                   \
+                         .accept_batch      = 0,                                                                       \
+                         .stats             = NULL,                                                                    \
+                         .io_readahead      = 2097152,                                                                 \
+                         .direct_io_min     = 1073741824ull,                                                           \
+                         .direct_io_buffer  = 1048576,                                                                 \
+                         .direct_io_buffers = 32,                                                                      \
+                         .zerocopy_min      = 262144,                                                                  \
+                         .load_shed         = LoadShedConfigInit(),                                                    \
+                         .data_rate         = DataRateConfigInit(),                                                    \
+                         .prefetch          = PrefetchConfigInit(),                                                    \
+                         .busy_poll         = BusyPollConfigInit(),                                                    \
+                         .hot_cache         = HotCacheConfigInit(),                                                    \
+                         .memory_keep_pct   = NULL,                                                                    \
+                         .hugepages         = true,                                                                    \
+                         .tlb_counters      = false})
+#endif
+
+typedef struct {
+    ServerConfig        config;
+    i32                 listen_fd;
+    i32                 epoll_fd;
+    i32                 spare_fd;      // held open to be given up for refusing connections once out of fds
+    bool                accept_paused; // listening socket is out of epoll until a spare fd is back
+    struct epoll_event *events;        // `max_events` entries, filled by epoll_wait()
+    Conn               *conns;         // connection slab, `max_conns` entries
+    Conn               *free;          // unused slab entries
+    Conn               *open;          // open connections
+    ConnOrphan         *orphans;       // closed connections kernel still sends lent buffers on
+    u32                 nconns;        // number of open connections
+    ConnList            pending;       // need a visit in next iteration, with or without an event
+    ConnList            ready;         // being visited in current iteration
+    ConnList            throttled;     // over their rate cap, waiting for it to refill
+    LoadShed            load_shed;     // queueing delay controller of this loop
+    u64                 next_sweep;    // when idle and slow connections are looked for next
+    u64                 next_id;       // id of last opened connection
+    IoCompletions       io_done;       // page cache misses read in by I/O pool
+    u32                 io_inflight;   // jobs submitted to I/O pool and not yet taken back
+    BufPool             direct_bufs;   // read buffers of connections streaming around page cache
+    Prefetch            prefetch;      // access patterns of files served by this loop
+    HotCache            hot_cache;     // rendered responses of hottest urls served by this loop
+    u32                 keep_pct;      // share of full size caches and buffers were last resized to
+    TlbCounters         tlb;           // TLB misses of loop thread, read into stats on every sweep
+    BusySpin            spin;          // how long to spin before sleeping in epoll_wait()
+    u64                 queue_delay;   // moving average of request queueing delay, published to balancer
+    Stats              *stats;         // counters of this loop, `own_stats` unless config puts them elsewhere
+    Stats               own_stats;
+} Server;
+
+///
+/// Prepare an event loop serving connections accepted on `listen_fd`.
+/// Listening socket is made non-blocking but stays owned by caller.
+///
+/// server[out]   : Server to be initialized.
+/// config[in]    : Server configuration. Copied.
+/// listen_fd[in] : Bound and listening socket.
+///
+/// SUCCESS: `server`
+/// FAILURE: NULL
+///
+Server *ServerInit(Server *server, const ServerConfig *config, i32 listen_fd);
+
+///
+/// Close all connections and free everything held by server.
+///
+/// server[in,out] : Server to be deinited.
+///
+/// SUCCESS: Returns with resetted server.
+/// FAILURE: Does not return.
+///
+void ServerDeinit(Server *server);
+
+///
+/// Run event loop.
+///
+/// server[in,out] : Initialized server.
+///
+/// SUCCESS: Does not return.
+/// FAILURE: false when event loop cannot continue.
+///
+bool ServerRun(Server *server);
+
+#endif // BEAM_SERVER_H
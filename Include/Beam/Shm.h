@@ -0,0 +1,34 @@
+/// file      : shm.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Memory shared with forked worker processes.
+///
+/// Anonymous shared mappings made before fork() stay shared between parent
+/// and every child forked afterwards, including ones forked to replace a
+/// crashed worker. Only lock-free (atomic) or single-writer data belongs here.
+
+#ifndef BEAM_SHM_H
+#define BEAM_SHM_H
+
+#include <Misra.h>
+
+///
+/// Map zeroed memory that stays shared across fork().
+///
+/// size[in] : Number of bytes.
+///
+/// SUCCESS: Mapped memory.
+/// FAILURE: NULL
+///
+void *ShmAlloc(u64 size);
+
+///
+/// Unmap memory returned by ShmAlloc().
+///
+/// mem[in]  : Mapped memory, may be NULL.
+/// size[in] : Size it was mapped with.
+///
+void ShmFree(void *mem, u64 size);
+
+#endif // BEAM_SHM_H
@@ -0,0 +1,100 @@
+/// file      : stats.h
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Counters kept by an event loop, reported in plain text.
+
+#ifndef BEAM_STATS_H
+#define BEAM_STATS_H
+
+#include <Misra.h>
+
+#define STATS_HISTOGRAM_BUCKETS 24
+
+///
+/// Power of two histogram of durations. Bucket `i` counts values below `2^i`
+/// microseconds, last bucket takes everything bigger.
+///
+typedef struct {
+    u64 buckets[STATS_HISTOGRAM_BUCKETS];
+    u64 count;
+    u64 sum;
+} StatsHistogram;
+
+typedef struct {
+    u64 accepted;      // connections accepted
+    u64 accept_misses; // wakeups for listening socket that found nothing to accept
+    u64 accept_no_fds; // connections refused, or accepting paused, for lack of file descriptors
+    u64 handed_off;    // accepted connections handed to a less loaded worker
+    u64 adopted;       // connections handed over by other workers
+    u64 requests;      // requests parsed, whether served, shed or limited
+    u64 read_calls;    // recvmsg() calls on connections
+    u64 write_calls;   // send(), sendmsg() and sendfile() calls on connections
+    u64 bytes_in;      // bytes received on connections
+    u64 bytes_out;     // bytes sent on connections
+    u64 iterations;    // event loop iterations
+    u64 events;        // events taken from epoll
+    u64 spins;         // epoll_wait() calls without timeout made while spinning
+    u64 spin_hits;     // spins that came back with events, saving a sleep
+    u64 sleeps;        // epoll_wait() calls that could block
+    u64 restarts;      // times worker was replaced after dying, worker processes only
+
+    u64 zerocopy_sends;     // sends lending their buffers to kernel with MSG_ZEROCOPY
+    u64 zerocopy_copied;    // completions saying kernel copied anyway, loopback or no scatter-gather
+    u64 zerocopy_abandoned; // lent buffers leaked, their connection closed before kernel gave them back
+
+    u64 cache_hits;   // files served from shared content cache
+    u64 cache_misses; // cacheable files sent from disk
+    u64 cache_stores; // files handed to I/O pool to be read into shared content cache
+
+    u64 cache_replica_hits; // files served from content replica of serving node
+
+    u64 hot_hits;   // responses served from hot cache of serving loop
+    u64 hot_stores; // responses put into hot cache of serving loop
+
+    u64 dtlb_misses; // data TLB misses of loop threads in user space, when counted
+    u64 itlb_misses; // instruction TLB misses of loop threads in user space, when counted
+
+    StatsHistogram loop_us; // time spent in one loop iteration, waiting excluded, in microseconds
+} Stats;
+
+#ifdef __cplusplus
+#    define StatsInit() (Stats {0})
+#else
+#    define StatsInit() ((Stats) {0})
+#endif
+
+///
+/// Record one duration.
+///
+static inline void StatsHistogramAdd(StatsHistogram *histogram, u64 us) {
+    u32 bucket = us ? 64 - (u32)__builtin_clzll(us) : 0;
+    histogram->buckets[bucket < STATS_HISTOGRAM_BUCKETS ? bucket : STATS_HISTOGRAM_BUCKETS - 1]++;
+    histogram->count++;
+    histogram->sum += us;
+}
+
+///
+/// Add counters of one loop to a total.
+///
+/// total[in,out] : Sum so far.
+/// stats[in]     : Counters to add.
+///
+/// SUCCESS: Returns with `stats` added to `total`.
+/// FAILURE: Does not return.
+///
+void StatsAdd(Stats *total, const Stats *stats);
+
+///
+/// Render counters as "name value" lines, followed by per-request ratios and
+/// histograms as cumulative "name_le_<bound> count" lines.
+///
+/// stats[in] : Counters.
+/// out[out]  : Text is appended here.
+///
+/// SUCCESS: `out`
+/// FAILURE: Does not fail.
+///
+Str *StatsRender(const Stats *stats, Str *out);
+
+#endif // BEAM_STATS_H
@@ -0,0 +1,97 @@
+/// file      : addr.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Client address helpers used to key per-client admission state.
+
+// sockets
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <Misra.h>
+#include <Beam/Addr.h>
+
+static u64 addr_mix(u64 x) {
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+u64 AddrHash(const struct sockaddr_storage *addr, u32 v6_prefix_bits) {
+    if (!addr) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    // normalize everything to a 16 byte IPv6 address
+    u8 bytes[16] = {0};
+    if (addr->ss_family == AF_INET) {
+        const struct sockaddr_in *in4 = (const struct sockaddr_in *)addr;
+        bytes[10]                     = 0xff;
+        bytes[11]                     = 0xff;
+        memcpy(bytes + 12, &in4->sin_addr, 4);
+    } else if (addr->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)addr;
+        memcpy(bytes, &in6->sin6_addr, 16);
+
+        // prefix masking only makes sense for native IPv6 peers
+        if (!IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr) && v6_prefix_bits < 128) {
+            for (u32 bit = v6_prefix_bits; bit < 128; bit++) {
+                bytes[bit / 8] &= (u8)~(0x80u >> (bit % 8));
+            }
+        }
+    } else {
+        return 0;
+    }
+
+    u64 hi, lo;
+    memcpy(&hi, bytes, 8);
+    memcpy(&lo, bytes + 8, 8);
+
+    u64 key = addr_mix(hi ^ addr_mix(lo));
+    return key ? key : 1;
+}
+
+bool AddrParse(struct sockaddr_storage *addr, const char *in, u64 len) {
+    if (!addr || !in) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    // trim whitespace and optional brackets
+    while (len && (*in == ' ' || *in == '\t')) {
+        in++;
+        len--;
+    }
+    while (len && (in[len - 1] == ' ' || in[len - 1] == '\t')) {
+        len--;
+    }
+    if (len >= 2 && in[0] == '[' && in[len - 1] == ']') {
+        in++;
+        len -= 2;
+    }
+
+    char text[INET6_ADDRSTRLEN] = {0};
+    if (!len || len >= sizeof(text)) {
+        return false;
+    }
+    memcpy(text, in, len);
+
+    memset(addr, 0, sizeof(*addr));
+
+    struct sockaddr_in *in4 = (struct sockaddr_in *)addr;
+    if (1 == inet_pton(AF_INET, text, &in4->sin_addr)) {
+        in4->sin_family = AF_INET;
+        return true;
+    }
+
+    struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)addr;
+    if (1 == inet_pton(AF_INET6, text, &in6->sin6_addr)) {
+        in6->sin6_family = AF_INET6;
+        return true;
+    }
+
+    return false;
+}
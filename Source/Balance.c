@@ -0,0 +1,221 @@
+/// file      : balance.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Connection rebalancing between workers.
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <Misra.h>
+#include <Beam/Balance.h>
+
+typedef struct {
+    _Atomic(u64)            seq; // position cell is ready for, bounded MPMC queue style
+    i32                     fd;
+    struct sockaddr_storage addr;
+} BalanceCell;
+
+// one cache line of load per worker, so publishing doesn't bounce peers' lines around
+struct BalanceWorker {
+    _Alignas(64) _Atomic(u32) conns;
+    _Atomic(u64) delay_ns;
+
+    _Alignas(64) _Atomic(u64) enqueue;
+    _Alignas(64) _Atomic(u64) dequeue;
+
+    BalanceCell *cells;
+    i32          event_fd;
+};
+
+static u64 balance_queued(BalanceWorker *w) {
+    u64 in  = atomic_load_explicit(&w->enqueue, memory_order_relaxed);
+    u64 out = atomic_load_explicit(&w->dequeue, memory_order_relaxed);
+    return in > out ? in - out : 0;
+}
+
+Balancer *BalancerInit(Balancer *balancer, const BalanceConfig *config, u32 workers) {
+    if (!balancer || !config || !workers) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    u32 slots = config->queue_slots;
+    if (!slots || (slots & (slots - 1))) {
+        LOG_ERROR("invalid balancer configuration");
+        return NULL;
+    }
+
+    memset(balancer, 0, sizeof(*balancer));
+    balancer->config  = *config;
+    balancer->workers = aligned_alloc(64, workers * sizeof(BalanceWorker));
+    if (!balancer->workers) {
+        LOG_ERROR("failed to allocate balancer");
+        return NULL;
+    }
+    memset(balancer->workers, 0, workers * sizeof(BalanceWorker));
+
+    for (u32 i = 0; i < workers; i++) {
+        BalanceWorker *w = &balancer->workers[i];
+        w->event_fd      = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        w->cells         = calloc(slots, sizeof(BalanceCell));
+        if (-1 == w->event_fd || !w->cells) {
+            LOG_SYS_ERROR("failed to create handoff queue");
+            if (w->event_fd >= 0) {
+                close(w->event_fd);
+            }
+            free(w->cells);
+            BalancerDeinit(balancer);
+            return NULL;
+        }
+
+        for (u32 c = 0; c < slots; c++) {
+            atomic_init(&w->cells[c].seq, c);
+        }
+        balancer->count++;
+    }
+
+    return balancer;
+}
+
+void BalancerDeinit(Balancer *balancer) {
+    if (!balancer) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    for (u32 i = 0; i < balancer->count; i++) {
+        BalanceWorker          *w    = &balancer->workers[i];
+        i32                     fd   = -1;
+        struct sockaddr_storage addr = {0};
+        while (BalanceTake(balancer, i, &fd, &addr)) {
+            close(fd);
+        }
+        close(w->event_fd);
+        free(w->cells);
+    }
+
+    free(balancer->workers);
+    memset(balancer, 0, sizeof(*balancer));
+}
+
+void BalancePublish(Balancer *balancer, u32 worker, u32 conns, u64 delay_ns) {
+    if (!balancer || worker >= balancer->count) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    BalanceWorker *w = &balancer->workers[worker];
+    atomic_store_explicit(&w->conns, conns, memory_order_relaxed);
+    atomic_store_explicit(&w->delay_ns, delay_ns, memory_order_relaxed);
+}
+
+i32 BalancePick(Balancer *balancer, u32 worker) {
+    if (!balancer || worker >= balancer->count) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    BalanceWorker *self  = &balancer->workers[worker];
+    u64            load  = atomic_load_explicit(&self->conns, memory_order_relaxed) + balance_queued(self);
+    u64            delay = atomic_load_explicit(&self->delay_ns, memory_order_relaxed);
+
+    // a lighter peer already slower to get to its requests is no better off
+    i32 best      = -1;
+    u64 best_load = load;
+    for (u32 i = 0; i < balancer->count; i++) {
+        BalanceWorker *w = &balancer->workers[i];
+        if (i == worker || atomic_load_explicit(&w->delay_ns, memory_order_relaxed) > delay) {
+            continue;
+        }
+
+        u64 l = atomic_load_explicit(&w->conns, memory_order_relaxed) + balance_queued(w);
+        if (l < best_load) {
+            best      = (i32)i;
+            best_load = l;
+        }
+    }
+
+    if (best < 0 || load - best_load < balancer->config.min_gap ||
+        load * 100 <= best_load * balancer->config.ratio_pct) {
+        return -1;
+    }
+
+    return best;
+}
+
+bool BalanceHandoff(Balancer *balancer, u32 worker, i32 fd, const struct sockaddr_storage *addr) {
+    if (!balancer || worker >= balancer->count || fd < 0 || !addr) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    BalanceWorker *w    = &balancer->workers[worker];
+    u64            mask = balancer->config.queue_slots - 1;
+
+    // claim a cell : it's free once its sequence caught up with our position
+    u64          pos  = atomic_load_explicit(&w->enqueue, memory_order_relaxed);
+    BalanceCell *cell = NULL;
+    while (true) {
+        cell    = &w->cells[pos & mask];
+        u64 seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        if (seq == pos) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &w->enqueue,
+                    &pos,
+                    pos + 1,
+                    memory_order_relaxed,
+                    memory_order_relaxed
+                )) {
+                break;
+            }
+        } else if (seq < pos) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&w->enqueue, memory_order_relaxed);
+        }
+    }
+
+    cell->fd   = fd;
+    cell->addr = *addr;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+    u64 one = 1;
+    while (-1 == write(w->event_fd, &one, sizeof(one)) && errno == EINTR) {}
+
+    return true;
+}
+
+bool BalanceTake(Balancer *balancer, u32 worker, i32 *fd, struct sockaddr_storage *addr) {
+    if (!balancer || worker >= balancer->count || !fd || !addr) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    BalanceWorker *w    = &balancer->workers[worker];
+    u64            mask = balancer->config.queue_slots - 1;
+
+    u64          pos  = atomic_load_explicit(&w->dequeue, memory_order_relaxed);
+    BalanceCell *cell = &w->cells[pos & mask];
+    if (atomic_load_explicit(&cell->seq, memory_order_acquire) != pos + 1) {
+        // clear readiness, anything handed after this signals again
+        u64 count = 0;
+        while (-1 == read(w->event_fd, &count, sizeof(count)) && errno == EINTR) {}
+
+        // a handoff may have landed in between
+        if (atomic_load_explicit(&cell->seq, memory_order_acquire) != pos + 1) {
+            return false;
+        }
+    }
+
+    *fd   = cell->fd;
+    *addr = cell->addr;
+    atomic_store_explicit(&w->dequeue, pos + 1, memory_order_relaxed);
+    atomic_store_explicit(&cell->seq, pos + mask + 1, memory_order_release);
+
+    return true;
+}
+
+i32 BalanceEventFd(Balancer *balancer, u32 worker) {
+    if (!balancer || worker >= balancer->count) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    return balancer->workers[worker].event_fd;
+}
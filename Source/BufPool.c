@@ -0,0 +1,109 @@
+/// file      : bufpool.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Fixed pool of equally sized, aligned buffers.
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <Misra.h>
+#include <Beam/BufPool.h>
+#include <Beam/HugePage.h>
+
+BufPool *BufPoolCreate(BufPool *pool, u64 buffer_size, u32 count, u64 align, bool huge) {
+    if (!pool || !buffer_size || !count || !align || (align & (align - 1)) || buffer_size % align ||
+        align > (u64)sysconf(_SC_PAGESIZE)) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    memset(pool, 0, sizeof(*pool));
+
+    // mappings are page aligned, so every buffer is aligned too
+    void *mem = HugePageAlloc(buffer_size * count, huge);
+    if (!mem) {
+        LOG_ERROR("failed to allocate aligned buffers");
+        return NULL;
+    }
+
+    pool->free = calloc(count, sizeof(u8 *));
+    if (!pool->free) {
+        LOG_ERROR("failed to allocate buffer pool");
+        HugePageFree(mem, buffer_size * count);
+        return NULL;
+    }
+
+    pool->mem         = mem;
+    pool->count       = count;
+    pool->limit       = count;
+    pool->buffer_size = buffer_size;
+    for (u32 i = count; i; i--) {
+        pool->free[pool->nfree++] = pool->mem + (i - 1) * buffer_size;
+    }
+
+    return pool;
+}
+
+void BufPoolDeinit(BufPool *pool) {
+    if (!pool) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (pool->nfree != pool->count) {
+        LOG_ERROR("buffer pool deinited with buffers still in use");
+    }
+
+    free(pool->free);
+    HugePageFree(pool->mem, pool->buffer_size * pool->count);
+    memset(pool, 0, sizeof(*pool));
+}
+
+u8 *BufPoolGet(BufPool *pool) {
+    if (!pool) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    return BufPoolAvailable(pool) ? pool->free[--pool->nfree] : NULL;
+}
+
+u32 BufPoolAvailable(const BufPool *pool) {
+    if (!pool) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    u32 used = pool->count - pool->nfree;
+    u32 left = pool->limit > used ? pool->limit - used : 0;
+    return left < pool->nfree ? left : pool->nfree;
+}
+
+void BufPoolResize(BufPool *pool, u32 limit) {
+    if (!pool) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    pool->limit = limit < pool->count ? limit : pool->count;
+
+    // buffers are handed out from top of free stack, those at bottom wait longest. On hugetlb
+    // backing kernel refuses anything short of a whole huge page, such buffers just stay resident.
+    u64 page  = (u64)sysconf(_SC_PAGESIZE);
+    u32 spare = pool->nfree - BufPoolAvailable(pool);
+    for (u32 i = 0; i < spare; i++) {
+        u64 start = ((u64)(uintptr_t)pool->free[i] + page - 1) & ~(page - 1);
+        u64 end   = ((u64)(uintptr_t)pool->free[i] + pool->buffer_size) & ~(page - 1);
+        if (start < end) {
+            madvise((void *)(uintptr_t)start, end - start, MADV_DONTNEED);
+        }
+    }
+}
+
+void BufPoolPut(BufPool *pool, u8 *buf) {
+    if (!pool || !buf || buf < pool->mem || buf >= pool->mem + pool->buffer_size * pool->count) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (pool->nfree == pool->count) {
+        LOG_FATAL("buffer given back twice");
+    }
+
+    pool->free[pool->nfree++] = buf;
+}
@@ -0,0 +1,107 @@
+/// file      : busypoll.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Busy polling and adaptive spinning.
+
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include <Misra.h>
+#include <Beam/BusyPoll.h>
+
+// older headers
+#ifndef SO_PREFER_BUSY_POLL
+#    define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef SO_BUSY_POLL_BUDGET
+#    define SO_BUSY_POLL_BUDGET 70
+#endif
+
+bool BusyPollEnable(int sockfd, const BusyPollConfig *config) {
+    if (sockfd < 0 || !config) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!config->poll_us) {
+        return true;
+    }
+
+    if (-1 == setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, &(int) {(int)config->poll_us}, sizeof(int))) {
+        LOG_SYS_ERROR("setsockopt(SO_BUSY_POLL) failed");
+        return false;
+    }
+
+    // keeps interrupts deferred while the loop is polling, so they don't steal the work back
+    if (-1 == setsockopt(sockfd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &(int) {1}, sizeof(int))) {
+        LOG_SYS_ERROR("setsockopt(SO_PREFER_BUSY_POLL) failed");
+        return false;
+    }
+
+    if (config->poll_budget &&
+        -1 == setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &(int) {(int)config->poll_budget}, sizeof(int))) {
+        LOG_SYS_ERROR("setsockopt(SO_BUSY_POLL_BUDGET) failed");
+        return false;
+    }
+
+    return true;
+}
+
+bool BusyPollEnableEpoll(int epfd, const BusyPollConfig *config) {
+    if (epfd < 0 || !config) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!config->poll_us) {
+        return true;
+    }
+
+#ifdef EPIOCSPARAMS
+    struct epoll_params params = {
+        .busy_poll_usecs  = config->poll_us,
+        .busy_poll_budget = (u16)(config->poll_budget ? config->poll_budget : 8),
+        .prefer_busy_poll = 1,
+    };
+    if (-1 == ioctl(epfd, EPIOCSPARAMS, &params)) {
+        LOG_SYS_ERROR("ioctl(EPIOCSPARAMS) failed");
+        return false;
+    }
+    return true;
+#else
+    LOG_ERROR("per epoll busy poll parameters not supported, net.core.busy_poll applies");
+    return false;
+#endif
+}
+
+void BusySpinSpun(BusySpin *spin, bool found) {
+    if (!spin) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (found) {
+        spin->budget_ns *= 2;
+    } else {
+        spin->budget_ns /= 2;
+    }
+
+    if (spin->budget_ns > spin->config.spin_ns) {
+        spin->budget_ns = spin->config.spin_ns;
+    }
+    if (spin->budget_ns < spin->config.spin_min_ns) {
+        spin->budget_ns = 0;
+    }
+}
+
+void BusySpinWoke(BusySpin *spin, u64 slept_ns) {
+    if (!spin) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    // a spin of full length would have caught this one without sleeping
+    if (slept_ns < spin->config.spin_ns) {
+        u64 grown       = spin->budget_ns * 2;
+        spin->budget_ns = grown > spin->config.spin_min_ns ? grown : spin->config.spin_min_ns;
+        spin->budget_ns = spin->budget_ns < spin->config.spin_ns ? spin->budget_ns : spin->config.spin_ns;
+    }
+}
@@ -0,0 +1,1158 @@
+/// file      : cache.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Static content cache shared by all workers.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <Misra.h>
+#include <Beam/Cache.h>
+#include <Beam/Clock.h>
+#include <Beam/HugePage.h>
+#include <Beam/Numa.h>
+
+#define CACHE_MAGIC 0x6265616d63616368ull // "beamcach"
+
+// slots looked at for a path, starting at its home slot
+#define CACHE_PROBE 8
+
+// readers retry a slot being written this many times before calling it a miss
+#define CACHE_READ_RETRIES 4
+
+// no slot, no block
+#define CACHE_NONE UINT32_MAX
+
+// frequency sketch : rows, counter ceiling, and counted lookups per slot before all counters are halved
+#define CACHE_SKETCH_ROWS    4
+#define CACHE_SKETCH_MAX     15
+#define CACHE_SKETCH_SAMPLES 10
+
+// lossy buffers hits are recorded in until a writer replays them, one per group of threads
+#define CACHE_READ_STRIPES 16
+#define CACHE_READ_BUFFER  256
+
+#define CACHE_SNAPSHOT_MAGIC   0x6265616d736e6170ull // "beamsnap"
+#define CACHE_SNAPSHOT_VERSION 1
+
+typedef enum {
+    CACHE_LIST_NONE,
+    CACHE_LIST_WINDOW,
+    CACHE_LIST_PROBATION,
+    CACHE_LIST_PROTECTED,
+    CACHE_LIST_COUNT,
+} CacheListId;
+
+typedef struct {
+    u32 head;   // most recently used
+    u32 tail;   // least recently used, evicted first
+    u64 blocks; // blocks held by entries on list
+    u64 cap;    // blocks list may hold
+} CacheList;
+
+typedef struct {
+    _Alignas(64) _Atomic(u64) tail; // records ever written
+    u64          head;                       // records replayed, lock holder only
+    _Atomic(u64) records[CACHE_READ_BUFFER]; // slot index + 1 and its sequence, 0 once replayed
+} CacheReadStripe;
+
+struct CacheHeader {
+    u64             magic;
+    u32             slot_count;
+    u32             block_count;
+    u64             sketch_width; // counters per sketch row, power of two
+    pthread_mutex_t lock;         // taken by writers, process-shared and robust
+
+    // everything below up to `samples` is changed by lock holder only
+    u32       block_limit; // blocks below this one may hold content, `block_count` unless shrunk
+    u32       free_head;   // first free block
+    u32       free_count;
+    CacheList lists[CACHE_LIST_COUNT];
+    u64       main_cap; // blocks probation and protected may hold together
+    u64       admitted; // window evictees let into main
+    u64       rejected; // window evictees looked up less than main's victim
+    u64       promoted; // entries hit on probation, moved to protected
+    u64       evicted;  // entries dropped
+
+    // read on every worker-local lookup, kept off lines writers keep changing
+    _Alignas(64) _Atomic(u64) generation; // bumped whenever a cached file is replaced by different content
+
+    _Alignas(64) _Atomic(u64) samples; // sketch increments since counters were last halved
+    CacheReadStripe stripes[CACHE_READ_STRIPES];
+};
+
+struct CacheSlot {
+    _Atomic(u32) seq;      // odd while being written
+    u32          path_len; // bytes of path at start of entry
+    u64          hash;     // hash of path, 0 for an empty slot
+    u32          first;    // first block of entry, path followed by content
+    u32          nblocks;  // blocks in chain
+    u64          length;   // bytes of content
+    u64          file_id;  // validators of cached file
+    u64          mtime_ns;
+    u64          size;
+    _Atomic(u64) hits; // lookups served, kept up outside of seqlock
+    u32          prev; // neighbours on policy list, lock holder only
+    u32          next;
+    u32          list;
+};
+
+// snapshot file : header followed by `count` records, each followed by its path
+typedef struct {
+    u64 magic;
+    u32 version;
+    u32 count;
+} CacheSnapshotHeader;
+
+typedef struct {
+    u64 hits;
+    u64 file_id;
+    u64 mtime_ns;
+    u64 size;
+    u32 path_len;
+} CacheSnapshotRecord;
+
+typedef struct {
+    CacheSnapshotRecord record;
+    char               *path;
+} CacheSnapshotEntry;
+
+// shared by threads warming cache up from a snapshot
+typedef struct {
+    Cache              *cache;
+    CacheSnapshotEntry *entries;
+    u32                 count;
+    _Atomic(u32)        next;
+    _Atomic(u32)        loaded;
+} CacheWarmer;
+
+// read buffer stripe of calling thread
+static _Thread_local u32 cache_stripe = CACHE_NONE;
+
+// FNV-1a, never 0 so that 0 can mean empty
+static u64 cache_hash(const char *path, u64 len) {
+    u64 h = 0xcbf29ce484222325ull;
+    for (u64 i = 0; i < len; i++) {
+        h ^= (u8)path[i];
+        h *= 0x100000001b3ull;
+    }
+    return h ? h : 1;
+}
+
+static u64 cache_mix(u64 x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+static _Atomic(u8) *cache_counter(Cache *cache, u64 hash, u32 row) {
+    u64 width = cache->header->sketch_width;
+    return &cache->sketch[row * width + (cache_mix(hash + row * 0x9e3779b97f4a7c15ull) & (width - 1))];
+}
+
+// count one lookup of a path, halving every counter once enough were counted so old popularity fades
+static void cache_sketch_add(Cache *cache, u64 hash) {
+    bool counted = false;
+    for (u32 row = 0; row < CACHE_SKETCH_ROWS; row++) {
+        _Atomic(u8) *counter = cache_counter(cache, hash, row);
+        if (atomic_load_explicit(counter, memory_order_relaxed) < CACHE_SKETCH_MAX) {
+            atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+            counted = true;
+        }
+    }
+
+    // saturated counters aren't counted, so hot paths don't hammer a shared line
+    u64 limit = (u64)CACHE_SKETCH_SAMPLES * cache->header->slot_count;
+    if (counted && atomic_fetch_add_explicit(&cache->header->samples, 1, memory_order_relaxed) + 1 == limit) {
+        u64 n = CACHE_SKETCH_ROWS * cache->header->sketch_width;
+        for (u64 i = 0; i < n; i++) {
+            u8 c = atomic_load_explicit(&cache->sketch[i], memory_order_relaxed);
+            atomic_store_explicit(&cache->sketch[i], c / 2, memory_order_relaxed);
+        }
+        atomic_store_explicit(&cache->header->samples, 0, memory_order_relaxed);
+    }
+}
+
+static u32 cache_sketch_freq(Cache *cache, u64 hash) {
+    u32 freq = CACHE_SKETCH_MAX;
+    for (u32 row = 0; row < CACHE_SKETCH_ROWS; row++) {
+        u32 c = atomic_load_explicit(cache_counter(cache, hash, row), memory_order_relaxed);
+        freq  = c < freq ? c : freq;
+    }
+    return freq;
+}
+
+// consistent copy of a slot, false when a writer kept it busy
+static bool cache_read_slot(CacheSlot *slot, CacheSlot *copy, u32 *seq) {
+    for (u32 attempt = 0; attempt < CACHE_READ_RETRIES; attempt++) {
+        *seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (*seq & 1) {
+            continue;
+        }
+
+        memcpy(copy, slot, sizeof(*copy));
+        atomic_thread_fence(memory_order_acquire);
+        if (*seq == atomic_load_explicit(&slot->seq, memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// slot still holds what was read at `seq`
+static bool cache_unchanged(CacheSlot *slot, u32 seq) {
+    atomic_thread_fence(memory_order_acquire);
+    return seq == atomic_load_explicit(&slot->seq, memory_order_relaxed);
+}
+
+// copy `len` bytes found `skip` bytes into a chain, false when chain ends first
+static bool cache_copy(Cache *cache, u32 first, u64 skip, char *dst, u64 len) {
+    u64 size  = cache->config.block_size;
+    u32 block = first;
+    for (; skip >= size; skip -= size) {
+        if (block >= cache->header->block_count) {
+            return false;
+        }
+        block = atomic_load_explicit(&cache->next[block], memory_order_relaxed);
+    }
+
+    // chain may be freed and relinked under a reader, every index is checked
+    while (len) {
+        if (block >= cache->header->block_count) {
+            return false;
+        }
+        u64 n = size - skip < len ? size - skip : len;
+        memcpy(dst, cache->blocks + (u64)block * size + skip, n);
+        dst   += n;
+        len   -= n;
+        skip   = 0;
+        block  = atomic_load_explicit(&cache->next[block], memory_order_relaxed);
+    }
+    return true;
+}
+
+// fill a chain of freshly allocated blocks, lock holder only
+static void cache_fill(Cache *cache, u32 first, u64 skip, const char *src, u64 len) {
+    u64 size  = cache->config.block_size;
+    u32 block = first;
+    for (; skip >= size; skip -= size) {
+        block = atomic_load_explicit(&cache->next[block], memory_order_relaxed);
+    }
+    while (len) {
+        u64 n = size - skip < len ? size - skip : len;
+        memcpy(cache->blocks + (u64)block * size + skip, src, n);
+        src   += n;
+        len   -= n;
+        skip   = 0;
+        block  = atomic_load_explicit(&cache->next[block], memory_order_relaxed);
+    }
+}
+
+static u32 cache_alloc(Cache *cache, u32 count) {
+    CacheHeader *h     = cache->header;
+    u32          first = h->free_head;
+    u32          last  = first;
+    for (u32 i = 1; i < count; i++) {
+        last = atomic_load_explicit(&cache->next[last], memory_order_relaxed);
+    }
+    h->free_head = atomic_load_explicit(&cache->next[last], memory_order_relaxed);
+    atomic_store_explicit(&cache->next[last], CACHE_NONE, memory_order_relaxed);
+    h->free_count -= count;
+    return first;
+}
+
+static void cache_release(Cache *cache, u32 first, u32 count) {
+    CacheHeader *h    = cache->header;
+    u32          last = first;
+    for (u32 i = 1; i < count; i++) {
+        last = atomic_load_explicit(&cache->next[last], memory_order_relaxed);
+    }
+    atomic_store_explicit(&cache->next[last], h->free_head, memory_order_relaxed);
+    h->free_head   = first;
+    h->free_count += count;
+}
+
+static void cache_unlink(Cache *cache, u32 index) {
+    CacheSlot *slot = &cache->slots[index];
+    CacheList *list = &cache->header->lists[slot->list];
+    if (slot->prev != CACHE_NONE) {
+        cache->slots[slot->prev].next = slot->next;
+    } else {
+        list->head = slot->next;
+    }
+    if (slot->next != CACHE_NONE) {
+        cache->slots[slot->next].prev = slot->prev;
+    } else {
+        list->tail = slot->prev;
+    }
+    list->blocks -= slot->nblocks;
+    slot->list    = CACHE_LIST_NONE;
+    slot->prev    = CACHE_NONE;
+    slot->next    = CACHE_NONE;
+}
+
+// make entry most recently used on a list
+static void cache_link(Cache *cache, u32 index, CacheListId id) {
+    CacheSlot *slot = &cache->slots[index];
+    CacheList *list = &cache->header->lists[id];
+    slot->list      = id;
+    slot->prev      = CACHE_NONE;
+    slot->next      = list->head;
+    if (list->head != CACHE_NONE) {
+        cache->slots[list->head].prev = index;
+    } else {
+        list->tail = index;
+    }
+    list->head    = index;
+    list->blocks += slot->nblocks;
+}
+
+// empty a slot, its blocks can be reused right away : readers notice sequence moved on
+static void cache_drop(Cache *cache, u32 index) {
+    CacheSlot *slot = &cache->slots[index];
+    if (slot->list) {
+        cache_unlink(cache, index);
+    }
+
+    u32 seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->hash = 0;
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+
+    cache_release(cache, slot->first, slot->nblocks);
+    cache->header->evicted++;
+}
+
+// a hit replayed from read buffers, same as LRU would do on the spot
+static void cache_touch(Cache *cache, u32 index) {
+    CacheList *protected = &cache->header->lists[CACHE_LIST_PROTECTED];
+    CacheSlot *slot      = &cache->slots[index];
+    switch (slot->list) {
+        case CACHE_LIST_WINDOW :
+        case CACHE_LIST_PROTECTED : {
+            CacheListId id = slot->list;
+            cache_unlink(cache, index);
+            cache_link(cache, index, id);
+            break;
+        }
+
+        case CACHE_LIST_PROBATION : {
+            cache_unlink(cache, index);
+            cache_link(cache, index, CACHE_LIST_PROTECTED);
+            cache->header->promoted++;
+
+            // protected segment overflows back onto probation, still ahead of cold entries there
+            while (protected->blocks > protected->cap && protected->tail != index) {
+                u32 demoted = protected->tail;
+                cache_unlink(cache, demoted);
+                cache_link(cache, demoted, CACHE_LIST_PROBATION);
+            }
+            break;
+        }
+
+        default :
+            break;
+    }
+}
+
+// apply hits readers recorded since last time, lock holder only
+static void cache_replay(Cache *cache) {
+    for (u32 i = 0; i < CACHE_READ_STRIPES; i++) {
+        CacheReadStripe *stripe = &cache->header->stripes[i];
+        u64              tail   = atomic_load_explicit(&stripe->tail, memory_order_acquire);
+        u64              head   = tail - stripe->head > CACHE_READ_BUFFER ? tail - CACHE_READ_BUFFER : stripe->head;
+        for (; head < tail; head++) {
+            u64 record = atomic_exchange_explicit(&stripe->records[head % CACHE_READ_BUFFER], 0, memory_order_relaxed);
+            u64 index  = (record >> 32) - 1;
+            if (!record || index >= cache->header->slot_count) {
+                continue;
+            }
+
+            // slot reused since, hit was on something else
+            CacheSlot *slot = &cache->slots[index];
+            if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == (u32)record && slot->list) {
+                cache_touch(cache, (u32)index);
+            }
+        }
+        stripe->head = tail;
+    }
+}
+
+static void cache_record_hit(Cache *cache, u32 index, u32 seq) {
+    if (cache_stripe == CACHE_NONE) {
+        cache_stripe = (u32)gettid() % CACHE_READ_STRIPES;
+    }
+
+    CacheReadStripe *stripe = &cache->header->stripes[cache_stripe];
+    u64              at     = atomic_fetch_add_explicit(&stripe->tail, 1, memory_order_relaxed);
+    u64              record = ((u64)(index + 1) << 32) | seq;
+    atomic_store_explicit(&stripe->records[at % CACHE_READ_BUFFER], record, memory_order_relaxed);
+}
+
+// least recently used entry of window moves to main when it's looked up more than what main would drop for it
+static void cache_evict_window(Cache *cache) {
+    CacheHeader *h         = cache->header;
+    CacheList   *probation = &h->lists[CACHE_LIST_PROBATION];
+    CacheList   *protected = &h->lists[CACHE_LIST_PROTECTED];
+    u32          candidate = h->lists[CACHE_LIST_WINDOW].tail;
+    if (candidate == CACHE_NONE) {
+        return;
+    }
+
+    CacheSlot *slot = &cache->slots[candidate];
+    cache_unlink(cache, candidate);
+    if (cache->config.policy == CACHE_POLICY_LRU) {
+        cache_drop(cache, candidate);
+        return;
+    }
+
+    if (probation->blocks + protected->blocks + slot->nblocks <= h->main_cap) {
+        cache_link(cache, candidate, CACHE_LIST_PROBATION);
+        return;
+    }
+
+    u32 victim = probation->tail != CACHE_NONE ? probation->tail : protected->tail;
+    if (victim == CACHE_NONE || slot->nblocks > h->main_cap ||
+        cache_sketch_freq(cache, slot->hash) <= cache_sketch_freq(cache, cache->slots[victim].hash)) {
+        h->rejected++;
+        cache_drop(cache, candidate);
+        return;
+    }
+
+    h->admitted++;
+    while (probation->blocks + protected->blocks + slot->nblocks > h->main_cap) {
+        cache_drop(cache, probation->tail != CACHE_NONE ? probation->tail : protected->tail);
+    }
+    cache_link(cache, candidate, CACHE_LIST_PROBATION);
+}
+
+// split blocks content may use between policy lists
+static void cache_set_caps(Cache *cache) {
+    CacheHeader *h     = cache->header;
+    u64          count = h->block_limit;
+
+    // window has to fit biggest entry, plain LRU is all window
+    u64 largest = (cache->config.max_object + PATH_MAX + cache->config.block_size - 1) / cache->config.block_size;
+    u64 window  = count * cache->config.window_pct / 100;
+    window      = window > largest ? window : largest;
+    if (window > count || cache->config.policy == CACHE_POLICY_LRU) {
+        window = count;
+    }
+    h->lists[CACHE_LIST_WINDOW].cap    = window;
+    h->main_cap                        = count - window;
+    h->lists[CACHE_LIST_PROBATION].cap = h->main_cap;
+    h->lists[CACHE_LIST_PROTECTED].cap = h->main_cap * cache->config.protected_pct / 100;
+}
+
+// forget everything, also how a dead lock holder's half done work is undone
+static void cache_reset(Cache *cache) {
+    CacheHeader *h = cache->header;
+    for (u32 i = 0; i < h->slot_count; i++) {
+        CacheSlot *slot = &cache->slots[i];
+        u32        seq  = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+        atomic_store_explicit(&slot->seq, seq | 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        slot->hash = 0;
+        slot->list = CACHE_LIST_NONE;
+        slot->prev = CACHE_NONE;
+        slot->next = CACHE_NONE;
+        atomic_store_explicit(&slot->seq, (seq | 1) + 1, memory_order_release);
+    }
+
+    for (u32 i = 0; i < h->block_limit; i++) {
+        atomic_store_explicit(&cache->next[i], i + 1 < h->block_limit ? i + 1 : CACHE_NONE, memory_order_relaxed);
+    }
+    h->free_head  = h->block_limit ? 0 : CACHE_NONE;
+    h->free_count = h->block_limit;
+
+    for (u32 i = 0; i < CACHE_LIST_COUNT; i++) {
+        h->lists[i].head   = CACHE_NONE;
+        h->lists[i].tail   = CACHE_NONE;
+        h->lists[i].blocks = 0;
+    }
+}
+
+static bool cache_lock(Cache *cache, bool wait) {
+    pthread_mutex_t *lock = &cache->header->lock;
+    int              err  = wait ? pthread_mutex_lock(lock) : pthread_mutex_trylock(lock);
+    if (err == EOWNERDEAD) {
+        LOG_ERROR("a worker died while writing to cache, flushing it");
+        cache_reset(cache);
+        pthread_mutex_consistent(lock);
+        return true;
+    }
+    return !err;
+}
+
+// memfd of given size, huge pages first when asked for
+static i32 cache_memfd(u64 *size, bool hugepages, bool *huge) {
+    if (hugepages) {
+        u64 rounded = (*size + HUGE_PAGE_SIZE - 1) & ~(u64)(HUGE_PAGE_SIZE - 1);
+        i32 fd      = memfd_create("beam-cache", MFD_CLOEXEC | MFD_HUGETLB);
+        if (fd >= 0 && 0 == ftruncate(fd, (off_t)rounded)) {
+            *size = rounded;
+            *huge = true;
+            return fd;
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    *huge  = false;
+    i32 fd = memfd_create("beam-cache", MFD_CLOEXEC);
+    if (-1 == fd) {
+        LOG_SYS_ERROR("memfd_create() failed");
+        return -1;
+    }
+    if (-1 == ftruncate(fd, (off_t)*size)) {
+        LOG_SYS_ERROR("ftruncate() failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static u64 cache_align(u64 x, u64 to) {
+    return (x + to - 1) / to * to;
+}
+
+Cache *CacheCreate(Cache *cache, const CacheConfig *config) {
+    if (!cache || !config) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    u32 slots = config->slots;
+    u32 bsize = config->block_size;
+    u64 count = bsize ? config->size / bsize : 0;
+    if (!slots || (slots & (slots - 1)) || bsize < 64 || (bsize & (bsize - 1)) || !count || count >= CACHE_NONE ||
+        config->window_pct > 100 || config->protected_pct > 100) {
+        LOG_ERROR("invalid cache configuration");
+        return NULL;
+    }
+
+    *cache        = CacheInit();
+    cache->config = *config;
+
+    u64 width = 64;
+    while (width < slots) {
+        width *= 2;
+    }
+
+    u64 page      = (u64)sysconf(_SC_PAGESIZE);
+    u64 slots_at  = cache_align(sizeof(CacheHeader), 64);
+    u64 sketch_at = slots_at + (u64)slots * sizeof(CacheSlot);
+    u64 next_at   = cache_align(sketch_at + CACHE_SKETCH_ROWS * width, 64);
+    u64 blocks_at = cache_align(next_at + count * sizeof(u32), page);
+    u64 size      = blocks_at + count * bsize;
+
+    bool huge = false;
+    i32  fd   = cache_memfd(&size, config->hugepages, &huge);
+    if (-1 == fd) {
+        return NULL;
+    }
+
+    char *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == base) {
+        LOG_SYS_ERROR("mmap() failed");
+        return NULL;
+    }
+
+    // nothing touched yet, every page lands where policy says
+    if (!NumaBind(base, size, config->numa_node)) {
+        LOG_SYS_ERROR("mbind() failed, cache pages go wherever they're first touched");
+    }
+
+    // shmem can still get transparent huge pages when hugetlb pool is empty
+    if (!huge && config->hugepages) {
+        madvise(base, size, MADV_HUGEPAGE);
+    }
+
+    cache->header   = (CacheHeader *)base;
+    cache->slots    = (CacheSlot *)(base + slots_at);
+    cache->sketch   = (_Atomic(u8) *)(base + sketch_at);
+    cache->next     = (_Atomic(u32) *)(base + next_at);
+    cache->blocks   = base + blocks_at;
+    cache->map_size = size;
+    cache->huge     = huge;
+
+    CacheHeader *h  = cache->header;
+    h->magic        = CACHE_MAGIC;
+    h->slot_count   = slots;
+    h->block_count  = (u32)count;
+    h->block_limit  = (u32)count;
+    h->sketch_width = width;
+    atomic_init(&h->generation, 1);
+    atomic_init(&h->samples, 0);
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&h->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    cache_set_caps(cache);
+    cache_reset(cache);
+    return cache;
+}
+
+void CacheDeinit(Cache *cache) {
+    if (!cache) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (cache->header) {
+        munmap(cache->header, cache->map_size);
+    }
+    *cache = CacheInit();
+}
+
+bool CacheGet(Cache *cache, const char *path, const CacheValidator *valid, Str *out) {
+    if (!cache || !path || !valid || !out) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!cache->header) {
+        return false;
+    }
+
+    u64 len = strlen(path);
+    if (len >= PATH_MAX) {
+        return false;
+    }
+
+    // misses count too, admission compares how often paths are asked for, not how often they hit
+    u64 hash = cache_hash(path, len);
+    u64 mask = cache->header->slot_count - 1;
+    if (cache->config.policy == CACHE_POLICY_TINYLFU) {
+        cache_sketch_add(cache, hash);
+    }
+
+    char key[PATH_MAX];
+    for (u32 probe = 0; probe < CACHE_PROBE; probe++) {
+        u32        index = (u32)((hash + probe) & mask);
+        CacheSlot *slot  = &cache->slots[index];
+        CacheSlot  copy;
+        u32        seq = 0;
+        if (!cache_read_slot(slot, &copy, &seq) || copy.hash != hash || copy.path_len != len ||
+            copy.file_id != valid->file_id || copy.mtime_ns != valid->mtime_ns || copy.size != valid->size) {
+            continue;
+        }
+
+        if (!cache_copy(cache, copy.first, 0, key, len) || memcmp(key, path, len)) {
+            continue;
+        }
+
+        StrReserve(out, out->length + copy.length);
+        bool whole = cache_copy(cache, copy.first, len, StrEnd(out), copy.length);
+
+        // blocks freed and reused while copying : what was copied is garbage
+        if (!whole || !cache_unchanged(slot, seq)) {
+            return false;
+        }
+
+        out->length += copy.length;
+        atomic_fetch_add_explicit(&slot->hits, 1, memory_order_relaxed);
+        cache_record_hit(cache, index, seq);
+        return true;
+    }
+
+    return false;
+}
+
+// store an entry, starting it off with `hits` lookups
+static bool cache_store(
+    Cache                *cache,
+    const char           *path,
+    const CacheValidator *valid,
+    const char           *data,
+    u64                   size,
+    u64                   hits,
+    bool                  wait
+) {
+    if (!cache->header || size > cache->config.max_object) {
+        return false;
+    }
+
+    u64 len = strlen(path);
+    u64 bs  = cache->config.block_size;
+    u32 n   = (u32)((len + size + bs - 1) / bs);
+    if (len >= PATH_MAX || n > cache->header->lists[CACHE_LIST_WINDOW].cap) {
+        return false;
+    }
+
+    if (!cache_lock(cache, wait)) {
+        return false;
+    }
+    cache_replay(cache);
+
+    // same path, else empty, else least looked up slot in probe window
+    CacheHeader *h      = cache->header;
+    u64          hash   = cache_hash(path, len);
+    u64          mask   = h->slot_count - 1;
+    u32          victim = CACHE_NONE;
+    u32          rank   = 0;
+    u32          freq   = 0;
+    char         key[PATH_MAX];
+    for (u32 probe = 0; probe < CACHE_PROBE && rank < 3; probe++) {
+        u32        index = (u32)((hash + probe) & mask);
+        CacheSlot *slot  = &cache->slots[index];
+        if (!slot->hash) {
+            victim = rank < 2 ? index : victim;
+            rank   = rank < 2 ? 2 : rank;
+        } else if (slot->hash == hash && slot->path_len == len && cache_copy(cache, slot->first, 0, key, len) &&
+                   !memcmp(key, path, len)) {
+            victim = index;
+            rank   = 3;
+        } else if (rank < 2) {
+            u32 f = cache_sketch_freq(cache, slot->hash);
+            if (!rank || f < freq) {
+                victim = index;
+                rank   = 1;
+                freq   = f;
+            }
+        }
+    }
+    CacheSlot *slot = &cache->slots[victim];
+    if (rank == 3 && (slot->file_id != valid->file_id || slot->mtime_ns != valid->mtime_ns ||
+                      slot->size != valid->size)) {
+        atomic_fetch_add_explicit(&h->generation, 1, memory_order_release);
+    }
+    if (slot->hash) {
+        cache_drop(cache, victim);
+    }
+
+    while (h->lists[CACHE_LIST_WINDOW].blocks + n > h->lists[CACHE_LIST_WINDOW].cap) {
+        cache_evict_window(cache);
+    }
+    if (h->free_count < n) {
+        pthread_mutex_unlock(&h->lock);
+        return false;
+    }
+
+    // fresh blocks, no reader can be looking at them
+    u32 first = cache_alloc(cache, n);
+    cache_fill(cache, first, 0, path, len);
+    cache_fill(cache, first, len, data, size);
+
+    u32 seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->hash     = hash;
+    slot->path_len = (u32)len;
+    slot->first    = first;
+    slot->nblocks  = n;
+    slot->length   = size;
+    slot->file_id  = valid->file_id;
+    slot->mtime_ns = valid->mtime_ns;
+    slot->size     = valid->size;
+    atomic_store_explicit(&slot->hits, hits, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+    cache_link(cache, victim, CACHE_LIST_WINDOW);
+
+    // popularity carried over from a snapshot counts towards admission
+    for (u64 i = 0; i < hits && i < CACHE_SKETCH_MAX; i++) {
+        cache_sketch_add(cache, hash);
+    }
+
+    pthread_mutex_unlock(&h->lock);
+    return true;
+}
+
+bool CachePut(Cache *cache, const char *path, const CacheValidator *valid, const char *data, u64 size, bool wait) {
+    if (!cache || !path || !valid || (!data && size)) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    return cache_store(cache, path, valid, data, size, 0, wait);
+}
+
+u64 CacheResize(Cache *cache, u64 size) {
+    if (!cache) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    CacheHeader *h = cache->header;
+    if (!h) {
+        return 0;
+    }
+
+    // never below what one biggest entry takes, never above what was mapped
+    u64 bs      = cache->config.block_size;
+    u64 largest = (cache->config.max_object + PATH_MAX + bs - 1) / bs;
+    u64 limit   = size / bs;
+    limit       = limit > largest ? limit : largest;
+    limit       = limit < h->block_count ? limit : h->block_count;
+
+    if (!cache_lock(cache, true)) {
+        return 0;
+    }
+    cache_replay(cache);
+
+    if (limit < h->block_limit) {
+        // entries with any block past new limit go, readers notice by sequence
+        for (u32 i = 0; i < h->slot_count; i++) {
+            CacheSlot *slot  = &cache->slots[i];
+            u32        block = slot->first;
+            for (u32 b = 0; slot->hash && b < slot->nblocks; b++) {
+                if (block >= limit) {
+                    cache_drop(cache, i);
+                    break;
+                }
+                block = atomic_load_explicit(&cache->next[block], memory_order_relaxed);
+            }
+        }
+
+        // free blocks past limit leave free list
+        u32 head  = CACHE_NONE;
+        u32 count = 0;
+        for (u32 block = h->free_head, next = 0; block != CACHE_NONE; block = next) {
+            next = atomic_load_explicit(&cache->next[block], memory_order_relaxed);
+            if (block < limit) {
+                atomic_store_explicit(&cache->next[block], head, memory_order_relaxed);
+                head = block;
+                count++;
+            }
+        }
+        h->free_head  = head;
+        h->free_count = count;
+
+        // pages past limit go back to kernel, in every process mapping region
+        u64   page  = cache->huge ? HUGE_PAGE_SIZE : (u64)sysconf(_SC_PAGESIZE);
+        char *end   = (char *)h + cache->map_size;
+        char *start = (char *)cache_align((u64)(uintptr_t)(cache->blocks + limit * bs), page);
+        if (start < end && -1 == madvise(start, (u64)(end - start), MADV_REMOVE)) {
+            LOG_SYS_ERROR("madvise() failed, cache memory not released");
+        }
+    } else {
+        // blocks coming back are zeroed pages, faulted in once used
+        for (u32 block = h->block_limit; block < limit; block++) {
+            atomic_store_explicit(&cache->next[block], h->free_head, memory_order_relaxed);
+            h->free_head = block;
+            h->free_count++;
+        }
+    }
+
+    h->block_limit = (u32)limit;
+    cache_set_caps(cache);
+
+    // lists shrink to their new caps, same way they would on an insert
+    CacheList *window    = &h->lists[CACHE_LIST_WINDOW];
+    CacheList *probation = &h->lists[CACHE_LIST_PROBATION];
+    CacheList *protected = &h->lists[CACHE_LIST_PROTECTED];
+    while (window->blocks > window->cap) {
+        cache_evict_window(cache);
+    }
+    while (probation->blocks + protected->blocks > h->main_cap) {
+        cache_drop(cache, probation->tail != CACHE_NONE ? probation->tail : protected->tail);
+    }
+    while (protected->blocks > protected->cap) {
+        u32 demoted = protected->tail;
+        cache_unlink(cache, demoted);
+        cache_link(cache, demoted, CACHE_LIST_PROBATION);
+    }
+
+    pthread_mutex_unlock(&h->lock);
+    return limit * bs;
+}
+
+u64 CacheGeneration(Cache *cache) {
+    if (!cache) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    return cache->header ? atomic_load_explicit(&cache->header->generation, memory_order_acquire) : 0;
+}
+
+Str *CacheRender(Cache *cache, u64 hits, u64 misses, Str *out) {
+    if (!cache || !out) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    CacheHeader *h = cache->header;
+    if (!h) {
+        return out;
+    }
+
+    // lock holder keeps changing these, a slightly stale view is fine
+    const char *policy = cache->config.policy == CACHE_POLICY_LRU ? "lru" : "tinylfu";
+    char        ratio[64];
+    snprintf(ratio, sizeof(ratio), "%.3f", hits + misses ? (double)hits / (double)(hits + misses) : 0.0);
+
+    StrWriteFmt(out, "cache_policy_{} 1\n", policy);
+    StrWriteFmt(out, "cache_{}_hit_ratio {}\n", policy, ratio);
+    StrWriteFmt(out, "cache_window_blocks {}\n", h->lists[CACHE_LIST_WINDOW].blocks);
+    StrWriteFmt(out, "cache_probation_blocks {}\n", h->lists[CACHE_LIST_PROBATION].blocks);
+    StrWriteFmt(out, "cache_protected_blocks {}\n", h->lists[CACHE_LIST_PROTECTED].blocks);
+    StrWriteFmt(out, "cache_free_blocks {}\n", (u64)h->free_count);
+    StrWriteFmt(out, "cache_limit_blocks {}\n", (u64)h->block_limit);
+    StrWriteFmt(out, "cache_hugepages {}\n", (u64)cache->huge);
+    StrWriteFmt(out, "cache_admitted {}\n", h->admitted);
+    StrWriteFmt(out, "cache_rejected {}\n", h->rejected);
+    StrWriteFmt(out, "cache_promoted {}\n", h->promoted);
+    StrWriteFmt(out, "cache_evicted {}\n", h->evicted);
+    StrWriteFmt(out, "cache_generation {}\n", atomic_load_explicit(&h->generation, memory_order_relaxed));
+
+    return out;
+}
+
+static int cache_hotter(const void *a, const void *b) {
+    u64 x = ((const CacheSnapshotEntry *)a)->record.hits;
+    u64 y = ((const CacheSnapshotEntry *)b)->record.hits;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static void cache_free_entries(CacheSnapshotEntry *entries, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        free(entries[i].path);
+    }
+    free(entries);
+}
+
+static bool cache_write_all(i32 fd, const void *data, u64 size) {
+    const char *p = data;
+    while (size) {
+        i64 n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p    += n;
+        size -= (u64)n;
+    }
+    return true;
+}
+
+static bool cache_read_all(i32 fd, void *data, u64 size, u64 offset) {
+    char *p = data;
+    while (size) {
+        i64 n = pread(fd, p, size, (off_t)offset);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p      += n;
+        size   -= (u64)n;
+        offset += (u64)n;
+    }
+    return true;
+}
+
+bool CacheSave(Cache *cache, const char *path, u32 max_entries) {
+    if (!cache || !path) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!cache->header) {
+        return true;
+    }
+
+    u32                 slots   = cache->header->slot_count;
+    CacheSnapshotEntry *entries = calloc(slots, sizeof(CacheSnapshotEntry));
+    if (!entries) {
+        LOG_ERROR("failed to allocate cache snapshot");
+        return false;
+    }
+
+    // workers may still be serving, every entry is taken under its seqlock
+    u32 count = 0;
+    for (u32 i = 0; i < slots; i++) {
+        CacheSlot copy;
+        u32       seq = 0;
+        if (!cache_read_slot(&cache->slots[i], &copy, &seq) || !copy.hash) {
+            continue;
+        }
+
+        char *key = malloc(copy.path_len + 1);
+        if (!key) {
+            break;
+        }
+        bool whole         = cache_copy(cache, copy.first, 0, key, copy.path_len);
+        key[copy.path_len] = 0;
+        if (!whole || !cache_unchanged(&cache->slots[i], seq)) {
+            free(key);
+            continue;
+        }
+
+        entries[count++] = (CacheSnapshotEntry) {
+            .record = {
+                .hits     = atomic_load_explicit(&cache->slots[i].hits, memory_order_relaxed),
+                .file_id  = copy.file_id,
+                .mtime_ns = copy.mtime_ns,
+                .size     = copy.size,
+                .path_len = copy.path_len,
+            },
+            .path = key,
+        };
+    }
+
+    qsort(entries, count, sizeof(CacheSnapshotEntry), cache_hotter);
+    count = count < max_entries ? count : max_entries;
+
+    // written aside and renamed over, a crash halfway leaves previous snapshot alone
+    char tmp[PATH_MAX];
+    int  n  = snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    i32  fd = -1;
+    if (n > 0 && (u64)n < sizeof(tmp)) {
+        fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (-1 == fd) {
+        LOG_SYS_ERROR("failed to create cache snapshot");
+        cache_free_entries(entries, slots);
+        return false;
+    }
+
+    CacheSnapshotHeader header = {.magic = CACHE_SNAPSHOT_MAGIC, .version = CACHE_SNAPSHOT_VERSION, .count = count};
+    bool                ok     = cache_write_all(fd, &header, sizeof(header));
+    for (u32 i = 0; ok && i < count; i++) {
+        ok = cache_write_all(fd, &entries[i].record, sizeof(CacheSnapshotRecord)) &&
+             cache_write_all(fd, entries[i].path, entries[i].record.path_len);
+    }
+    ok = ok && 0 == fsync(fd);
+    close(fd);
+    ok = ok && 0 == rename(tmp, path);
+
+    if (!ok) {
+        LOG_SYS_ERROR("failed to write cache snapshot");
+        unlink(tmp);
+    }
+
+    cache_free_entries(entries, slots);
+    return ok;
+}
+
+// read file of one snapshot entry into cache, when it's still there
+static bool cache_warm_entry(Cache *cache, CacheSnapshotEntry *entry) {
+    i32 fd = open(entry->path, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        return false;
+    }
+
+    struct stat st;
+    if (-1 == fstat(fd, &st) || !S_ISREG(st.st_mode) || (u64)st.st_size > cache->config.max_object) {
+        close(fd);
+        return false;
+    }
+
+    CacheValidator valid = {
+        .file_id  = ((u64)st.st_dev << 32) ^ (u64)st.st_ino,
+        .mtime_ns = (u64)st.st_mtim.tv_sec * NSEC_PER_SEC + (u64)st.st_mtim.tv_nsec,
+        .size     = (u64)st.st_size,
+    };
+
+    // popularity of a file that changed since says little about new content
+    bool same = valid.file_id == entry->record.file_id && valid.mtime_ns == entry->record.mtime_ns &&
+                valid.size == entry->record.size;
+
+    char *data = malloc(valid.size ? valid.size : 1);
+    bool  ok   = data && cache_read_all(fd, data, valid.size, 0) &&
+              cache_store(cache, entry->path, &valid, data, valid.size, same ? entry->record.hits : 0, true);
+
+    free(data);
+    close(fd);
+    return ok;
+}
+
+static void *cache_warm_main(void *arg) {
+    CacheWarmer *warmer = arg;
+    while (true) {
+        u32 i = atomic_fetch_add_explicit(&warmer->next, 1, memory_order_relaxed);
+        if (i >= warmer->count) {
+            return NULL;
+        }
+        if (cache_warm_entry(warmer->cache, &warmer->entries[i])) {
+            atomic_fetch_add_explicit(&warmer->loaded, 1, memory_order_relaxed);
+        }
+    }
+}
+
+i64 CacheWarm(Cache *cache, const char *path, u32 threads) {
+    if (!cache || !path) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!cache->header) {
+        return 0;
+    }
+
+    i32 fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        LOG_SYS_ERROR("failed to open cache snapshot");
+        return -1;
+    }
+
+    CacheSnapshotHeader header = {0};
+    if (!cache_read_all(fd, &header, sizeof(header), 0) || header.magic != CACHE_SNAPSHOT_MAGIC ||
+        header.version != CACHE_SNAPSHOT_VERSION) {
+        LOG_ERROR("ignoring unrecognized cache snapshot");
+        close(fd);
+        return -1;
+    }
+
+    CacheWarmer warmer = {0};
+    warmer.cache       = cache;
+    warmer.entries     = calloc(header.count ? header.count : 1, sizeof(CacheSnapshotEntry));
+    if (!warmer.entries) {
+        close(fd);
+        return -1;
+    }
+
+    u64 offset = sizeof(header);
+    for (u32 i = 0; i < header.count; i++) {
+        CacheSnapshotEntry *entry = &warmer.entries[i];
+        if (!cache_read_all(fd, &entry->record, sizeof(entry->record), offset) || entry->record.path_len >= PATH_MAX) {
+            break;
+        }
+        offset += sizeof(entry->record);
+
+        entry->path = malloc(entry->record.path_len + 1);
+        if (!entry->path || !cache_read_all(fd, entry->path, entry->record.path_len, offset)) {
+            free(entry->path);
+            entry->path = NULL;
+            break;
+        }
+        entry->path[entry->record.path_len] = 0;
+        offset                              += entry->record.path_len;
+        warmer.count++;
+    }
+    close(fd);
+
+    // hottest first, so whatever is served before warming finishes most likely hits
+    threads            = threads ? threads : 1;
+    pthread_t *workers = calloc(threads, sizeof(pthread_t));
+    u32        started = 0;
+    while (workers && started < threads && !pthread_create(&workers[started], NULL, cache_warm_main, &warmer)) {
+        started++;
+    }
+    if (!started) {
+        cache_warm_main(&warmer);
+    }
+    for (u32 i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+    cache_free_entries(warmer.entries, warmer.count);
+    return atomic_load_explicit(&warmer.loaded, memory_order_relaxed);
+}
@@ -0,0 +1,134 @@
+/// file      : cgroup.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Control group (v2) this process runs in.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <Misra.h>
+#include <Beam/Cgroup.h>
+
+// read a whole interface file, zero-terminated
+static bool cgroup_read(const char *dir, const char *name, char *buf, u64 size) {
+    char path[4352];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    i32 fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        return false;
+    }
+
+    i64 n = read(fd, buf, size - 1);
+    close(fd);
+    if (n <= 0) {
+        return false;
+    }
+    buf[n] = 0;
+    return true;
+}
+
+// "0-3,8,10-11" style cpu list
+static u32 cgroup_count_cpus(const char *list) {
+    u32         count = 0;
+    const char *p     = list;
+    while (*p >= '0' && *p <= '9') {
+        char *end   = NULL;
+        u64   first = strtoull(p, &end, 10);
+        u64   last  = first;
+        if (*end == '-') {
+            last = strtoull(end + 1, &end, 10);
+        }
+        count += last >= first ? (u32)(last - first + 1) : 0;
+        p      = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+// lower of a limit so far and one read from a "max" or number file, 0 meaning none
+static u64 cgroup_lower(u64 limit, const char *dir, const char *name) {
+    char buf[64];
+    if (!cgroup_read(dir, name, buf, sizeof(buf)) || !strncmp(buf, "max", 3)) {
+        return limit;
+    }
+    u64 value = strtoull(buf, NULL, 10);
+    return !limit || value < limit ? value : limit;
+}
+
+char *CgroupFind(char *dir, u64 size) {
+    if (!dir || !size) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    FILE *f = fopen("/proc/self/cgroup", "re");
+    if (!f) {
+        return NULL;
+    }
+
+    // v2 membership is the one line with hierarchy id 0 and no controllers, "0::/path"
+    char line[4096];
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), f)) {
+        if (!strncmp(line, "0::", 3)) {
+            line[strcspn(line, "\n")] = 0;
+            found = (u64)snprintf(dir, size, "%s%s", CGROUP_ROOT, line + 3) < size;
+        }
+    }
+    fclose(f);
+    if (!found) {
+        return NULL;
+    }
+
+    // a v1 host, or a container that only sees its own cgroup mounted at root
+    char probe[4352];
+    snprintf(probe, sizeof(probe), "%s/cgroup.controllers", dir);
+    if (access(probe, F_OK)) {
+        snprintf(dir, size, "%s", CGROUP_ROOT);
+        snprintf(probe, sizeof(probe), "%s/cgroup.controllers", dir);
+        if (access(probe, F_OK)) {
+            return NULL;
+        }
+    }
+
+    return dir;
+}
+
+CgroupLimits *CgroupReadLimits(CgroupLimits *limits, const char *dir) {
+    if (!limits || !dir) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    *limits = CgroupLimitsInit();
+
+    // effective cpuset already accounts for every ancestor
+    char buf[4096];
+    if (cgroup_read(dir, "cpuset.cpus.effective", buf, sizeof(buf))) {
+        limits->cpus = cgroup_count_cpus(buf);
+    }
+
+    // quotas and memory limits of every ancestor apply as well, walk up to root
+    char path[4352];
+    snprintf(path, sizeof(path), "%s", dir);
+    while (true) {
+        u64 quota  = 0;
+        u64 period = 0;
+        if (cgroup_read(path, "cpu.max", buf, sizeof(buf)) && 2 == sscanf(buf, "%lu %lu", &quota, &period) &&
+            period) {
+            u32 cpus     = (u32)((quota + period - 1) / period);
+            cpus         = cpus ? cpus : 1;
+            limits->cpus = !limits->cpus || cpus < limits->cpus ? cpus : limits->cpus;
+        }
+        limits->memory = cgroup_lower(limits->memory, path, "memory.max");
+        limits->memory = cgroup_lower(limits->memory, path, "memory.high");
+
+        char *slash = strrchr(path, '/');
+        if (strlen(path) <= strlen(CGROUP_ROOT) || !slash) {
+            break;
+        }
+        *slash = 0;
+    }
+
+    return limits;
+}
@@ -0,0 +1,40 @@
+/// file      : config.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Runtime configuration knobs for beam.
+
+#include <errno.h>
+
+#include <Misra.h>
+#include <Beam/Config.h>
+
+u64 ConfigGetU64(const char *name, u64 fallback) {
+    if (!name) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    const char *value = getenv(name);
+    if (!value || !*value) {
+        return fallback;
+    }
+
+    char *end = NULL;
+    errno     = 0;
+    u64 v     = strtoull(value, &end, 0);
+    if (errno || *end) {
+        LOG_ERROR("ignoring malformed value for {} : '{}'", name, value);
+        return fallback;
+    }
+
+    return v;
+}
+
+const char *ConfigGetZstr(const char *name, const char *fallback) {
+    if (!name) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    const char *value = getenv(name);
+    return value && *value ? value : fallback;
+}
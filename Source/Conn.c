@@ -0,0 +1,874 @@
+/// file      : conn.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Client connections : input buffer, output queue and per-connection accounting.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/file.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <linux/errqueue.h>
+
+#include <Misra.h>
+#include <Beam/Clock.h>
+#include <Beam/Conn.h>
+#include <Beam/LoadShed.h>
+#include <Beam/Ring.h>
+
+#define CONN_QUEUE_MIN_CAPACITY 8
+
+// number of in-memory chunks written with one sendmsg()
+#define CONN_GATHER_MAX (IOV_MAX < 64 ? IOV_MAX : 64)
+
+#define CONN_COUNT(conn, counter) ((conn)->stats ? (void)(conn)->stats->counter++ : (void)0)
+
+struct ConnLent {
+    Str       buf;    // lent bytes
+    u32       first;  // sequence number of first send from buffer
+    u32       last;   // sequence number of last send from buffer
+    u32       sent;   // sends from buffer
+    u32       done;   // sends from buffer kernel reported complete
+    bool      queued; // chunk still has bytes to send from buffer
+    ConnLent *next;
+};
+
+struct ConnOrphan {
+    i32         fd;    // socket of closed connection, out of epoll
+    ConnLent   *lent;  // buffers kernel may still be sending from
+    u64         since; // when connection was closed
+    Stats      *stats;
+    ConnOrphan *next;
+};
+
+static void conn_stream_deinit(ConnStream *stream) {
+    // buffers being filled belong to their read jobs, whoever takes those back returns them
+    for (u32 b = 0; b < 2; b++) {
+        if (stream->buf[b] && !stream->busy[b]) {
+            BufPoolPut(stream->pool, stream->buf[b]);
+        }
+    }
+    free(stream);
+}
+
+static void conn_chunk_deinit(ConnChunk *chunk) {
+    if (chunk->kind == CONN_CHUNK_MEMORY) {
+        StrDeinit(&chunk->buf);
+        if (chunk->lent) {
+            chunk->lent->queued = false;
+        }
+    } else if (chunk->kind == CONN_CHUNK_DIRECT && chunk->stream) {
+        conn_stream_deinit(chunk->stream);
+    }
+
+    // read-once content shouldn't linger in page cache pushing hot content out, once nobody else streams it
+    if (chunk->kind == CONN_CHUNK_FILE && chunk->dontneed && chunk->offset > chunk->start &&
+        0 == flock(chunk->fd, LOCK_EX | LOCK_NB)) {
+        posix_fadvise(chunk->fd, (off_t)chunk->start, (off_t)(chunk->offset - chunk->start), POSIX_FADV_DONTNEED);
+    }
+
+    if ((chunk->kind == CONN_CHUNK_FILE || chunk->kind == CONN_CHUNK_DIRECT) && chunk->fd >= 0) {
+        close(chunk->fd);
+    }
+    memset(chunk, 0, sizeof(*chunk));
+}
+
+// switch file chunk over to O_DIRECT streaming, leaves chunk untouched on failure
+static bool conn_stream_open(Conn *conn, ConnChunk *chunk) {
+    if (BufPoolAvailable(conn->direct_pool) < 2) {
+        return false;
+    }
+
+    // sendfile() does not mix with O_DIRECT, so only flip it once buffers are there
+    i32 flags = fcntl(chunk->fd, F_GETFL);
+    if (-1 == flags) {
+        return false;
+    }
+
+    ConnStream *stream = calloc(1, sizeof(ConnStream));
+    if (!stream) {
+        return false;
+    }
+
+    // filesystems without direct I/O support refuse the flag
+    if (-1 == fcntl(chunk->fd, F_SETFL, flags | O_DIRECT)) {
+        free(stream);
+        return false;
+    }
+
+    stream->pool   = conn->direct_pool;
+    stream->buf[0] = BufPoolGet(stream->pool);
+    stream->buf[1] = BufPoolGet(stream->pool);
+    stream->next   = chunk->offset & ~(u64)(CONN_DIRECT_ALIGN - 1);
+
+    chunk->kind   = CONN_CHUNK_DIRECT;
+    chunk->stream = stream;
+    return true;
+}
+
+// send from buffer holding next bytes of a DIRECT chunk
+static i64 conn_stream_send(Conn *conn, ConnChunk *chunk, u64 want) {
+    ConnStream *stream = chunk->stream;
+    u32         b      = stream->cur;
+
+    if (stream->error) {
+        errno = stream->error;
+        LOG_SYS_ERROR("failed to read file being sent");
+        return -1;
+    }
+
+    if (stream->busy[b] || !stream->len[b]) {
+        conn->io_wait = true;
+        return 0;
+    }
+
+    // a short read that does not reach end of chunk means file shrank
+    u64 stop = stream->pos[b] + stream->pool->buffer_size;
+    stop     = stop < chunk->end ? stop : chunk->end;
+    if (stream->pos[b] + stream->len[b] < stop) {
+        LOG_ERROR("file truncated while being sent");
+        return -1;
+    }
+
+    u64 avail = stop - chunk->offset;
+    return send(conn->fd, stream->buf[b] + (chunk->offset - stream->pos[b]), want < avail ? want : avail, MSG_NOSIGNAL);
+}
+
+// hand buffer back for refilling once everything in it was sent
+static void conn_stream_advance(ConnChunk *chunk) {
+    ConnStream *stream = chunk->stream;
+    u32         b      = stream->cur;
+    if (chunk->offset >= stream->pos[b] + stream->len[b]) {
+        stream->len[b] = 0;
+        stream->cur    = b ^ 1;
+    }
+}
+
+static ConnChunk *conn_queue_front(ConnQueue *q) {
+    return q->count ? &q->chunks[q->head] : NULL;
+}
+
+// would sending `want` bytes of file chunk have to wait for disk?
+static bool conn_file_cached(ConnChunk *chunk, u64 want) {
+    u64 last = chunk->offset + want - 1;
+    if (last < chunk->cached) {
+        return true;
+    }
+
+    // probe first and last byte, readahead fills whatever lies between them
+    u64 probes[2] = {chunk->offset, last};
+    for (u32 i = 0; i < 2; i++) {
+        char         byte = 0;
+        struct iovec iov  = {.iov_base = &byte, .iov_len = 1};
+        if (-1 == preadv2(chunk->fd, &iov, 1, (off_t)probes[i], RWF_NOWAIT)) {
+            if (errno == EAGAIN) {
+                return false;
+            }
+
+            // filesystem can't tell, don't ask again
+            chunk->cached = chunk->end;
+            return true;
+        }
+    }
+
+    return true;
+}
+
+static ConnChunk *conn_queue_back(ConnQueue *q) {
+    return q->count ? &q->chunks[(q->head + q->count - 1) & (q->capacity - 1)] : NULL;
+}
+
+static void conn_queue_pop(ConnQueue *q) {
+    conn_chunk_deinit(&q->chunks[q->head]);
+    q->head = (q->head + 1) & (q->capacity - 1);
+    q->count--;
+}
+
+static ConnChunk *conn_queue_push(Conn *conn) {
+    ConnQueue *q = &conn->out;
+
+    if (q->count == q->capacity) {
+        u32        capacity = q->capacity ? q->capacity * 2 : CONN_QUEUE_MIN_CAPACITY;
+        ConnChunk *chunks   = calloc(capacity, sizeof(ConnChunk));
+        if (!chunks) {
+            LOG_ERROR("failed to grow output queue");
+            return NULL;
+        }
+
+        // unwrap ring into new storage
+        for (u32 i = 0; i < q->count; i++) {
+            chunks[i] = q->chunks[(q->head + i) & (q->capacity - 1)];
+        }
+        free(q->chunks);
+
+        q->chunks   = chunks;
+        q->head     = 0;
+        q->capacity = capacity;
+    }
+
+    // a new burst of output starts, measure its throughput from now
+    if (!q->count) {
+        conn->download = DataRateMeterInit(ClockNowNs());
+    }
+
+    ConnChunk *chunk = &q->chunks[(q->head + q->count) & (q->capacity - 1)];
+    memset(chunk, 0, sizeof(*chunk));
+    chunk->fd = -1;
+    q->count++;
+
+    return chunk;
+}
+
+static bool conn_chunk_in_memory(ConnChunk *chunk) {
+    return chunk->kind == CONN_CHUNK_STATIC || chunk->kind == CONN_CHUNK_MEMORY;
+}
+
+// hand buffers of first `n` chunks over to lent records, stops at first one that can't be allocated
+static bool conn_lend(Conn *conn, u32 n) {
+    ConnQueue *q = &conn->out;
+
+    for (u32 i = 0; i < n; i++) {
+        ConnChunk *chunk = &q->chunks[(q->head + i) & (q->capacity - 1)];
+        if (chunk->kind != CONN_CHUNK_MEMORY || chunk->lent) {
+            continue;
+        }
+
+        ConnLent *lent = calloc(1, sizeof(ConnLent));
+        if (!lent) {
+            return false;
+        }
+
+        // data pointer of chunk stays valid, only ownership moves
+        lent->buf    = chunk->buf;
+        lent->queued = true;
+        lent->next   = conn->lent;
+        conn->lent   = lent;
+        chunk->buf   = StrInit();
+        chunk->lent  = lent;
+    }
+
+    return true;
+}
+
+// note zerocopy send `seq` against buffers of chunks its `n` bytes came from
+static void conn_lent_record(Conn *conn, u64 n, u32 seq) {
+    ConnQueue *q = &conn->out;
+
+    for (u32 i = 0; i < q->count && n; i++) {
+        ConnChunk *chunk = &q->chunks[(q->head + i) & (q->capacity - 1)];
+        u64        left  = chunk->end - chunk->offset;
+        n               -= left < n ? left : n;
+
+        ConnLent *lent = chunk->lent;
+        if (lent) {
+            lent->first = lent->sent ? lent->first : seq;
+            lent->last  = seq;
+            lent->sent++;
+        }
+    }
+}
+
+// kernel is done with sends `lo` to `hi`, sequence numbers wrap around
+static void conn_lent_complete(ConnLent *list, u32 lo, u32 hi) {
+    for (ConnLent *lent = list; lent; lent = lent->next) {
+        if (!lent->sent) {
+            continue;
+        }
+
+        u32 from = (i32)(lo - lent->first) > 0 ? lo : lent->first;
+        u32 to   = (i32)(hi - lent->last) < 0 ? hi : lent->last;
+        if ((i32)(to - from) >= 0) {
+            lent->done += to - from + 1;
+        }
+    }
+}
+
+// free buffers neither queued nor in use by kernel
+static void conn_lent_collect(ConnLent **list) {
+    for (ConnLent **link = list; *link;) {
+        ConnLent *lent = *link;
+        if (lent->queued || lent->done < lent->sent) {
+            link = &lent->next;
+            continue;
+        }
+
+        *link = lent->next;
+        StrDeinit(&lent->buf);
+        free(lent);
+    }
+}
+
+// give up on buffers kernel may still send from, only bookkeeping is freed
+static void conn_lent_abandon(ConnLent **list, Stats *stats) {
+    while (*list) {
+        ConnLent *lent = *list;
+        *list          = lent->next;
+        if (stats) {
+            stats->zerocopy_abandoned++;
+        }
+        free(lent);
+    }
+}
+
+// take zerocopy completions off error queue of `fd` into `list`
+static i64 conn_reap_errqueue(i32 fd, ConnLent *list, Stats *stats) {
+    i64 taken = 0;
+    while (true) {
+        char          control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+        struct msghdr msg = {.msg_control = control, .msg_controllen = sizeof(control)};
+
+        if (-1 == recvmsg(fd, &msg, MSG_ERRQUEUE)) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return -1;
+        }
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            bool v4 = cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR;
+            bool v6 = cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR;
+            if (!v4 && !v6) {
+                continue;
+            }
+
+            struct sock_extended_err *err = (struct sock_extended_err *)CMSG_DATA(cmsg);
+            if (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+
+            // range of sends done, merged by kernel when it can
+            conn_lent_complete(list, err->ee_info, err->ee_data);
+            if ((err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) && stats) {
+                stats->zerocopy_copied++;
+            }
+            taken++;
+        }
+    }
+
+    return taken;
+}
+
+// send consecutive in-memory chunks from front of queue with a single syscall
+static i64 conn_send_gathered(Conn *conn, u64 budget) {
+    ConnQueue   *q       = &conn->out;
+    struct iovec iov[CONN_GATHER_MAX];
+    u32          n       = 0;
+    u64          largest = 0;
+
+    for (u32 i = 0; i < q->count && n < CONN_GATHER_MAX && budget; i++) {
+        ConnChunk *chunk = &q->chunks[(q->head + i) & (q->capacity - 1)];
+        if (!conn_chunk_in_memory(chunk)) {
+            break;
+        }
+
+        u64 left = chunk->end - chunk->offset;
+        u64 take = left < budget ? left : budget;
+
+        iov[n].iov_base  = (void *)(chunk->data + chunk->offset);
+        iov[n].iov_len   = take;
+        budget          -= take;
+        largest          = take > largest ? take : largest;
+        n++;
+    }
+
+    // a file body or more output follows : let kernel fill packets across both
+    struct msghdr msg   = {.msg_iov = iov, .msg_iovlen = n};
+    i32           flags = MSG_NOSIGNAL | (n < q->count ? MSG_MORE : 0);
+
+    // pinning pages and waiting for completion only pays off for big sends
+    if (conn->zerocopy_min && largest >= conn->zerocopy_min && conn_lend(conn, n)) {
+        i64 sent = sendmsg(conn->fd, &msg, flags | MSG_ZEROCOPY);
+        if (sent > 0) {
+            conn_lent_record(conn, (u64)sent, conn->zerocopy_next++);
+            CONN_COUNT(conn, zerocopy_sends);
+            return sent;
+        }
+
+        // out of memory for completion notifications : a copy still goes out
+        if (sent != -1 || errno != ENOBUFS) {
+            return sent;
+        }
+    }
+
+    return sendmsg(conn->fd, &msg, flags);
+}
+
+// account `n` bytes sent from front of queue, possibly spanning several chunks
+static void conn_queue_advance(ConnQueue *q, u64 n) {
+    while (n) {
+        ConnChunk *chunk = &q->chunks[q->head];
+        u64        left  = chunk->end - chunk->offset;
+        u64        take  = left < n ? left : n;
+
+        chunk->offset += take;
+        n             -= take;
+        if (chunk->offset == chunk->end) {
+            conn_queue_pop(q);
+        }
+    }
+}
+
+Conn *ConnOpen(Conn *conn, i32 fd, const struct sockaddr_storage *addr, u64 input_size, u64 now) {
+    if (!conn || fd < 0 || !addr || !input_size) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (conn->in.size < input_size + 1) {
+        RingDeinit(&conn->in);
+        if (!RingCreate(&conn->in, input_size)) {
+            return NULL;
+        }
+    }
+    conn->in.head   = 0;
+    conn->in.length = 0;
+
+    conn->fd                = fd;
+    conn->addr              = *addr;
+    conn->limit_slot        = NULL;
+    conn->client_key        = 0;
+    conn->discard           = 0;
+    conn->sojourn           = 0;
+    conn->upload            = DataRateMeterInit(now);
+    conn->download          = DataRateMeterInit(now);
+    conn->burst_sent        = 0;
+    conn->throttle_tat      = 0;
+    conn->last_active       = now;
+    conn->readable          = true;
+    conn->writable          = true;
+    conn->peer_closed       = false;
+    conn->close_after_write = false;
+    conn->offload_io        = false;
+    conn->io_wait           = false;
+    conn->direct_pool       = NULL;
+    conn->direct_min        = 0;
+    conn->prefetch          = NULL;
+    conn->hot_cache         = NULL;
+    conn->zerocopy_min      = 0;
+    conn->zerocopy_next     = 0;
+    conn->lingering         = false;
+    conn->stats             = NULL;
+    conn->run_list          = CONN_LIST_NONE;
+    conn->backlogged        = false;
+
+    return conn;
+}
+
+void ConnClose(Conn *conn, bool reset, ConnOrphan **orphans, u64 now) {
+    if (!conn) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    while (conn->out.count) {
+        conn_queue_pop(&conn->out);
+    }
+    conn_lent_collect(&conn->lent);
+
+    // packets already handed to qdisc or NIC keep pointing at lent pages whatever happens to the socket, so buffers
+    // stay until kernel says so, which it does on the error queue of this very socket
+    ConnOrphan *orphan = conn->lent && orphans && conn->fd >= 0 ? calloc(1, sizeof(ConnOrphan)) : NULL;
+    if (orphan) {
+        if (reset) {
+            // aborts connection and drops unsent data, but unlike close() keeps socket to hear completions on
+            connect(conn->fd, &(struct sockaddr) {.sa_family = AF_UNSPEC}, sizeof(struct sockaddr));
+        } else {
+            shutdown(conn->fd, SHUT_RDWR);
+        }
+
+        orphan->fd    = conn->fd;
+        orphan->lent  = conn->lent;
+        orphan->since = now;
+        orphan->stats = conn->stats;
+        orphan->next  = *orphans;
+        *orphans      = orphan;
+        conn->fd      = -1;
+        conn->lent    = NULL;
+    }
+
+    if (conn->fd >= 0) {
+        if (reset || conn->lent) {
+            struct linger linger = {.l_onoff = 1, .l_linger = 0};
+            setsockopt(conn->fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+        }
+        close(conn->fd);
+    }
+    conn->fd = -1;
+
+    // nowhere to wait for them : leaked, handing them out again could send someone else's data to this peer
+    conn_lent_abandon(&conn->lent, conn->stats);
+
+    conn->out.bytes = 0;
+    conn->in.head   = 0;
+    conn->in.length = 0;
+}
+
+void ConnDeinit(Conn *conn) {
+    if (!conn) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    ConnClose(conn, false, NULL, 0);
+    RingDeinit(&conn->in);
+    free(conn->out.chunks);
+    memset(&conn->out, 0, sizeof(conn->out));
+}
+
+i64 ConnRead(Conn *conn, u64 now) {
+    if (!conn) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    i64 total = 0;
+    while (conn->readable && RingSpace(&conn->in)) {
+        bool fresh = !conn->in.length && !conn->discard;
+
+        char          control[CMSG_SPACE(sizeof(struct timespec))];
+        struct iovec  iov = {
+            .iov_base = RingTail(&conn->in),
+            .iov_len  = RingSpace(&conn->in)
+        };
+        struct msghdr msg = {
+            .msg_iov        = &iov,
+            .msg_iovlen     = 1,
+            .msg_control    = control,
+            .msg_controllen = sizeof(control)
+        };
+
+        CONN_COUNT(conn, read_calls);
+        i64 n = recvmsg(conn->fd, &msg, 0);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                conn->readable = false;
+                break;
+            }
+            return -1;
+        }
+
+        if (!n) {
+            conn->readable    = false;
+            conn->peer_closed = true;
+            break;
+        }
+
+        // first bytes of a new request : start measuring it
+        if (fresh) {
+            conn->sojourn = LoadShedSojourn(&msg);
+            conn->upload  = DataRateMeterInit(now);
+        }
+
+        RingCommit(&conn->in, (u64)n);
+        *RingTail(&conn->in)  = 0;
+        total                += n;
+    }
+
+    if (total) {
+        conn->last_active = now;
+    }
+
+    return total;
+}
+
+void ConnConsume(Conn *conn, u64 n) {
+    if (!conn || n > conn->in.length) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    // wrapped bytes are still contiguous in the mirror, nothing to move
+    RingConsume(&conn->in, n);
+}
+
+i64 ConnWrite(Conn *conn, u64 budget) {
+    if (!conn) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    i64 total = 0;
+    while (conn->writable && budget) {
+        ConnChunk *chunk = conn_queue_front(&conn->out);
+        if (!chunk) {
+            break;
+        }
+
+        u64 left = chunk->end - chunk->offset;
+        u64 want = left < budget ? left : budget;
+        i64 n    = 0;
+
+        CONN_COUNT(conn, write_calls);
+        if (chunk->kind == CONN_CHUNK_DIRECT) {
+            n = conn_stream_send(conn, chunk, want);
+            if (conn->io_wait) {
+                break;
+            }
+        } else if (chunk->kind == CONN_CHUNK_FILE) {
+            if (conn->offload_io && !conn_file_cached(chunk, want)) {
+                conn->io_wait = true;
+                break;
+            }
+
+            off_t offset = (off_t)chunk->offset;
+            n            = sendfile(conn->fd, chunk->fd, &offset, want);
+        } else {
+            n = conn_send_gathered(conn, budget);
+        }
+
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                conn->writable = false;
+                break;
+            }
+            return -1;
+        }
+
+        if (!n) {
+            // only a file truncated under us makes no progress
+            LOG_ERROR("file truncated while being sent");
+            return -1;
+        }
+
+        conn->out.bytes -= (u64)n;
+        budget          -= (u64)n;
+        total           += n;
+
+        if (conn_chunk_in_memory(chunk)) {
+            conn_queue_advance(&conn->out, (u64)n);
+            continue;
+        }
+
+        chunk->offset += (u64)n;
+        if (chunk->offset == chunk->end) {
+            conn_queue_pop(&conn->out);
+        } else if (chunk->kind == CONN_CHUNK_DIRECT) {
+            conn_stream_advance(chunk);
+        }
+    }
+
+    if (conn->lent) {
+        conn_lent_collect(&conn->lent);
+    }
+
+    return total;
+}
+
+i64 ConnReapZerocopy(Conn *conn) {
+    if (!conn) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    i64 taken = conn->fd >= 0 ? conn_reap_errqueue(conn->fd, conn->lent, conn->stats) : 0;
+    if (taken < 0) {
+        return -1;
+    }
+
+    conn_lent_collect(&conn->lent);
+    return taken;
+}
+
+u32 ConnOrphansReap(ConnOrphan **orphans, u64 now, u64 timeout_ns) {
+    if (!orphans) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    u32 left = 0;
+    for (ConnOrphan **link = orphans; *link;) {
+        ConnOrphan *orphan = *link;
+        if (conn_reap_errqueue(orphan->fd, orphan->lent, orphan->stats) >= 0) {
+            conn_lent_collect(&orphan->lent);
+        }
+
+        // waited long enough, or completions can't come anymore : socket goes, whatever is still lent stays lent
+        if (orphan->lent && now - orphan->since < timeout_ns) {
+            link = &orphan->next;
+            left++;
+            continue;
+        }
+
+        conn_lent_abandon(&orphan->lent, orphan->stats);
+        close(orphan->fd);
+        *link = orphan->next;
+        free(orphan);
+    }
+
+    return left;
+}
+
+bool ConnLending(Conn *conn) {
+    if (!conn) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    for (ConnLent *lent = conn->lent; lent; lent = lent->next) {
+        if (lent->done < lent->sent) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+ConnChunk *ConnFront(Conn *conn) {
+    if (!conn) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    return conn_queue_front(&conn->out);
+}
+
+bool ConnQueueStatic(Conn *conn, const char *data, u64 size) {
+    if (!conn || (!data && size)) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!size) {
+        return true;
+    }
+
+    ConnChunk *chunk = conn_queue_push(conn);
+    if (!chunk) {
+        return false;
+    }
+
+    chunk->kind      = CONN_CHUNK_STATIC;
+    chunk->data      = data;
+    chunk->end       = size;
+    conn->out.bytes += size;
+
+    return true;
+}
+
+bool ConnQueueStr(Conn *conn, Str *s) {
+    if (!conn || !s) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!s->length) {
+        StrDeinit(s);
+        return true;
+    }
+
+    ConnChunk *chunk = conn_queue_push(conn);
+    if (!chunk) {
+        StrDeinit(s);
+        return false;
+    }
+
+    chunk->kind      = CONN_CHUNK_MEMORY;
+    chunk->buf       = *s;
+    chunk->data      = chunk->buf.data;
+    chunk->end       = chunk->buf.length;
+    conn->out.bytes += chunk->end;
+    *s               = StrInit();
+
+    return true;
+}
+
+bool ConnQueueFile(Conn *conn, i32 fd, u64 offset, u64 length) {
+    if (!conn || fd < 0) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!length) {
+        close(fd);
+        return true;
+    }
+
+    ConnChunk *chunk = conn_queue_push(conn);
+    if (!chunk) {
+        close(fd);
+        return false;
+    }
+
+    chunk->kind      = CONN_CHUNK_FILE;
+    chunk->fd        = fd;
+    chunk->offset    = offset;
+    chunk->start     = offset;
+    chunk->end       = offset + length;
+    conn->out.bytes += length;
+
+    if (conn->direct_pool && conn->direct_min && length >= conn->direct_min) {
+        conn_stream_open(conn, chunk);
+    }
+
+    return true;
+}
+
+bool ConnQueueResponse(Conn *conn, HttpResponse *response) {
+    if (!conn || !response) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    Str head = StrInit();
+    if (!HttpResponseRender(response, &head)) {
+        StrDeinit(&head);
+        return false;
+    }
+
+    if (response->close) {
+        conn->close_after_write = true;
+    }
+
+    if (!ConnQueueStr(conn, &head)) {
+        return false;
+    }
+
+    if (response->file_fd < 0) {
+        return true;
+    }
+
+    i32 fd            = response->file_fd;
+    response->file_fd = -1;
+    if (!ConnQueueFile(conn, fd, response->file_offset, response->file_length)) {
+        return false;
+    }
+
+    // empty ranges queue nothing, and streams around page cache need no advice
+    ConnChunk *chunk = conn_queue_back(&conn->out);
+    if (conn->prefetch && response->file_length && chunk->kind == CONN_CHUNK_FILE) {
+        PrefetchAdvice advice = PrefetchAdvise(
+            conn->prefetch,
+            chunk->fd,
+            response->file_id,
+            response->file_size,
+            chunk->start,
+            chunk->end - chunk->start
+        );
+        chunk->readahead = advice.window;
+
+        // every reader holds a shared lock, whoever can take it exclusive when done was the last
+        chunk->dontneed = advice.dontneed && 0 == flock(chunk->fd, LOCK_SH | LOCK_NB);
+
+        // without I/O pool sending blocks anyway, kernel may as well get started right away
+        if (!conn->offload_io && advice.window) {
+            posix_fadvise(chunk->fd, (off_t)chunk->start, (off_t)advice.window, POSIX_FADV_WILLNEED);
+        }
+    }
+
+    return true;
+}
+
+bool ConnQueueCanned(Conn *conn, HttpResponseCode code) {
+    if (!conn) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    u64         size = 0;
+    const char *data = HttpCannedResponse(code, &size);
+    if (!data) {
+        LOG_ERROR("no pre-rendered response for given code");
+        return false;
+    }
+
+    conn->close_after_write = true;
+    return ConnQueueStatic(conn, data, size);
+}
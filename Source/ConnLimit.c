@@ -0,0 +1,225 @@
+/// file      : connlimit.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Per-client cap on simultaneous connections, checked right after accept().
+
+#include <stdatomic.h>
+
+#include <Misra.h>
+#include <Beam/Addr.h>
+#include <Beam/ConnLimit.h>
+#include <Beam/Shm.h>
+
+#define CONN_LIMIT_COUNT_MASK  0xffffull
+#define CONN_LIMIT_TAG_MASK    (~CONN_LIMIT_COUNT_MASK)
+#define CONN_LIMIT_PROBE_LIMIT 16
+#define CONN_LIMIT_RETRIES     4
+
+///
+/// A word of 0 was never used. Once used, the tag stays behind even when the
+/// count drops to zero, so a client can never live past the first 0 word of its
+/// probe window. Slots with a zero count are free to be recycled.
+///
+/// Two racing accepts from the same new client may claim two different slots,
+/// letting that client briefly have up to twice its limit. That is acceptable.
+///
+struct ConnLimitSlot {
+    _Atomic u64 word;
+};
+
+ConnLimiter *ConnLimiterInit(ConnLimiter *limiter, const ConnLimitConfig *config) {
+    if (!limiter || !config) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!config->table_slots || (config->table_slots & (config->table_slots - 1))) {
+        LOG_ERROR("connection limit table size must be a power of two");
+        return NULL;
+    }
+
+    if (config->max_per_client > CONN_LIMIT_COUNT_MASK) {
+        LOG_ERROR("connection limit cannot exceed {}", CONN_LIMIT_COUNT_MASK);
+        return NULL;
+    }
+
+    memset(limiter, 0, sizeof(*limiter));
+    limiter->config = *config;
+
+    if (!config->max_per_client) {
+        return limiter;
+    }
+
+    u64 size       = (u64)config->table_slots * sizeof(ConnLimitSlot);
+    limiter->slots = config->shared ? ShmAlloc(size) : calloc(1, size);
+    if (!limiter->slots) {
+        LOG_ERROR("failed to allocate connection limit table");
+        return NULL;
+    }
+
+    if (config->holders) {
+        u64 held      = (u64)config->holders * config->table_slots * sizeof(_Atomic(u16));
+        limiter->held = config->shared ? ShmAlloc(held) : calloc(1, held);
+        if (!limiter->held) {
+            LOG_ERROR("failed to allocate connection limit table");
+            ConnLimiterDeinit(limiter);
+            return NULL;
+        }
+    }
+
+    return limiter;
+}
+
+void ConnLimiterDeinit(ConnLimiter *limiter) {
+    if (!limiter) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    u64 held = (u64)limiter->config.holders * limiter->config.table_slots * sizeof(_Atomic(u16));
+    if (limiter->config.shared) {
+        ShmFree(limiter->slots, (u64)limiter->config.table_slots * sizeof(ConnLimitSlot));
+        ShmFree(limiter->held, held);
+    } else {
+        free(limiter->slots);
+        free(limiter->held);
+    }
+    memset(limiter, 0, sizeof(*limiter));
+}
+
+// count of `holder` in `slot`, NULL when holder isn't counted apart
+static _Atomic(u16) *conn_limit_held(ConnLimiter *limiter, u32 holder, ConnLimitSlot *slot) {
+    if (!limiter->held || holder >= limiter->config.holders) {
+        return NULL;
+    }
+    return &limiter->held[(u64)holder * limiter->config.table_slots + (u64)(slot - limiter->slots)];
+}
+
+// slot was just taken : a holder dying in between leaves one connection counted, never takes one too many off
+static bool conn_limit_taken(ConnLimiter *limiter, u32 holder, ConnLimitSlot *slot, ConnLimitSlot **out) {
+    _Atomic(u16) *held = conn_limit_held(limiter, holder, slot);
+    if (held) {
+        atomic_fetch_add_explicit(held, 1, memory_order_relaxed);
+    }
+    *out = slot;
+    return true;
+}
+
+bool ConnLimitAcquire(ConnLimiter *limiter, u32 holder, const struct sockaddr_storage *peer, ConnLimitSlot **slot) {
+    if (!limiter || !peer || !slot) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    *slot = NULL;
+    if (!limiter->slots) {
+        return true;
+    }
+
+    u64 hash = AddrHash(peer, limiter->config.v6_prefix_bits);
+    u64 tag  = hash & CONN_LIMIT_TAG_MASK;
+    if (!hash) {
+        return true;
+    }
+    if (!tag) {
+        tag = CONN_LIMIT_COUNT_MASK + 1;
+    }
+
+    u64 mask = limiter->config.table_slots - 1;
+    u64 max  = limiter->config.max_per_client;
+
+    for (u32 retry = 0; retry < CONN_LIMIT_RETRIES; retry++) {
+        ConnLimitSlot *mine  = NULL;
+        ConnLimitSlot *spare = NULL;
+
+        for (u64 i = 0; i < CONN_LIMIT_PROBE_LIMIT && i <= mask; i++) {
+            ConnLimitSlot *s = &limiter->slots[(hash + i) & mask];
+            u64            w = atomic_load_explicit(&s->word, memory_order_relaxed);
+
+            if ((w & CONN_LIMIT_TAG_MASK) == tag) {
+                mine = s;
+                break;
+            }
+            if (!spare && !(w & CONN_LIMIT_COUNT_MASK)) {
+                spare = s;
+            }
+            if (!w) {
+                break;
+            }
+        }
+
+        if (mine) {
+            u64 w = atomic_load_explicit(&mine->word, memory_order_relaxed);
+            while ((w & CONN_LIMIT_TAG_MASK) == tag) {
+                if ((w & CONN_LIMIT_COUNT_MASK) >= max) {
+                    return false;
+                }
+                if (atomic_compare_exchange_weak_explicit(
+                        &mine->word,
+                        &w,
+                        w + 1,
+                        memory_order_relaxed,
+                        memory_order_relaxed
+                    )) {
+                    return conn_limit_taken(limiter, holder, mine, slot);
+                }
+            }
+
+            // slot got recycled for another client under us
+            continue;
+        }
+
+        if (!spare) {
+            // probe window full of busy clients, fail open and don't track
+            return true;
+        }
+
+        u64 w = atomic_load_explicit(&spare->word, memory_order_relaxed);
+        if (!(w & CONN_LIMIT_COUNT_MASK) &&
+            atomic_compare_exchange_strong_explicit(
+                &spare->word,
+                &w,
+                tag | 1,
+                memory_order_relaxed,
+                memory_order_relaxed
+            )) {
+            return conn_limit_taken(limiter, holder, spare, slot);
+        }
+    }
+
+    return true;
+}
+
+void ConnLimitRelease(ConnLimiter *limiter, u32 holder, ConnLimitSlot *slot) {
+    if (!limiter) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!slot) {
+        return;
+    }
+
+    // holder's own count goes first, for the same reason it's taken last
+    _Atomic(u16) *held = conn_limit_held(limiter, holder, slot);
+    if (held) {
+        atomic_fetch_sub_explicit(held, 1, memory_order_relaxed);
+    }
+    atomic_fetch_sub_explicit(&slot->word, 1, memory_order_relaxed);
+}
+
+void ConnLimitReleaseHolder(ConnLimiter *limiter, u32 holder) {
+    if (!limiter) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!limiter->held || holder >= limiter->config.holders) {
+        return;
+    }
+
+    // slots holder still counts in can't have been recycled, their counts are at least as high
+    _Atomic(u16) *held = &limiter->held[(u64)holder * limiter->config.table_slots];
+    for (u64 i = 0; i < limiter->config.table_slots; i++) {
+        u16 n = atomic_exchange_explicit(&held[i], 0, memory_order_relaxed);
+        if (n) {
+            atomic_fetch_sub_explicit(&limiter->slots[i].word, n, memory_order_relaxed);
+        }
+    }
+}
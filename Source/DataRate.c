@@ -0,0 +1,53 @@
+/// file      : datarate.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Minimum data-rate enforcement against slow-send and slow-read clients.
+
+#include <Misra.h>
+#include <Beam/Clock.h>
+#include <Beam/DataRate.h>
+
+// move fixed windows forward so that `now` falls in current one
+static void data_rate_roll(DataRateMeter *meter, u64 window, u64 now) {
+    u64 elapsed = now - meter->window_start;
+    if (elapsed < window) {
+        return;
+    }
+
+    meter->prev_bytes    = elapsed < 2 * window ? meter->window_bytes : 0;
+    meter->window_bytes  = 0;
+    meter->window_start += (elapsed / window) * window;
+}
+
+void DataRateMeterUpdate(DataRateMeter *meter, const DataRateConfig *config, u64 nbytes, u64 now) {
+    if (!meter || !config) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!config->min_bytes_per_sec) {
+        return;
+    }
+
+    data_rate_roll(meter, config->window_ns, now);
+    meter->window_bytes += nbytes;
+}
+
+bool DataRateMeterTooSlow(DataRateMeter *meter, const DataRateConfig *config, u64 now) {
+    if (!meter || !config) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    u64 window = config->window_ns;
+    if (!config->min_bytes_per_sec || now - meter->started < window) {
+        return false;
+    }
+
+    data_rate_roll(meter, window, now);
+
+    // previous window contributes the part of it still inside the sliding window
+    u64 into  = now - meter->window_start;
+    u64 moved = meter->window_bytes + (u64)((__uint128_t)meter->prev_bytes * (window - into) / window);
+
+    return (__uint128_t)moved * NSEC_PER_SEC < (__uint128_t)config->min_bytes_per_sec * window;
+}
@@ -0,0 +1,399 @@
+/// file      : docindex.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Index of files under document root, built once at startup.
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+#include <Misra.h>
+#include <Beam/Clock.h>
+#include <Beam/DocIndex.h>
+
+#define DOC_DIRENT_BUFFER 65536
+
+// filter bits per indexed path, and bits tested per lookup : about 0.2% false positives
+#define DOC_BLOOM_BITS_PER_ENTRY 16
+#define DOC_BLOOM_PROBES         4
+
+// what getdents64() fills its buffer with
+typedef struct {
+    u64  d_ino;
+    i64  d_off;
+    u16  d_reclen;
+    u8   d_type;
+    char d_name[];
+} DocDirent;
+
+// shared by walking threads
+typedef struct {
+    DocIndex       *index;
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;
+    char          **dirs; // directories waiting to be listed
+    u64             ndirs;
+    u64             dirs_cap;
+    u64             busy; // directories queued or being listed, walk is done at 0
+    DocEntry       *entries;
+    u64             count;
+    u64             cap;
+    u64             preloaded;
+} DocWalk;
+
+// what a walking thread found in one directory
+typedef struct {
+    char    **dirs;
+    u64       ndirs;
+    u64       dirs_cap;
+    DocEntry *entries;
+    u64       count;
+    u64       cap;
+    char     *data; // preload buffer
+    u64       data_cap;
+    u64       preloaded;
+} DocFound;
+
+// FNV-1a
+static u64 doc_hash(const char *path) {
+    u64 h = 0xcbf29ce484222325ull;
+    while (*path) {
+        h ^= (u8)*path++;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static u64 doc_mix(u64 x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+static bool doc_grow(void **items, u64 *cap, u64 need, u64 item_size) {
+    if (need <= *cap) {
+        return true;
+    }
+    u64   cap2 = *cap ? *cap * 2 : 64;
+    void *p    = realloc(*items, (cap2 > need ? cap2 : need) * item_size);
+    if (!p) {
+        return false;
+    }
+    *items = p;
+    *cap   = cap2 > need ? cap2 : need;
+    return true;
+}
+
+static char *doc_join(const char *dir, const char *name) {
+    u64   dl   = strlen(dir);
+    u64   nl   = strlen(name);
+    char *path = malloc(dl + nl + 2);
+    if (path) {
+        memcpy(path, dir, dl);
+        path[dl] = '/';
+        memcpy(path + dl + 1, name, nl + 1);
+    }
+    return path;
+}
+
+DocEtag DocEtagMake(u64 file_id, u64 mtime_ns, u64 size) {
+    DocEtag etag = {0};
+    u64     tag  = doc_mix(file_id ^ doc_mix(mtime_ns ^ doc_mix(size)));
+    snprintf(etag.value, sizeof(etag.value), "\"%016llx\"", (unsigned long long)tag);
+    return etag;
+}
+
+// read a small file into cache, reusing found->data as buffer
+static void doc_preload(DocIndex *index, DocFound *found, i32 dirfd, const char *name, DocEntry *entry) {
+    Cache *cache = index->config.cache;
+    if (!cache || !cache->header || entry->size > index->config.preload_max ||
+        entry->size > cache->config.max_object) {
+        return;
+    }
+
+    if (!doc_grow((void **)&found->data, &found->data_cap, entry->size ? entry->size : 1, 1)) {
+        return;
+    }
+
+    i32 fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        return;
+    }
+
+    u64 done = 0;
+    while (done < entry->size) {
+        i64 n = pread(fd, found->data + done, entry->size - done, (off_t)done);
+        if (n <= 0 && !(n == -1 && errno == EINTR)) {
+            break;
+        }
+        done += n > 0 ? (u64)n : 0;
+    }
+    close(fd);
+
+    CacheValidator valid = {.file_id = entry->file_id, .mtime_ns = entry->mtime_ns, .size = entry->size};
+    if (done == entry->size && CachePut(cache, entry->path, &valid, found->data, done, true)) {
+        found->preloaded++;
+    }
+}
+
+// look at one directory entry, a regular file becomes an index entry and a directory more work
+static void doc_visit(DocIndex *index, DocFound *found, i32 dirfd, const char *dir, DocDirent *d) {
+    const char *name = d->d_name;
+    if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) {
+        return;
+    }
+
+    // symlinks are followed to files but never into directories, so cycles can't be walked
+    struct statx stx;
+    i32          flags = d->d_type == DT_LNK ? 0 : AT_SYMLINK_NOFOLLOW;
+    u32          mask  = STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_INO;
+    if (d->d_type != DT_DIR && -1 == statx(dirfd, name, flags | AT_STATX_DONT_SYNC, mask, &stx)) {
+        return;
+    }
+
+    char *path = doc_join(dir, name);
+    if (!path) {
+        return;
+    }
+
+    if (d->d_type == DT_DIR || (d->d_type == DT_UNKNOWN && S_ISDIR(stx.stx_mode))) {
+        if (doc_grow((void **)&found->dirs, &found->dirs_cap, found->ndirs + 1, sizeof(char *))) {
+            found->dirs[found->ndirs++] = path;
+            return;
+        }
+    } else if (S_ISREG(stx.stx_mode) &&
+               doc_grow((void **)&found->entries, &found->cap, found->count + 1, sizeof(DocEntry))) {
+        DocEntry *entry     = &found->entries[found->count++];
+        u64       dev       = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+        entry->path         = path;
+        entry->size         = stx.stx_size;
+        entry->mtime_ns     = (u64)stx.stx_mtime.tv_sec * NSEC_PER_SEC + stx.stx_mtime.tv_nsec;
+        entry->file_id      = (dev << 32) ^ stx.stx_ino;
+        entry->content_type = HttpContentTypeFromPath(path);
+        entry->etag         = DocEtagMake(entry->file_id, entry->mtime_ns, entry->size);
+        doc_preload(index, found, dirfd, name, entry);
+        return;
+    }
+
+    free(path);
+}
+
+// list a directory with getdents64()
+static void doc_list(DocIndex *index, DocFound *found, const char *dir, char *buffer) {
+    i32 dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (-1 == dirfd) {
+        return;
+    }
+
+    while (true) {
+        i64 n = syscall(SYS_getdents64, dirfd, buffer, DOC_DIRENT_BUFFER);
+        if (n <= 0) {
+            break;
+        }
+        for (i64 at = 0; at < n;) {
+            DocDirent *d = (DocDirent *)(buffer + at);
+            doc_visit(index, found, dirfd, dir, d);
+            at += d->d_reclen;
+        }
+    }
+
+    close(dirfd);
+}
+
+static void *doc_walk_main(void *arg) {
+    DocWalk *walk   = arg;
+    DocFound found  = {0};
+    char    *buffer = malloc(DOC_DIRENT_BUFFER);
+
+    pthread_mutex_lock(&walk->lock);
+    while (buffer) {
+        while (!walk->ndirs && walk->busy) {
+            pthread_cond_wait(&walk->wake, &walk->lock);
+        }
+        if (!walk->ndirs) {
+            break;
+        }
+
+        char *dir = walk->dirs[--walk->ndirs];
+        pthread_mutex_unlock(&walk->lock);
+
+        found.ndirs = 0;
+        found.count = 0;
+        doc_list(walk->index, &found, dir, buffer);
+        free(dir);
+
+        // hand over what was found, in one go so the lock is taken once per directory
+        pthread_mutex_lock(&walk->lock);
+        bool room = doc_grow((void **)&walk->dirs, &walk->dirs_cap, walk->ndirs + found.ndirs, sizeof(char *)) &&
+                    doc_grow((void **)&walk->entries, &walk->cap, walk->count + found.count, sizeof(DocEntry));
+        if (room) {
+            memcpy(walk->dirs + walk->ndirs, found.dirs, found.ndirs * sizeof(char *));
+            memcpy(walk->entries + walk->count, found.entries, found.count * sizeof(DocEntry));
+            walk->ndirs += found.ndirs;
+            walk->count += found.count;
+            walk->busy  += found.ndirs;
+        } else {
+            for (u64 i = 0; i < found.ndirs; i++) {
+                free(found.dirs[i]);
+            }
+            for (u64 i = 0; i < found.count; i++) {
+                free(found.entries[i].path);
+            }
+        }
+
+        walk->busy--;
+        if (found.ndirs || !walk->busy) {
+            pthread_cond_broadcast(&walk->wake);
+        }
+    }
+    walk->preloaded += found.preloaded;
+    pthread_cond_broadcast(&walk->wake);
+    pthread_mutex_unlock(&walk->lock);
+
+    free(found.dirs);
+    free(found.entries);
+    free(found.data);
+    free(buffer);
+    return NULL;
+}
+
+static void doc_bloom_add(DocIndex *index, u64 hash) {
+    u64 step = doc_mix(hash) | 1;
+    for (u32 i = 0; i < DOC_BLOOM_PROBES; i++) {
+        u64 bit               = (hash + i * step) & index->bloom_mask;
+        index->bloom[bit / 64] |= 1ull << (bit % 64);
+    }
+}
+
+static bool doc_bloom_has(const DocIndex *index, u64 hash) {
+    u64 step = doc_mix(hash) | 1;
+    for (u32 i = 0; i < DOC_BLOOM_PROBES; i++) {
+        u64 bit = (hash + i * step) & index->bloom_mask;
+        if (!(index->bloom[bit / 64] & (1ull << (bit % 64)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static u64 doc_pow2(u64 x) {
+    u64 p = 64;
+    while (p < x) {
+        p *= 2;
+    }
+    return p;
+}
+
+DocIndex *DocIndexBuild(DocIndex *index, const DocIndexConfig *config, const char *root) {
+    if (!index || !config || !root || !config->threads) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    *index        = DocIndexInit();
+    index->config = *config;
+
+    DocWalk walk = {.index = index, .busy = 1};
+    walk.dirs    = malloc(sizeof(char *));
+    if (!walk.dirs || !(walk.dirs[0] = strdup(root))) {
+        LOG_ERROR("failed to allocate document root index");
+        free(walk.dirs);
+        return NULL;
+    }
+    walk.ndirs    = 1;
+    walk.dirs_cap = 1;
+    pthread_mutex_init(&walk.lock, NULL);
+    pthread_cond_init(&walk.wake, NULL);
+
+    pthread_t *threads = calloc(config->threads, sizeof(pthread_t));
+    u32        started = 0;
+    while (threads && started < config->threads && !pthread_create(&threads[started], NULL, doc_walk_main, &walk)) {
+        started++;
+    }
+    if (!started) {
+        doc_walk_main(&walk);
+    }
+    for (u32 i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    pthread_cond_destroy(&walk.wake);
+    pthread_mutex_destroy(&walk.lock);
+    free(walk.dirs);
+
+    index->entries   = walk.entries;
+    index->count     = walk.count;
+    index->preloaded = walk.preloaded;
+
+    u64 slots         = doc_pow2(index->count * 2);
+    u64 bits          = doc_pow2(index->count * DOC_BLOOM_BITS_PER_ENTRY);
+    index->table      = calloc(slots, sizeof(u32));
+    index->table_mask = slots - 1;
+    index->bloom      = calloc(bits / 64, sizeof(u64));
+    index->bloom_mask = bits - 1;
+    if (!index->table || !index->bloom || index->count >= UINT32_MAX) {
+        LOG_ERROR("failed to allocate document root index");
+        DocIndexDeinit(index);
+        return NULL;
+    }
+
+    for (u64 i = 0; i < index->count; i++) {
+        u64 hash = doc_hash(index->entries[i].path);
+        u64 slot = hash & index->table_mask;
+        while (index->table[slot]) {
+            slot = (slot + 1) & index->table_mask;
+        }
+        index->table[slot] = (u32)i + 1;
+        doc_bloom_add(index, hash);
+    }
+
+    return index;
+}
+
+void DocIndexDeinit(DocIndex *index) {
+    if (!index) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    for (u64 i = 0; i < index->count; i++) {
+        free(index->entries[i].path);
+    }
+    free(index->entries);
+    free(index->table);
+    free(index->bloom);
+    *index = DocIndexInit();
+}
+
+const DocEntry *DocIndexFind(const DocIndex *index, const char *path) {
+    if (!index || !path) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!index->table) {
+        return NULL;
+    }
+
+    u64 hash = doc_hash(path);
+    if (!doc_bloom_has(index, hash)) {
+        return NULL;
+    }
+
+    for (u64 slot = hash & index->table_mask; index->table[slot]; slot = (slot + 1) & index->table_mask) {
+        const DocEntry *entry = &index->entries[index->table[slot] - 1];
+        if (!strcmp(entry->path, path)) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,139 @@
+/// file      : hotcache.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Worker-local cache of rendered responses.
+
+#include <Misra.h>
+#include <Beam/HotCache.h>
+
+struct HotCacheEntry {
+    u64 hash;       // hash of url, 0 for unused
+    u64 generation; // of shared cache when response was rendered
+    u64 made_ns;    // when response was rendered
+    Str url;
+    Str response;
+};
+
+// FNV-1a, never 0 so that 0 can mark unused entries
+static u64 hot_hash(const char *url, u64 len) {
+    u64 h = 0xcbf29ce484222325ull;
+    for (u64 i = 0; i < len; i++) {
+        h ^= (u8)url[i];
+        h *= 0x100000001b3ull;
+    }
+    return h ? h : 1;
+}
+
+static void hot_append(Str *out, const char *data, u64 len) {
+    StrReserve(out, out->length + len);
+    memcpy(StrEnd(out), data, len);
+    out->length += len;
+}
+
+HotCache *HotCacheInit(HotCache *hot, const HotCacheConfig *config) {
+    if (!hot || !config) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    u32 slots = config->slots;
+    if (!slots || (slots & (slots - 1))) {
+        LOG_ERROR("invalid hot cache configuration");
+        return NULL;
+    }
+
+    memset(hot, 0, sizeof(*hot));
+    hot->entries = calloc(slots, sizeof(HotCacheEntry));
+    if (!hot->entries) {
+        LOG_ERROR("failed to allocate hot cache");
+        return NULL;
+    }
+
+    for (u32 i = 0; i < slots; i++) {
+        hot->entries[i].url      = StrInit();
+        hot->entries[i].response = StrInit();
+    }
+
+    hot->config = *config;
+    hot->mask   = slots - 1;
+    return hot;
+}
+
+void HotCacheDeinit(HotCache *hot) {
+    if (!hot) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    for (u32 i = 0; hot->entries && i < hot->config.slots; i++) {
+        StrDeinit(&hot->entries[i].url);
+        StrDeinit(&hot->entries[i].response);
+    }
+    free(hot->entries);
+    memset(hot, 0, sizeof(*hot));
+}
+
+void HotCacheResize(HotCache *hot, u32 pct) {
+    if (!hot || !hot->entries || pct > 100) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    u64 want  = (u64)hot->config.slots * pct / 100;
+    u32 slots = 1;
+    while ((u64)slots * 2 <= want) {
+        slots *= 2;
+    }
+
+    // entries left out give their buffers back, ones let back in start empty
+    for (u32 i = slots; i <= hot->mask; i++) {
+        StrDeinit(&hot->entries[i].url);
+        StrDeinit(&hot->entries[i].response);
+        hot->entries[i].url      = StrInit();
+        hot->entries[i].response = StrInit();
+        hot->entries[i].hash     = 0;
+    }
+    hot->mask = slots - 1;
+}
+
+bool HotCacheGet(HotCache *hot, const char *url, u64 len, u64 generation, u64 now, Str *out) {
+    if (!hot || !hot->entries || !url || !out) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    u64            hash  = hot_hash(url, len);
+    HotCacheEntry *entry = &hot->entries[hash & hot->mask];
+    if (entry->hash != hash || entry->url.length != len || memcmp(entry->url.data, url, len)) {
+        return false;
+    }
+
+    // shared cache moved on, or entry is due a look at the file
+    if (entry->generation != generation || now - entry->made_ns >= hot->config.revalidate_ns) {
+        entry->hash = 0;
+        return false;
+    }
+
+    hot_append(out, entry->response.data, entry->response.length);
+    return true;
+}
+
+bool HotCachePut(HotCache *hot, const char *url, u64 len, u64 generation, u64 now, const Str *response) {
+    if (!hot || !hot->entries || !url || !response) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (response->length > hot->config.max_response) {
+        return false;
+    }
+
+    // buffers of replaced entry are reused, they're about the right size already
+    u64            hash  = hot_hash(url, len);
+    HotCacheEntry *entry = &hot->entries[hash & hot->mask];
+
+    entry->url.length      = 0;
+    entry->response.length = 0;
+    hot_append(&entry->url, url, len);
+    hot_append(&entry->response, response->data, response->length);
+    entry->hash       = hash;
+    entry->generation = generation;
+    entry->made_ns    = now;
+    return true;
+}
@@ -6,8 +6,15 @@
 
 // socket
 #include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
 
 #include <Misra.h>
+#include <Beam/Clock.h>
 #include <Beam/Http.h>
 
 void HttpHeaderDeinit(HttpHeader *header) {
@@ -26,7 +33,7 @@ HttpHeader *HttpHeadersFind(HttpHeaders *headers, const char *key) {
     }
 
     VecForeachPtr(headers, header, {
-        if (0 == ZstrCompare(header->key.data, key)) {
+        if (header->key.data && 0 == strcasecmp(header->key.data, key)) {
             return header;
         }
     });
@@ -34,28 +41,49 @@ HttpHeader *HttpHeadersFind(HttpHeaders *headers, const char *key) {
     return NULL;
 }
 
+u32 HttpHeadersCount(HttpHeaders *headers, const char *key) {
+    if (!headers || !key) {
+        LOG_ERROR("Invalid arguments.");
+        return 0;
+    }
+
+    u32 count = 0;
+    VecForeachPtr(headers, header, {
+        if (header->key.data && 0 == strcasecmp(header->key.data, key)) {
+            count++;
+        }
+    });
+
+    return count;
+}
+
+// whole of method token has to match, "GETX" isn't GET
+static bool http_request_method_is(Str *mstr, const char *name, u64 length) {
+    return mstr->length == length && 0 == ZstrCompareN(mstr->data, name, length);
+}
+
 HttpRequestMethod http_request_method_from_str(Str *mstr) {
     if (!mstr || !mstr->data) {
         LOG_FATAL("Invalid arguments");
     }
 
-    if (ZstrCompareN(mstr->data, "GET", 3)) {
+    if (http_request_method_is(mstr, "GET", 3)) {
         return HTTP_REQUEST_METHOD_GET;
-    } else if (ZstrCompareN(mstr->data, "POST", 4)) {
+    } else if (http_request_method_is(mstr, "POST", 4)) {
         return HTTP_REQUEST_METHOD_POST;
-    } else if (ZstrCompareN(mstr->data, "DELETE", 6)) {
+    } else if (http_request_method_is(mstr, "DELETE", 6)) {
         return HTTP_REQUEST_METHOD_DELETE;
-    } else if (ZstrCompareN(mstr->data, "PUT", 3)) {
+    } else if (http_request_method_is(mstr, "PUT", 3)) {
         return HTTP_REQUEST_METHOD_PUT;
-    } else if (ZstrCompareN(mstr->data, "PATCH", 5)) {
+    } else if (http_request_method_is(mstr, "PATCH", 5)) {
         return HTTP_REQUEST_METHOD_PATCH;
-    } else if (ZstrCompareN(mstr->data, "HEAD", 4)) {
+    } else if (http_request_method_is(mstr, "HEAD", 4)) {
         return HTTP_REQUEST_METHOD_HEAD;
-    } else if (ZstrCompareN(mstr->data, "OPTIONS", 7)) {
+    } else if (http_request_method_is(mstr, "OPTIONS", 7)) {
         return HTTP_REQUEST_METHOD_OPTIONS;
-    } else if (ZstrCompareN(mstr->data, "CONNECT", 7)) {
+    } else if (http_request_method_is(mstr, "CONNECT", 7)) {
         return HTTP_REQUEST_METHOD_CONNECT;
-    } else if (ZstrCompareN(mstr->data, "TRACE", 5)) {
+    } else if (http_request_method_is(mstr, "TRACE", 5)) {
         return HTTP_REQUEST_METHOD_TRACE;
     }
 
@@ -79,7 +107,7 @@ const char *HttpRequestParse(HttpRequest *req, const char *in) {
         StrDeinit(&method);
         HttpRequestDeinit(req);
         StrDeinit(&version);
-        return in;
+        return NULL;
     }
 
     // make sure http version is good
@@ -88,7 +116,7 @@ const char *HttpRequestParse(HttpRequest *req, const char *in) {
         HttpRequestDeinit(req);
         StrDeinit(&method);
         LOG_ERROR("Invalid/Unsupported http verison.");
-        return in;
+        return NULL;
     }
     StrDeinit(&version);
 
@@ -98,7 +126,7 @@ const char *HttpRequestParse(HttpRequest *req, const char *in) {
     if (req->method == HTTP_REQUEST_METHOD_UNKNOWN) {
         HttpRequestDeinit(req);
         LOG_ERROR("Invalid http request method.");
-        return in;
+        return NULL;
     }
 
     HttpHeader hh = HttpHeaderInit();
@@ -126,7 +154,7 @@ const char *HttpRequestParse(HttpRequest *req, const char *in) {
             LOG_ERROR("Failed to find header key. Invalid http request.");
             HttpHeaderDeinit(&hh);
             HttpRequestDeinit(req);
-            return in;
+            return NULL;
         }
 
         VecPushBack(&req->headers, hh);
@@ -311,6 +339,8 @@ const char *HttpContentTypeToZstr(HttpContentType type) {
             return "image/bmp";
         case HTTP_CONTENT_TYPE_IMAGE_SVG_XML :
             return "image/svg+xml";
+        case HTTP_CONTENT_TYPE_IMAGE_WEBP :
+            return "image/webp";
         case HTTP_CONTENT_TYPE_AUDIO_MPEG :
             return "audio/mpeg";
         case HTTP_CONTENT_TYPE_AUDIO_OGG :
@@ -323,11 +353,69 @@ const char *HttpContentTypeToZstr(HttpContentType type) {
             return "video/webm";
         case HTTP_CONTENT_TYPE_VIDEO_OGG :
             return "video/ogg";
+        case HTTP_CONTENT_TYPE_FONT_WOFF :
+            return "font/woff";
+        case HTTP_CONTENT_TYPE_FONT_WOFF2 :
+            return "font/woff2";
+        case HTTP_CONTENT_TYPE_TEXT_CSV :
+            return "text/csv";
         default :
             return NULL;
     }
 }
 
+HttpContentType HttpContentTypeFromPath(const char *path) {
+    if (!path) {
+        LOG_FATAL("invalid arguments.");
+    }
+
+    static const struct {
+        const char     *ext;
+        HttpContentType type;
+    } types[] = {
+        {"html", HTTP_CONTENT_TYPE_TEXT_HTML},
+        {"htm", HTTP_CONTENT_TYPE_TEXT_HTML},
+        {"txt", HTTP_CONTENT_TYPE_TEXT_PLAIN},
+        {"css", HTTP_CONTENT_TYPE_TEXT_CSS},
+        {"js", HTTP_CONTENT_TYPE_TEXT_JAVASCRIPT},
+        {"mjs", HTTP_CONTENT_TYPE_TEXT_JAVASCRIPT},
+        {"csv", HTTP_CONTENT_TYPE_TEXT_CSV},
+        {"json", HTTP_CONTENT_TYPE_APPLICATION_JSON},
+        {"xml", HTTP_CONTENT_TYPE_APPLICATION_XML},
+        {"pdf", HTTP_CONTENT_TYPE_APPLICATION_PDF},
+        {"zip", HTTP_CONTENT_TYPE_APPLICATION_ZIP},
+        {"jpg", HTTP_CONTENT_TYPE_IMAGE_JPEG},
+        {"jpeg", HTTP_CONTENT_TYPE_IMAGE_JPEG},
+        {"png", HTTP_CONTENT_TYPE_IMAGE_PNG},
+        {"gif", HTTP_CONTENT_TYPE_IMAGE_GIF},
+        {"bmp", HTTP_CONTENT_TYPE_IMAGE_BMP},
+        {"webp", HTTP_CONTENT_TYPE_IMAGE_WEBP},
+        {"svg", HTTP_CONTENT_TYPE_IMAGE_SVG_XML},
+        {"mp3", HTTP_CONTENT_TYPE_AUDIO_MPEG},
+        {"ogg", HTTP_CONTENT_TYPE_AUDIO_OGG},
+        {"wav", HTTP_CONTENT_TYPE_AUDIO_WAV},
+        {"mp4", HTTP_CONTENT_TYPE_VIDEO_MP4},
+        {"ogv", HTTP_CONTENT_TYPE_VIDEO_OGG},
+        {"webm", HTTP_CONTENT_TYPE_VIDEO_WEBM},
+        {"woff", HTTP_CONTENT_TYPE_FONT_WOFF},
+        {"woff2", HTTP_CONTENT_TYPE_FONT_WOFF2},
+    };
+
+    const char *dot   = strrchr(path, '.');
+    const char *slash = strrchr(path, '/');
+    if (!dot || (slash && dot < slash)) {
+        return HTTP_CONTENT_TYPE_APPLICATION_OCTET_STREAM;
+    }
+
+    for (u64 i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if (0 == strcasecmp(dot + 1, types[i].ext)) {
+            return types[i].type;
+        }
+    }
+
+    return HTTP_CONTENT_TYPE_APPLICATION_OCTET_STREAM;
+}
+
 HttpResponse *HttpRespondWithHtml(HttpResponse *response, HttpResponseCode status, Str *html) {
     if (!response || !html) {
         LOG_FATAL("invalid arguments.");
@@ -350,20 +438,129 @@ HttpResponse *HttpRespondWithFile(
         LOG_FATAL("invalid arguments.");
     }
 
-    response->status_code  = status;
-    response->content_type = content_type;
+    i32 fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        LOG_SYS_ERROR("failed to open file.");
+        return NULL;
+    }
 
-    if (!ReadCompleteFile(filepath, &response->body.data, &response->body.length, &response->body.capacity)) {
-        LOG_ERROR("failed to read html file contents.");
+    struct stat st;
+    if (-1 == fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+        LOG_ERROR("not a regular file.");
+        close(fd);
         return NULL;
     }
 
+    response->status_code   = status;
+    response->content_type  = content_type;
+    response->file_fd       = fd;
+    response->file_offset   = 0;
+    response->file_length   = (u64)st.st_size;
+    response->file_size     = (u64)st.st_size;
+    response->file_id       = ((u64)st.st_dev << 32) ^ (u64)st.st_ino;
+    response->file_mtime_ns = (u64)st.st_mtim.tv_sec * NSEC_PER_SEC + (u64)st.st_mtim.tv_nsec;
+
     return response;
 }
 
 
-HttpResponse *HttpRespondTo(HttpResponse *response, int connfd) {
-    if (!response || !connfd) {
+// parse decimal number, advancing `in` past it
+static bool http_parse_u64(const char **in, u64 *out) {
+    const char *p = *in;
+    u64         v = 0;
+
+    if (*p < '0' || *p > '9') {
+        return false;
+    }
+
+    for (; *p >= '0' && *p <= '9'; p++) {
+        if (v > (UINT64_MAX - (u64)(*p - '0')) / 10) {
+            return false;
+        }
+        v = v * 10 + (u64)(*p - '0');
+    }
+
+    *in  = p;
+    *out = v;
+    return true;
+}
+
+bool HttpParseContentLength(const char *value, u64 *length) {
+    if (!length) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    // nothing but digits : sign, spaces or junk after them would be read differently by someone else
+    return value && http_parse_u64(&value, length) && !*value;
+}
+
+
+HttpResponse *HttpResponseSetRange(HttpResponse *response, const char *range) {
+    if (!response || !range) {
+        LOG_ERROR("invalid arguments.");
+        return NULL;
+    }
+
+    if (response->file_fd < 0 || response->status_code != HTTP_RESPONSE_CODE_OK) {
+        return response;
+    }
+
+    // bytes=first-last, bytes=first- or bytes=-suffix
+    const char *p = range;
+    while (*p == ' ') {
+        p++;
+    }
+    if (strncasecmp(p, "bytes=", 6) || strchr(p, ',')) {
+        return response;
+    }
+    p += 6;
+
+    u64  size  = response->file_size;
+    u64  first = 0;
+    u64  last  = size ? size - 1 : 0;
+    bool valid = false;
+
+    if (*p == '-') {
+        p++;
+        u64 suffix = 0;
+        if (http_parse_u64(&p, &suffix)) {
+            // an empty suffix can't be satisfied
+            valid = true;
+            first = !suffix ? size : suffix < size ? size - suffix : 0;
+        }
+    } else if (http_parse_u64(&p, &first) && *p == '-') {
+        p++;
+        valid = true;
+        if (*p >= '0' && *p <= '9') {
+            u64 end = 0;
+            valid   = http_parse_u64(&p, &end) && end >= first;
+            last    = end < last ? end : last;
+        }
+    }
+
+    while (*p == ' ') {
+        p++;
+    }
+    if (!valid || *p) {
+        return response;
+    }
+
+    if (first >= size) {
+        response->status_code = HTTP_RESPONSE_CODE_RANGE_NOT_SATISFIABLE;
+        response->file_offset = 0;
+        response->file_length = 0;
+        return response;
+    }
+
+    response->status_code = HTTP_RESPONSE_CODE_PARTIAL_CONTENT;
+    response->file_offset = first;
+    response->file_length = last - first + 1;
+    return response;
+}
+
+
+Str *HttpResponseRenderHead(HttpResponse *response, Str *out) {
+    if (!response || !out) {
         LOG_ERROR("invalid arguments.");
         return NULL;
     }
@@ -381,37 +578,171 @@ HttpResponse *HttpRespondTo(HttpResponse *response, int connfd) {
     }
 
     // http response
-    Str rstr = StrInit();
-    StrWriteFmt(
-        &rstr,
-        "HTTP/1.1 {}\r\n"
-        "Server: beam/0.1\r\n"
-        "Content-Type: {}\r\n"
-        "Content-Length: {}\r\n",
-        response_code,
-        content_type,
-        response->body.length
-    );
+    StrWriteFmt(out, "HTTP/1.1 {}\r\nServer: beam/0.1\r\nContent-Type: {}\r\n", response_code, content_type);
+
+    // a 304 carries no body, and its length would have to be that of the full response
+    if (response->status_code != HTTP_RESPONSE_CODE_NOT_MODIFIED) {
+        StrWriteFmt(
+            out,
+            "Content-Length: {}\r\n",
+            response->file_fd >= 0 ? response->file_length : response->body.length
+        );
+    }
+
+    if (response->close) {
+        StrWriteFmt(out, "Connection: close\r\n");
+    }
+
+    if (response->file_fd >= 0) {
+        StrWriteFmt(out, "Accept-Ranges: bytes\r\n");
+        if (response->status_code == HTTP_RESPONSE_CODE_PARTIAL_CONTENT) {
+            u64 last = response->file_offset + response->file_length - 1;
+            StrWriteFmt(out, "Content-Range: bytes {}-{}/{}\r\n", response->file_offset, last, response->file_size);
+        } else if (response->status_code == HTTP_RESPONSE_CODE_RANGE_NOT_SATISFIABLE) {
+            StrWriteFmt(out, "Content-Range: bytes */{}\r\n", response->file_size);
+        }
+    }
 
     // http headers
-    VecForeachPtr(&response->headers, header, { StrWriteFmt(&rstr, "{}: {}\r\n", header->key, header->value); });
+    VecForeachPtr(&response->headers, header, { StrWriteFmt(out, "{}: {}\r\n", header->key, header->value); });
 
     // response end, body start
-    StrWriteFmt(&rstr, "\r\n");
+    StrWriteFmt(out, "\r\n");
+
+    return out;
+}
+
+
+Str *HttpResponseRender(HttpResponse *response, Str *out) {
+    if (!HttpResponseRenderHead(response, out)) {
+        return NULL;
+    }
 
     // response body
-    StrReserve(&rstr, rstr.length + response->body.length);
-    memcpy(StrEnd(&rstr), response->body.data, response->body.length);
-    rstr.length += response->body.length;
+    StrReserve(out, out->length + response->body.length);
+    memcpy(StrEnd(out), response->body.data, response->body.length);
+    out->length += response->body.length;
 
-    send(connfd, rstr.data, rstr.length, 0);
+    return out;
+}
+
+
+HttpResponse *HttpRespondTo(HttpResponse *response, int connfd) {
+    if (!response || !connfd) {
+        LOG_ERROR("invalid arguments.");
+        return NULL;
+    }
+
+    Str rstr = StrInit();
+    if (!HttpResponseRender(response, &rstr)) {
+        StrDeinit(&rstr);
+        return NULL;
+    }
+
+    // blocking send may still return early when interrupted
+    const char *p    = rstr.data;
+    u64         left = rstr.length;
+    while (left) {
+        i64 n = send(connfd, p, left, MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            LOG_SYS_ERROR("send() failed");
+            StrDeinit(&rstr);
+            return NULL;
+        }
+        p    += n;
+        left -= (u64)n;
+    }
 
     StrDeinit(&rstr);
 
+    // file body goes straight from page cache to socket
+    off_t offset = (off_t)response->file_offset;
+    left         = response->file_fd >= 0 ? response->file_length : 0;
+    while (left) {
+        i64 n = sendfile(connfd, response->file_fd, &offset, left);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            LOG_SYS_ERROR("sendfile() failed");
+            return NULL;
+        }
+        left -= (u64)n;
+    }
+
     return response;
 }
 
 
+#define HTTP_CANNED_RESPONSE(status, body)                                                                             \
+    "HTTP/1.1 " status "\r\n"                                                                                          \
+    "Server: beam/0.1\r\n"                                                                                            \
+    "Content-Type: text/plain\r\n"                                                                                    \
+    "Content-Length: " body "\r\n"                                                                                    \
+    "Connection: close\r\n"
+
+static const char http_canned_bad_request[] = HTTP_CANNED_RESPONSE("400 Bad Request", "12")
+    "\r\n"
+    "Bad Request\n";
+
+static const char http_canned_header_fields_too_large[] =
+    HTTP_CANNED_RESPONSE("431 Request Header Fields Too Large", "32")
+    "\r\n"
+    "Request Header Fields Too Large\n";
+
+static const char http_canned_too_many_requests[] = HTTP_CANNED_RESPONSE("429 Too Many Requests", "18")
+    "Retry-After: 1\r\n"
+    "\r\n"
+    "Too Many Requests\n";
+
+static const char http_canned_service_unavailable[] = HTTP_CANNED_RESPONSE("503 Service Unavailable", "20")
+    "Retry-After: 1\r\n"
+    "\r\n"
+    "Service Unavailable\n";
+
+#define HTTP_CANNED(code, response)                                                                                    \
+    case code :                                                                                                        \
+        *size = sizeof(response) - 1;                                                                                  \
+        return response
+
+const char *HttpCannedResponse(HttpResponseCode code, u64 *size) {
+    if (!size) {
+        LOG_FATAL("invalid arguments.");
+    }
+
+    switch (code) {
+        HTTP_CANNED(HTTP_RESPONSE_CODE_BAD_REQUEST, http_canned_bad_request);
+        HTTP_CANNED(HTTP_RESPONSE_CODE_REQUEST_HEADER_FIELDS_TOO_LARGE, http_canned_header_fields_too_large);
+        HTTP_CANNED(HTTP_RESPONSE_CODE_TOO_MANY_REQUESTS, http_canned_too_many_requests);
+        HTTP_CANNED(HTTP_RESPONSE_CODE_SERVICE_UNAVAILABLE, http_canned_service_unavailable);
+        default :
+            *size = 0;
+            return NULL;
+    }
+}
+
+#undef HTTP_CANNED
+
+bool HttpRespondCanned(HttpResponseCode code, int connfd) {
+    if (connfd < 0) {
+        LOG_ERROR("invalid arguments.");
+        return false;
+    }
+
+    u64         size = 0;
+    const char *data = HttpCannedResponse(code, &size);
+    if (!data) {
+        LOG_ERROR("no pre-rendered response for given code");
+        return false;
+    }
+
+    return send(connfd, data, size, MSG_NOSIGNAL) == (i64)size;
+}
+
+
 void HttpResponseDeinit(HttpResponse *response) {
     if (!response) {
         LOG_FATAL("invalid arguments");
@@ -419,6 +750,13 @@ void HttpResponseDeinit(HttpResponse *response) {
 
     StrDeinit(&response->body);
     VecDeinit(&response->headers);
+    if (response->file_fd >= 0) {
+        close(response->file_fd);
+    }
+    response->file_fd      = -1;
+    response->file_offset  = 0;
+    response->file_length  = 0;
+    response->close        = false;
     response->content_type = HTTP_CONTENT_TYPE_INVALID;
     response->status_code  = HTTP_RESPONSE_CODE_INVALID;
 }
@@ -0,0 +1,49 @@
+/// file      : hugepage.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Private memory backed by huge pages where kernel has any.
+
+#include <sys/mman.h>
+
+#include <Misra.h>
+#include <Beam/HugePage.h>
+
+// hugetlb mappings are unmapped in whole huge pages, so both sides round alike
+static u64 huge_page_round(u64 size) {
+    return size >= HUGE_PAGE_SIZE ? (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1) : size;
+}
+
+void *HugePageAlloc(u64 size, bool huge) {
+    if (!size) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    size = huge_page_round(size);
+
+    // reserved pool first, failing fast when it's empty rather than on a later fault
+    if (huge && size >= HUGE_PAGE_SIZE) {
+        void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (MAP_FAILED != mem) {
+            return mem;
+        }
+    }
+
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == mem) {
+        LOG_SYS_ERROR("mmap() failed");
+        return NULL;
+    }
+
+    // khugepaged collapses aligned 2MB ranges of it later, page faults may get one right away
+    if (huge && size >= HUGE_PAGE_SIZE) {
+        madvise(mem, size, MADV_HUGEPAGE);
+    }
+    return mem;
+}
+
+void HugePageFree(void *mem, u64 size) {
+    if (mem) {
+        munmap(mem, huge_page_round(size));
+    }
+}
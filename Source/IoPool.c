@@ -0,0 +1,268 @@
+/// file      : iopool.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Thread pool for file I/O that would block an event loop.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <Misra.h>
+#include <Beam/IoPool.h>
+
+// bytes read per pread() while bringing a range into page cache, data itself is thrown away
+#define IO_SCRATCH_SIZE (64 * 1024)
+
+static void io_job_complete(IoJob *job) {
+    IoCompletions *done = job->done;
+
+    IoJob *head = atomic_load_explicit(&done->head, memory_order_relaxed);
+    do {
+        job->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(
+        &done->head,
+        &head,
+        job,
+        memory_order_release,
+        memory_order_relaxed
+    ));
+
+    // only the push onto an empty list needs to wake submitter up
+    if (!head) {
+        u64 one = 1;
+        while (-1 == write(done->event_fd, &one, sizeof(one)) && errno == EINTR) {}
+    }
+}
+
+static void *io_pool_thread(void *arg) {
+    IoPool *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (!pool->head && !pool->stopping) {
+            pthread_cond_wait(&pool->ready, &pool->lock);
+        }
+
+        IoJob *job = pool->head;
+        if (!job) {
+            break;
+        }
+
+        pool->head = job->next;
+        if (!pool->head) {
+            pool->tail = NULL;
+        }
+        bool stopping = pool->stopping;
+        pthread_mutex_unlock(&pool->lock);
+
+        // a call nobody waits for may free job as it returns
+        bool detached = !job->done;
+        if (!stopping) {
+            IoJobRun(job);
+        } else if (job->kind == IO_JOB_READ) {
+            job->result = -1;
+            job->error  = ECANCELED;
+        } else if (job->kind == IO_JOB_CALL) {
+            job->error = ECANCELED;
+            job->run(job);
+        }
+        if (!detached) {
+            io_job_complete(job);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+IoPool *IoPoolInit(IoPool *pool, const IoPoolConfig *config) {
+    if (!pool || !config) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    memset(pool, 0, sizeof(*pool));
+    pool->config = *config;
+
+    if (!config->threads) {
+        return pool;
+    }
+
+    pool->threads = calloc(config->threads, sizeof(pthread_t));
+    if (!pool->threads) {
+        LOG_ERROR("failed to allocate I/O threads");
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->ready, NULL);
+
+    for (u32 i = 0; i < config->threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, io_pool_thread, pool)) {
+            LOG_ERROR("failed to start I/O thread");
+            IoPoolDeinit(pool);
+            return NULL;
+        }
+        pool->nthreads++;
+    }
+
+    return pool;
+}
+
+void IoPoolDeinit(IoPool *pool) {
+    if (!pool) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (pool->threads) {
+        pthread_mutex_lock(&pool->lock);
+        pool->stopping = true;
+        pthread_cond_broadcast(&pool->ready);
+        pthread_mutex_unlock(&pool->lock);
+
+        for (u32 i = 0; i < pool->nthreads; i++) {
+            pthread_join(pool->threads[i], NULL);
+        }
+
+        pthread_cond_destroy(&pool->ready);
+        pthread_mutex_destroy(&pool->lock);
+        free(pool->threads);
+    }
+
+    memset(pool, 0, sizeof(*pool));
+}
+
+void IoJobRun(IoJob *job) {
+    if (!job || (job->kind == IO_JOB_CALL ? !job->run : job->fd < 0)) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (job->kind == IO_JOB_CALL) {
+        job->run(job);
+        return;
+    }
+
+    if (job->kind == IO_JOB_READ) {
+        u64 done = 0;
+        while (done < job->length) {
+            i64 n = pread(job->fd, job->buf + done, job->length - done, (off_t)(job->offset + done));
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            if (n == -1) {
+                job->result = -1;
+                job->error  = errno;
+                return;
+            }
+            if (!n) {
+                break;
+            }
+            done += (u64)n;
+        }
+        job->result = (i64)done;
+        return;
+    }
+
+    // readahead() only queues reads, so range is read through after it : sendfile() faulting pages in on loop
+    // thread is what this job is there to prevent
+    u64 queued = job->length + job->ahead;
+    if (-1 == readahead(job->fd, (off64_t)job->offset, queued)) {
+        posix_fadvise(job->fd, (off_t)job->offset, (off_t)queued, POSIX_FADV_WILLNEED);
+    }
+
+    u8  scratch[IO_SCRATCH_SIZE];
+    u64 done = 0;
+    while (done < job->length) {
+        u64 want = job->length - done < sizeof(scratch) ? job->length - done : sizeof(scratch);
+        i64 n    = pread(job->fd, scratch, want, (off_t)(job->offset + done));
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+
+        // errors and end of file show up again when range is sent
+        if (n <= 0) {
+            break;
+        }
+        done += (u64)n;
+    }
+}
+
+bool IoPoolSubmit(IoPool *pool, IoJob *job) {
+    if (!pool || !job || (!job->done && job->kind != IO_JOB_CALL)) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!pool->nthreads) {
+        return false;
+    }
+
+    job->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    bool accepted = !pool->stopping;
+    if (accepted) {
+        if (pool->tail) {
+            pool->tail->next = job;
+        } else {
+            pool->head = job;
+        }
+        pool->tail = job;
+        pthread_cond_signal(&pool->ready);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return accepted;
+}
+
+IoCompletions *IoCompletionsInit(IoCompletions *done) {
+    if (!done) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    atomic_init(&done->head, NULL);
+    done->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (-1 == done->event_fd) {
+        LOG_SYS_ERROR("eventfd() failed");
+        return NULL;
+    }
+
+    return done;
+}
+
+void IoCompletionsDeinit(IoCompletions *done) {
+    if (!done) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (done->event_fd >= 0) {
+        close(done->event_fd);
+    }
+    done->event_fd = -1;
+    atomic_store(&done->head, NULL);
+}
+
+IoJob *IoCompletionsTake(IoCompletions *done) {
+    if (!done) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    // clear readiness first, anything pushed after this signals again
+    u64 count = 0;
+    while (-1 == read(done->event_fd, &count, sizeof(count)) && errno == EINTR) {}
+
+    IoJob *jobs = atomic_exchange_explicit(&done->head, NULL, memory_order_acquire);
+
+    // list is newest first, hand it back in completion order
+    IoJob *ordered = NULL;
+    while (jobs) {
+        IoJob *next = jobs->next;
+        jobs->next  = ordered;
+        ordered     = jobs;
+        jobs        = next;
+    }
+
+    return ordered;
+}
@@ -0,0 +1,121 @@
+/// file      : loadshed.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Adaptive load shedding driven by queueing delay.
+
+#include <time.h>
+
+#include <Misra.h>
+#include <Beam/Clock.h>
+#include <Beam/LoadShed.h>
+
+static u64 isqrt(u64 x) {
+    u64 r = 0;
+    for (u64 bit = 1ull << 62; bit; bit >>= 2) {
+        if (x >= r + bit) {
+            x -= r + bit;
+            r  = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+    }
+    return r;
+}
+
+// t + interval / sqrt(count), in 10 bit fixed point to keep small counts precise
+static u64 load_shed_control_law(LoadShed *shed, u64 t) {
+    return t + (shed->config.interval_ns << 10) / isqrt((u64)shed->count << 20);
+}
+
+// has sojourn been above target for at least an interval ?
+static bool load_shed_above_target(LoadShed *shed, u64 sojourn_ns, u64 now_ns) {
+    if (sojourn_ns < shed->config.target_ns) {
+        shed->first_above = 0;
+        return false;
+    }
+
+    if (!shed->first_above) {
+        shed->first_above = now_ns + shed->config.interval_ns;
+        return false;
+    }
+
+    return now_ns >= shed->first_above;
+}
+
+bool LoadShedEnableTimestamps(int sockfd) {
+    if (sockfd < 0) {
+        LOG_ERROR("Invalid arguments");
+        return false;
+    }
+
+    if (-1 == setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &(int) {1}, sizeof(int))) {
+        LOG_SYS_ERROR("setsockopt(SO_TIMESTAMPNS) failed");
+        return false;
+    }
+
+    return true;
+}
+
+u64 LoadShedSojourn(struct msghdr *msg) {
+    if (!msg) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TIMESTAMPNS) {
+            continue;
+        }
+
+        // kernel stamps packets with wall clock time
+        struct timespec rx, now;
+        memcpy(&rx, CMSG_DATA(cmsg), sizeof(rx));
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        u64 rx_ns  = (u64)rx.tv_sec * NSEC_PER_SEC + (u64)rx.tv_nsec;
+        u64 now_ns = (u64)now.tv_sec * NSEC_PER_SEC + (u64)now.tv_nsec;
+        return now_ns > rx_ns ? now_ns - rx_ns : 0;
+    }
+
+    return 0;
+}
+
+bool LoadShedAdmit(LoadShed *shed, u64 sojourn_ns, u64 now_ns) {
+    if (!shed) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!shed->config.target_ns) {
+        return true;
+    }
+
+    bool above = load_shed_above_target(shed, sojourn_ns, now_ns);
+
+    if (shed->shedding) {
+        if (!above) {
+            shed->shedding = false;
+            return true;
+        }
+
+        if (now_ns >= shed->drop_next) {
+            shed->count++;
+            shed->drop_next = load_shed_control_law(shed, shed->drop_next);
+            return false;
+        }
+
+        return true;
+    }
+
+    if (!above) {
+        return true;
+    }
+
+    // resume close to previous shedding rate if we only just stopped shedding
+    u32 delta        = shed->count - shed->last_count;
+    shed->shedding   = true;
+    shed->count      = (delta > 1 && now_ns - shed->drop_next < 16 * shed->config.interval_ns) ? delta : 1;
+    shed->last_count = shed->count;
+    shed->drop_next  = load_shed_control_law(shed, now_ns);
+
+    return false;
+}
@@ -0,0 +1,183 @@
+/// file      : numa.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// NUMA topology, worker placement and memory binding.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+
+#include <Misra.h>
+#include <Beam/Numa.h>
+
+#define NUMA_SYSFS "/sys/devices/system/node"
+
+// mbind() takes a bitmask of nodes, one word of it covers any host we'd run on
+#define NUMA_MAX_NODES 64
+
+// read a "0-3,8,10-11" style list into a set, false when file isn't there
+static bool numa_read_list(const char *path, cpu_set_t *set) {
+    char buf[4096];
+    i32  fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        return false;
+    }
+    i64 n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) {
+        return false;
+    }
+    buf[n] = 0;
+
+    CPU_ZERO(set);
+    const char *p = buf;
+    while (*p >= '0' && *p <= '9') {
+        char *end   = NULL;
+        u64   first = strtoull(p, &end, 10);
+        u64   last  = first;
+        if (*end == '-') {
+            last = strtoull(end + 1, &end, 10);
+        }
+        for (u64 i = first; i <= last && i < CPU_SETSIZE; i++) {
+            CPU_SET(i, set);
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return true;
+}
+
+NumaTopology *NumaTopologyRead(NumaTopology *topo) {
+    if (!topo) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    *topo = NumaTopologyInit();
+
+    cpu_set_t allowed;
+    if (-1 == sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        LOG_SYS_ERROR("sched_getaffinity() failed");
+        return NULL;
+    }
+
+    u32 total = (u32)CPU_COUNT(&allowed);
+
+    topo->cpus     = calloc(total, sizeof(u32));
+    topo->cpu_node = calloc(total, sizeof(u32));
+    if (!topo->cpus || !topo->cpu_node) {
+        LOG_ERROR("failed to allocate NUMA topology");
+        NumaTopologyDeinit(topo);
+        return NULL;
+    }
+
+    // allowed CPUs of every node, a host without sysfs node entries is one node
+    cpu_set_t node_cpus[NUMA_MAX_NODES];
+    cpu_set_t online;
+    u32       nnodes = 0;
+    if (!numa_read_list(NUMA_SYSFS "/online", &online)) {
+        CPU_ZERO(&online);
+        CPU_SET(0, &online);
+    }
+    for (u32 node = 0; node < NUMA_MAX_NODES; node++) {
+        char path[128];
+        snprintf(path, sizeof(path), NUMA_SYSFS "/node%u/cpulist", node);
+        if (!CPU_ISSET(node, &online) || !numa_read_list(path, &node_cpus[node])) {
+            node_cpus[node] = node ? (cpu_set_t) {0} : allowed;
+        }
+        CPU_AND(&node_cpus[node], &node_cpus[node], &allowed);
+        if (CPU_COUNT(&node_cpus[node])) {
+            nnodes++;
+            topo->max_node = node;
+        }
+    }
+
+    // one CPU of every node in turn, nodes running out drop out of rotation
+    while (topo->count < total) {
+        u32 before = topo->count;
+        for (u32 node = 0; node <= topo->max_node && topo->count < total; node++) {
+            for (u32 cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &node_cpus[node])) {
+                    CPU_CLR(cpu, &node_cpus[node]);
+                    topo->cpus[topo->count]     = cpu;
+                    topo->cpu_node[topo->count] = node;
+                    topo->count++;
+                    break;
+                }
+            }
+        }
+        // CPUs allowed but in no node sysfs knows of
+        if (topo->count == before) {
+            break;
+        }
+    }
+
+    topo->nodes = nnodes ? nnodes : 1;
+    return topo;
+}
+
+void NumaTopologyDeinit(NumaTopology *topo) {
+    if (!topo) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    free(topo->cpus);
+    free(topo->cpu_node);
+    *topo = NumaTopologyInit();
+}
+
+i32 NumaPinWorker(const NumaTopology *topo, u32 worker) {
+    if (!topo) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!topo->count) {
+        return -1;
+    }
+
+    u32       at = worker % topo->count;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(topo->cpus[at], &set);
+    if (-1 == sched_setaffinity(0, sizeof(set), &set)) {
+        LOG_SYS_ERROR("sched_setaffinity() failed");
+        return -1;
+    }
+
+    return (i32)topo->cpu_node[at];
+}
+
+bool NumaBind(void *mem, u64 size, i32 node) {
+    if (!mem || !size || node >= NUMA_MAX_NODES) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    cpu_set_t nodes;
+    if (!numa_read_list(NUMA_SYSFS "/has_memory", &nodes)) {
+        return true;
+    }
+
+    // preferred rather than bound : a full node spills over instead of failing faults
+    unsigned long mask = 0;
+    int           mode = MPOL_PREFERRED;
+    if (node >= 0) {
+        mask = 1ul << node;
+    } else {
+        for (u32 n = 0; n < NUMA_MAX_NODES; n++) {
+            mask |= CPU_ISSET(n, &nodes) ? 1ul << n : 0;
+        }
+        mode = MPOL_INTERLEAVE;
+        if (!(mask & (mask - 1))) {
+            return true;
+        }
+    }
+
+    if (-1 == syscall(SYS_mbind, mem, size, mode, &mask, NUMA_MAX_NODES + 1, 0)) {
+        return errno == ENOSYS;
+    }
+    return true;
+}
@@ -0,0 +1,79 @@
+/// file      : perf.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Hardware TLB miss counters of calling thread, through perf_event_open().
+
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+#include <Misra.h>
+#include <Beam/Perf.h>
+
+static i32 perf_open_cache_miss(u64 cache) {
+    struct perf_event_attr attr = {0};
+    attr.type                   = PERF_TYPE_HW_CACHE;
+    attr.size                   = sizeof(attr);
+    attr.config                 = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel         = 1;
+    attr.exclude_hv             = 1;
+
+    // this thread only, on whichever CPU it runs
+    return (i32)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+static u64 perf_read(i32 fd) {
+    u64 value = 0;
+    if (fd < 0 || (ssize_t)sizeof(value) != read(fd, &value, sizeof(value))) {
+        return 0;
+    }
+    return value;
+}
+
+bool TlbCountersOpen(TlbCounters *counters) {
+    if (!counters) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    *counters         = TlbCountersInit();
+    counters->dtlb_fd = perf_open_cache_miss(PERF_COUNT_HW_CACHE_DTLB);
+    counters->itlb_fd = perf_open_cache_miss(PERF_COUNT_HW_CACHE_ITLB);
+    if (counters->dtlb_fd < 0 && counters->itlb_fd < 0) {
+        LOG_SYS_ERROR("perf_event_open() failed");
+        return false;
+    }
+
+    counters->dtlb = perf_read(counters->dtlb_fd);
+    counters->itlb = perf_read(counters->itlb_fd);
+    return true;
+}
+
+void TlbCountersClose(TlbCounters *counters) {
+    if (!counters) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (counters->dtlb_fd >= 0) {
+        close(counters->dtlb_fd);
+    }
+    if (counters->itlb_fd >= 0) {
+        close(counters->itlb_fd);
+    }
+    *counters = TlbCountersInit();
+}
+
+void TlbCountersRead(TlbCounters *counters, u64 *dtlb, u64 *itlb) {
+    if (!counters || !dtlb || !itlb) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    u64 d = counters->dtlb_fd >= 0 ? perf_read(counters->dtlb_fd) : counters->dtlb;
+    u64 i = counters->itlb_fd >= 0 ? perf_read(counters->itlb_fd) : counters->itlb;
+
+    // a failed read gives 0, never count backwards
+    *dtlb          = d > counters->dtlb ? d - counters->dtlb : 0;
+    *itlb          = i > counters->itlb ? i - counters->itlb : 0;
+    counters->dtlb = d > counters->dtlb ? d : counters->dtlb;
+    counters->itlb = i > counters->itlb ? i : counters->itlb;
+}
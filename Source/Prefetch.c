@@ -0,0 +1,120 @@
+/// file      : prefetch.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Readahead policy for file responses.
+
+#include <fcntl.h>
+
+#include <Misra.h>
+#include <Beam/Prefetch.h>
+
+// ranges in a row continuing previous one before file counts as streamed
+#define PREFETCH_SEQUENTIAL_AFTER 2
+#define PREFETCH_SEQUENTIAL_MAX   15
+
+// how many ranges of typical size are prefetched ahead of a streaming client
+#define PREFETCH_RANGES_AHEAD 2
+
+struct PrefetchEntry {
+    u64 file;       // file id, 0 for unused
+    u64 next;       // offset right after last range sent
+    u64 avg_length; // moving average of range lengths
+    u32 sequential; // saturating count of ranges continuing previous one
+};
+
+static u64 prefetch_hash(u64 x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+static u64 prefetch_clamp(Prefetch *prefetch, u64 window) {
+    window = window > prefetch->config.window_min ? window : prefetch->config.window_min;
+    return window < prefetch->config.window_max ? window : prefetch->config.window_max;
+}
+
+Prefetch *PrefetchInit(Prefetch *prefetch, const PrefetchConfig *config) {
+    if (!prefetch || !config) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    u32 slots = config->table_slots;
+    if (!slots || (slots & (slots - 1)) || config->window_min > config->window_max) {
+        LOG_ERROR("invalid prefetch configuration");
+        return NULL;
+    }
+
+    memset(prefetch, 0, sizeof(*prefetch));
+    prefetch->table = calloc(slots, sizeof(PrefetchEntry));
+    if (!prefetch->table) {
+        LOG_ERROR("failed to allocate prefetch table");
+        return NULL;
+    }
+
+    prefetch->config = *config;
+    prefetch->mask   = slots - 1;
+    return prefetch;
+}
+
+void PrefetchDeinit(Prefetch *prefetch) {
+    if (!prefetch) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    free(prefetch->table);
+    memset(prefetch, 0, sizeof(*prefetch));
+}
+
+PrefetchAdvice PrefetchAdvise(Prefetch *prefetch, i32 fd, u64 file_id, u64 file_size, u64 offset, u64 length) {
+    if (!prefetch || fd < 0) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    PrefetchAdvice advice = {0};
+    advice.dontneed       = prefetch->config.dontneed_min && file_size >= prefetch->config.dontneed_min;
+
+    if (!length) {
+        return advice;
+    }
+
+    // direct mapped, a colliding file simply takes the slot over
+    PrefetchEntry *entry = &prefetch->table[prefetch_hash(file_id) & prefetch->mask];
+    if (entry->file != file_id) {
+        memset(entry, 0, sizeof(*entry));
+        entry->file       = file_id;
+        entry->avg_length = length;
+    }
+
+    bool whole        = !offset && length == file_size;
+    bool continues    = offset && offset == entry->next;
+    entry->next       = offset + length;
+    entry->avg_length = (entry->avg_length * 3 + length) / 4;
+    if (continues) {
+        entry->sequential += entry->sequential < PREFETCH_SEQUENTIAL_MAX;
+    } else if (!whole) {
+        entry->sequential /= 2;
+    }
+
+    if (whole) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        advice.window = prefetch_clamp(prefetch, length);
+    } else if (entry->sequential >= PREFETCH_SEQUENTIAL_AFTER) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        advice.window = prefetch_clamp(prefetch, length + PREFETCH_RANGES_AHEAD * entry->avg_length);
+    } else {
+        // seeking : exactly what was asked for, no kernel readahead beyond it
+        posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+        advice.window = length < prefetch->config.window_max ? length : prefetch->config.window_max;
+    }
+
+    // window never reaches past end of file
+    if (advice.window > file_size - offset) {
+        advice.window = file_size - offset;
+    }
+
+    return advice;
+}
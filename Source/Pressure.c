@@ -0,0 +1,206 @@
+/// file      : pressure.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Memory pressure of our cgroup.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <Misra.h>
+#include <Beam/Clock.h>
+#include <Beam/Pressure.h>
+#include <Beam/Shm.h>
+
+// high and max events in `memory.events`, -1 when it can't be read
+static i64 pressure_breaches(Pressure *pressure) {
+    char buf[512];
+    i64  n = pread(pressure->events_fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0) {
+        return -1;
+    }
+    buf[n] = 0;
+
+    u64 high = 0;
+    u64 max  = 0;
+    for (char *line = buf; line; line = strchr(line, '\n')) {
+        line += *line == '\n';
+        sscanf(line, "high %lu", &high);
+        sscanf(line, "max %lu", &max);
+    }
+    return (i64)(high + max);
+}
+
+// share caches may keep at current level, published to everyone
+static void pressure_publish(Pressure *pressure) {
+    PressureConfig *config = &pressure->config;
+    u32             keep   = 100 - pressure->level * (100 - config->floor_pct) / config->levels;
+    atomic_store_explicit(pressure->keep_pct, keep, memory_order_relaxed);
+    if (config->on_change) {
+        config->on_change(keep, config->arg);
+    }
+}
+
+static void *pressure_main(void *arg) {
+    Pressure *pressure = arg;
+    u64       window   = pressure->config.window_us * NSEC_PER_USEC;
+    u64       relax    = pressure->config.relax_ns;
+    u64       changed  = ClockNowNs();
+    u64       fired    = 0;
+
+    while (true) {
+        // poll() skips negative fds, either notification may be missing
+        struct pollfd pfds[3] = {
+            {.fd = pressure->stop_fd, .events = POLLIN},
+            {.fd = pressure->psi_fd, .events = POLLPRI},
+            {.fd = pressure->events_fd, .events = POLLPRI},
+        };
+
+        // nothing to relax from at level 0
+        i32 timeout = -1;
+        if (pressure->level) {
+            u64 now   = ClockNowNs();
+            u64 quiet = (changed > fired ? changed : fired) + relax;
+            timeout   = quiet > now ? (i32)((quiet - now + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC) : 0;
+        }
+
+        if (-1 == poll(pfds, 3, timeout)) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_SYS_ERROR("poll() failed, memory pressure no longer watched");
+            break;
+        }
+        if (pfds[0].revents) {
+            break;
+        }
+
+        u64  now     = ClockNowNs();
+        bool pressed = false;
+
+        // trigger goes away with its cgroup
+        if (pfds[1].revents & POLLERR) {
+            close(pressure->psi_fd);
+            pressure->psi_fd = -1;
+        } else if (pfds[1].revents & POLLPRI) {
+            pressed = true;
+        }
+
+        // file changed, reading it is also what rearms notification
+        if (pfds[2].revents & (POLLPRI | POLLERR)) {
+            i64 breaches = pressure_breaches(pressure);
+            if (breaches > (i64)pressure->breaches) {
+                pressed = true;
+            }
+            pressure->breaches = breaches >= 0 ? (u64)breaches : pressure->breaches;
+        }
+
+        if (pressed) {
+            fired = now;
+            if (pressure->level < pressure->config.levels && now - changed >= window) {
+                pressure->level++;
+                changed = now;
+                pressure_publish(pressure);
+            }
+        } else if (pressure->level && now - (changed > fired ? changed : fired) >= relax) {
+            pressure->level--;
+            changed = now;
+            pressure_publish(pressure);
+        }
+    }
+
+    return NULL;
+}
+
+Pressure *PressureStart(Pressure *pressure, const PressureConfig *config, const char *cgroup) {
+    if (!pressure || !config || !cgroup) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!config->levels || config->floor_pct > 100 || !config->window_us || config->stall_us > config->window_us) {
+        LOG_ERROR("invalid memory pressure configuration");
+        return NULL;
+    }
+
+    memset(pressure, 0, sizeof(*pressure));
+    pressure->config    = *config;
+    pressure->psi_fd    = -1;
+    pressure->events_fd = -1;
+    pressure->stop_fd   = -1;
+
+    char path[4352];
+    snprintf(path, sizeof(path), "%s/memory.pressure", cgroup);
+    pressure->psi_fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (pressure->psi_fd >= 0) {
+        char trigger[64];
+        i32  len = snprintf(trigger, sizeof(trigger), "some %lu %lu", config->stall_us, config->window_us);
+        if (write(pressure->psi_fd, trigger, (u64)len + 1) < 0) {
+            LOG_SYS_ERROR("PSI trigger refused, memory pressure stalls not watched");
+            close(pressure->psi_fd);
+            pressure->psi_fd = -1;
+        }
+    }
+
+    snprintf(path, sizeof(path), "%s/memory.events", cgroup);
+    pressure->events_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (pressure->events_fd >= 0) {
+        i64 breaches       = pressure_breaches(pressure);
+        pressure->breaches = breaches > 0 ? (u64)breaches : 0;
+    }
+
+    if (pressure->psi_fd < 0 && pressure->events_fd < 0) {
+        return NULL;
+    }
+
+    pressure->keep_pct = ShmAlloc(sizeof(*pressure->keep_pct));
+    pressure->stop_fd  = eventfd(0, EFD_CLOEXEC);
+    if (!pressure->keep_pct || -1 == pressure->stop_fd) {
+        LOG_SYS_ERROR("failed to set up memory pressure monitor");
+        PressureStop(pressure);
+        return NULL;
+    }
+    atomic_store_explicit(pressure->keep_pct, 100, memory_order_relaxed);
+
+    // signals meant for main thread (stopping, reaping workers) must not land here
+    sigset_t all;
+    sigset_t old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    i32 err = pthread_create(&pressure->thread, NULL, pressure_main, pressure);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err) {
+        LOG_ERROR("failed to start memory pressure monitor");
+        close(pressure->stop_fd);
+        pressure->stop_fd = -1;
+        PressureStop(pressure);
+        return NULL;
+    }
+
+    return pressure;
+}
+
+void PressureStop(Pressure *pressure) {
+    if (!pressure) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (pressure->stop_fd >= 0) {
+        u64 one = 1;
+        while (-1 == write(pressure->stop_fd, &one, sizeof(one)) && errno == EINTR) {}
+        pthread_join(pressure->thread, NULL);
+        close(pressure->stop_fd);
+    }
+    if (pressure->psi_fd >= 0) {
+        close(pressure->psi_fd);
+    }
+    if (pressure->events_fd >= 0) {
+        close(pressure->events_fd);
+    }
+    ShmFree(pressure->keep_pct, sizeof(*pressure->keep_pct));
+    memset(pressure, 0, sizeof(*pressure));
+}
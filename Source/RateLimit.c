@@ -0,0 +1,253 @@
+/// file      : ratelimit.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Per-client request-rate and bandwidth limits.
+
+#include <stdatomic.h>
+
+#include <Misra.h>
+#include <Beam/Addr.h>
+#include <Beam/Clock.h>
+#include <Beam/RateLimit.h>
+#include <Beam/Shm.h>
+
+// how many slots are looked at before recycling the least recently seen one
+#define RATE_LIMIT_PROBE_LIMIT 8
+
+///
+/// A bucket never goes back to being empty once claimed, it only gets recycled
+/// for another key. This keeps probing correct without tombstones : a key can
+/// never live past the first empty slot of its probe window.
+///
+/// Updates are intentionally relaxed : a racing recycle may let a request or two
+/// through with a fresh bucket, which is acceptable for admission control.
+///
+struct RateBucket {
+    _Atomic u64 key;         // client key, 0 when slot was never used
+    _Atomic u64 request_tat; // theoretical arrival time of next request (ns)
+    _Atomic u64 byte_tat;    // theoretical arrival time of next byte (ns)
+    _Atomic u64 last_seen;   // last time this bucket was touched (ns)
+};
+
+static bool is_pow2(u64 x) {
+    return x && !(x & (x - 1));
+}
+
+static void rate_bucket_reset(RateBucket *bucket) {
+    atomic_store_explicit(&bucket->request_tat, 0, memory_order_relaxed);
+    atomic_store_explicit(&bucket->byte_tat, 0, memory_order_relaxed);
+}
+
+static RateBucket *rate_bucket_find(RateLimiter *limiter, u64 key, u64 now) {
+    u64         nslots = limiter->config.shard_slots;
+    u64         shard  = (key >> 32) & (limiter->config.shard_count - 1);
+    RateBucket *slots  = limiter->buckets + shard * nslots;
+    u64         mask   = nslots - 1;
+    u64         probes = nslots < RATE_LIMIT_PROBE_LIMIT ? nslots : RATE_LIMIT_PROBE_LIMIT;
+
+    RateBucket *bucket      = NULL;
+    RateBucket *victim      = NULL;
+    u64         victim_key  = 0;
+    u64         victim_seen = UINT64_MAX;
+
+    for (u64 i = 0; i < probes && !bucket; i++) {
+        RateBucket *slot = &slots[(key + i) & mask];
+        u64         k    = atomic_load_explicit(&slot->key, memory_order_acquire);
+
+        if (k == key) {
+            bucket = slot;
+            break;
+        }
+
+        if (!k) {
+            // first empty slot, key cannot be further down the window
+            if (atomic_compare_exchange_strong(&slot->key, &k, key)) {
+                rate_bucket_reset(slot);
+                bucket = slot;
+                break;
+            }
+
+            // lost the race, maybe to someone inserting the same key
+            if (k == key) {
+                bucket = slot;
+                break;
+            }
+        }
+
+        u64 seen = atomic_load_explicit(&slot->last_seen, memory_order_relaxed);
+        if (seen < victim_seen) {
+            victim      = slot;
+            victim_key  = k;
+            victim_seen = seen;
+        }
+    }
+
+    // window is full : recycle least recently seen bucket
+    if (!bucket && victim) {
+        if (!atomic_compare_exchange_strong(&victim->key, &victim_key, key)) {
+            return NULL;
+        }
+        rate_bucket_reset(victim);
+        bucket = victim;
+    }
+
+    atomic_store_explicit(&bucket->last_seen, now, memory_order_relaxed);
+    return bucket;
+}
+
+RateLimiter *RateLimiterInit(RateLimiter *limiter, const RateLimitConfig *config) {
+    if (!limiter || !config) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!is_pow2(config->shard_count) || !is_pow2(config->shard_slots)) {
+        LOG_ERROR("rate limit shard count and shard size must be powers of two");
+        return NULL;
+    }
+
+    memset(limiter, 0, sizeof(*limiter));
+    limiter->config = *config;
+
+    if (config->requests_per_sec) {
+        u64 burst                  = config->request_burst ? config->request_burst : 1;
+        limiter->request_interval  = ClockRateIntervalNs(1, config->requests_per_sec);
+        limiter->request_tolerance = ClockRateIntervalNs(burst, config->requests_per_sec);
+    }
+
+    if (config->bytes_per_sec) {
+        u64 burst               = config->byte_burst ? config->byte_burst : config->bytes_per_sec;
+        limiter->byte_tolerance = ClockRateIntervalNs(burst, config->bytes_per_sec);
+    }
+
+    if (!RateLimiterEnabled(limiter)) {
+        return limiter;
+    }
+
+    u64 size         = (u64)config->shard_count * config->shard_slots * sizeof(RateBucket);
+    limiter->buckets = config->shared ? ShmAlloc(size) : calloc(1, size);
+    if (!limiter->buckets) {
+        LOG_ERROR("failed to allocate rate limit table");
+        return NULL;
+    }
+
+    return limiter;
+}
+
+void RateLimiterDeinit(RateLimiter *limiter) {
+    if (!limiter) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (limiter->config.shared) {
+        ShmFree(limiter->buckets, (u64)limiter->config.shard_count * limiter->config.shard_slots * sizeof(RateBucket));
+    } else {
+        free(limiter->buckets);
+    }
+    memset(limiter, 0, sizeof(*limiter));
+}
+
+bool RateLimiterEnabled(const RateLimiter *limiter) {
+    if (!limiter) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    return limiter->config.requests_per_sec || limiter->config.bytes_per_sec;
+}
+
+u64 RateLimitKey(const RateLimiter *limiter, HttpRequest *request, const struct sockaddr_storage *peer) {
+    if (!limiter || !peer) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    const char *trusted = limiter->config.trusted_header;
+    HttpHeader *header  = request && trusted ? HttpHeadersFind(&request->headers, trusted) : NULL;
+
+    if (header && header->value.length) {
+        // "client, proxy1, proxy2" : last entry is the one our trusted proxy appended
+        const char *value = header->value.data;
+        u64         len   = header->value.length;
+        const char *last  = memrchr(value, ',', len);
+        const char *start = last ? last + 1 : value;
+
+        struct sockaddr_storage forwarded;
+        if (AddrParse(&forwarded, start, len - (u64)(start - value))) {
+            return AddrHash(&forwarded, limiter->config.v6_prefix_bits);
+        }
+    }
+
+    return AddrHash(peer, limiter->config.v6_prefix_bits);
+}
+
+bool RateLimitAdmit(RateLimiter *limiter, u64 key) {
+    if (!limiter) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!limiter->buckets || !key) {
+        return true;
+    }
+
+    u64         now    = ClockNowNs();
+    RateBucket *bucket = rate_bucket_find(limiter, key, now);
+    if (!bucket) {
+        // table contention, fail open
+        return true;
+    }
+
+    // still paying off bandwidth debt from earlier responses ?
+    if (limiter->config.bytes_per_sec) {
+        u64 tat = atomic_load_explicit(&bucket->byte_tat, memory_order_relaxed);
+        if (tat > now && tat - now > limiter->byte_tolerance) {
+            return false;
+        }
+    }
+
+    if (!limiter->config.requests_per_sec) {
+        return true;
+    }
+
+    u64 tat = atomic_load_explicit(&bucket->request_tat, memory_order_relaxed);
+    while (true) {
+        u64 next = (tat > now ? tat : now) + limiter->request_interval;
+        if (next - now > limiter->request_tolerance) {
+            return false;
+        }
+        if (atomic_compare_exchange_weak_explicit(
+                &bucket->request_tat,
+                &tat,
+                next,
+                memory_order_relaxed,
+                memory_order_relaxed
+            )) {
+            return true;
+        }
+    }
+}
+
+void RateLimitChargeBytes(RateLimiter *limiter, u64 key, u64 nbytes) {
+    if (!limiter) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!limiter->config.bytes_per_sec || !key || !nbytes) {
+        return;
+    }
+
+    u64         now    = ClockNowNs();
+    RateBucket *bucket = rate_bucket_find(limiter, key, now);
+    if (!bucket) {
+        return;
+    }
+
+    u64 cost = ClockRateIntervalNs(nbytes, limiter->config.bytes_per_sec);
+    u64 tat  = atomic_load_explicit(&bucket->byte_tat, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(
+        &bucket->byte_tat,
+        &tat,
+        (tat > now ? tat : now) + cost,
+        memory_order_relaxed,
+        memory_order_relaxed
+    )) {
+    }
+}
@@ -0,0 +1,70 @@
+/// file      : ring.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Mirrored ("magic") ring buffer.
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <Misra.h>
+#include <Beam/Ring.h>
+
+Ring *RingCreate(Ring *ring, u64 min_size) {
+    if (!ring || !min_size) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    u64 page = (u64)sysconf(_SC_PAGESIZE);
+    u64 size = (min_size + 1 + page - 1) / page * page;
+
+    i32 fd = memfd_create("beam-ring", MFD_CLOEXEC);
+    if (-1 == fd) {
+        LOG_SYS_ERROR("memfd_create() failed");
+        return NULL;
+    }
+
+    if (-1 == ftruncate(fd, (off_t)size)) {
+        LOG_SYS_ERROR("ftruncate() failed");
+        close(fd);
+        return NULL;
+    }
+
+    // reserve address space for both halves first, so nothing else lands in between
+    char *base = mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == base) {
+        LOG_SYS_ERROR("mmap() failed");
+        close(fd);
+        return NULL;
+    }
+
+    for (u32 half = 0; half < 2; half++) {
+        void *at = mmap(base + half * size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+        if (MAP_FAILED == at) {
+            LOG_SYS_ERROR("mmap() failed");
+            munmap(base, 2 * size);
+            close(fd);
+            return NULL;
+        }
+    }
+
+    // mappings keep pages alive
+    close(fd);
+
+    ring->base   = base;
+    ring->size   = size;
+    ring->head   = 0;
+    ring->length = 0;
+    return ring;
+}
+
+void RingDeinit(Ring *ring) {
+    if (!ring) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (ring->base) {
+        munmap(ring->base, 2 * ring->size);
+    }
+    *ring = RingInit();
+}
@@ -0,0 +1,1044 @@
+/// file      : server.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Event loop serving connections accepted on a listening socket.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <strings.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include <Misra.h>
+#include <Beam/Clock.h>
+#include <Beam/HugePage.h>
+#include <Beam/Server.h>
+
+#define SERVER_SWEEP_INTERVAL_NS (250 * NSEC_PER_MSEC)
+#define SERVER_THROTTLE_HZ       10
+#define SERVER_OUTPUT_HIGH_WATER (1024 * 1024)
+
+// closed connections wait this long for kernel to give lent buffers back
+#define SERVER_ORPHAN_TIMEOUT_NS (30 * NSEC_PER_SEC)
+
+static void server_list_push(ConnList *list, Conn *conn, ConnListId id) {
+    conn->run_next = NULL;
+    conn->run_prev = list->tail;
+    if (list->tail) {
+        list->tail->run_next = conn;
+    } else {
+        list->head = conn;
+    }
+    list->tail     = conn;
+    conn->run_list = id;
+}
+
+static void server_list_remove(Server *server, Conn *conn) {
+    ConnList *list = NULL;
+    switch (conn->run_list) {
+        case CONN_LIST_PENDING :
+            list = &server->pending;
+            break;
+        case CONN_LIST_THROTTLED :
+            list = &server->throttled;
+            break;
+        case CONN_LIST_READY :
+            list = &server->ready;
+            break;
+        default :
+            return;
+    }
+
+    if (conn->run_prev) {
+        conn->run_prev->run_next = conn->run_next;
+    } else {
+        list->head = conn->run_next;
+    }
+    if (conn->run_next) {
+        conn->run_next->run_prev = conn->run_prev;
+    } else {
+        list->tail = conn->run_prev;
+    }
+
+    conn->run_next = conn->run_prev = NULL;
+    conn->run_list = CONN_LIST_NONE;
+}
+
+static void server_drop_fd(i32 fd) {
+    struct linger linger = {.l_onoff = 1, .l_linger = 0};
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+    close(fd);
+}
+
+static void server_close(Server *server, Conn *conn, bool reset) {
+    server_list_remove(server, conn);
+
+    if (conn->prev) {
+        conn->prev->next = conn->next;
+    } else {
+        server->open = conn->next;
+    }
+    if (conn->next) {
+        conn->next->prev = conn->prev;
+    }
+
+    if (server->config.conn_limiter) {
+        ConnLimitRelease(server->config.conn_limiter, server->config.worker, conn->limit_slot);
+    }
+
+    // closing the socket also takes it out of epoll, an orphaned one stays open
+    if (conn->lent) {
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    }
+    ConnClose(conn, reset, &server->orphans, ClockNowNs());
+
+    conn->prev   = NULL;
+    conn->next   = server->free;
+    server->free = conn;
+    server->nconns--;
+}
+
+// take a freshly accepted socket on as one of this loop's connections
+static void server_adopt(Server *server, i32 fd, const struct sockaddr_storage *addr, u64 now) {
+    // over the limit connections are dropped before anything is spent on them
+    ConnLimitSlot *slot    = NULL;
+    ConnLimiter   *limiter = server->config.conn_limiter;
+    if (limiter && !ConnLimitAcquire(limiter, server->config.worker, addr, &slot)) {
+        server_drop_fd(fd);
+        return;
+    }
+
+    Conn *conn = server->free;
+    if (!conn || !ConnOpen(conn, fd, addr, server->config.input_size, now)) {
+        if (limiter) {
+            ConnLimitRelease(limiter, server->config.worker, slot);
+        }
+        server_drop_fd(fd);
+        return;
+    }
+    server->free = conn->next;
+
+    conn->id         = ++server->next_id;
+    conn->limit_slot = slot;
+    conn->stats      = server->stats;
+    conn->offload_io = server->io_done.event_fd >= 0;
+    if (server->direct_bufs.count) {
+        conn->direct_pool = &server->direct_bufs;
+        conn->direct_min  = server->config.direct_io_min;
+    }
+    if (server->prefetch.table) {
+        conn->prefetch = &server->prefetch;
+    }
+    if (server->hot_cache.entries) {
+        conn->hot_cache = &server->hot_cache;
+    }
+
+    // kernel quietly copies MSG_ZEROCOPY sends on sockets without this, and never reports them complete
+    if (server->config.zerocopy_min && 0 == setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &(int) {1}, sizeof(int))) {
+        conn->zerocopy_min = server->config.zerocopy_min;
+    }
+
+    conn->prev = NULL;
+    conn->next = server->open;
+    if (server->open) {
+        server->open->prev = conn;
+    }
+    server->open = conn;
+    server->nconns++;
+
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = conn};
+    if (-1 == epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+        LOG_SYS_ERROR("epoll_ctl() failed");
+        server_close(server, conn, true);
+    }
+}
+
+// listening socket comes and goes from epoll while out of file descriptors
+static void server_listen(Server *server, bool on) {
+    u32                events = EPOLLIN | (server->config.listen_exclusive ? EPOLLEXCLUSIVE : 0);
+    struct epoll_event ev     = {.events = events, .data.ptr = NULL};
+    if (-1 == epoll_ctl(server->epoll_fd, on ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, server->listen_fd, &ev)) {
+        LOG_SYS_ERROR("epoll_ctl() failed");
+        return;
+    }
+    server->accept_paused = !on;
+}
+
+// out of file descriptors : pending connection is refused with spare fd, level triggered listener spins otherwise
+static bool server_refuse(Server *server) {
+    server->stats->accept_no_fds++;
+
+    if (server->spare_fd >= 0) {
+        close(server->spare_fd);
+        i32 fd = accept4(server->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd >= 0) {
+            close(fd);
+        }
+        server->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (server->spare_fd >= 0) {
+            return true;
+        }
+    }
+
+    // someone else took spare fd meanwhile, stop listening until next sweep
+    server_listen(server, false);
+    return false;
+}
+
+// listening socket is level triggered : whatever is left over when batch runs out wakes someone again
+static void server_accept(Server *server, u64 now) {
+    Balancer *balancer = server->config.balancer;
+    u32       batch    = server->config.accept_batch;
+
+    for (u32 taken = 0; !batch || taken < batch; taken++) {
+        struct sockaddr_storage addr    = {0};
+        socklen_t               addrlen = sizeof(addr);
+        i32 fd = accept4(server->listen_fd, (struct sockaddr *)&addr, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (-1 == fd) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno == EMFILE || errno == ENFILE) {
+                if (server_refuse(server)) {
+                    continue;
+                }
+                return;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_SYS_ERROR("accept4() failed");
+                return;
+            }
+
+            // another loop sharing the socket got there first
+            if (!taken) {
+                server->stats->accept_misses++;
+            }
+            return;
+        }
+        server->stats->accepted++;
+
+        // noticeably busier than some peer : let it have this one, nothing was read yet
+        if (balancer) {
+            i32 peer = BalancePick(balancer, server->config.worker);
+            if (peer >= 0 && BalanceHandoff(balancer, (u32)peer, fd, &addr)) {
+                server->stats->handed_off++;
+                continue;
+            }
+        }
+
+        server_adopt(server, fd, &addr, now);
+    }
+}
+
+// take over connections peers handed to us
+static void server_take_handoffs(Server *server, u64 now) {
+    struct sockaddr_storage addr = {0};
+    i32                     fd   = -1;
+    while (BalanceTake(server->config.balancer, server->config.worker, &fd, &addr)) {
+        server->stats->adopted++;
+        server_adopt(server, fd, &addr, now);
+    }
+}
+
+static void server_dispatch(Server *server, Conn *conn, HttpRequest *request, u64 now) {
+    HttpHeader *length     = HttpHeadersFind(&request->headers, "Content-Length");
+    HttpHeader *encoding   = HttpHeadersFind(&request->headers, "Transfer-Encoding");
+    HttpHeader *connection = HttpHeadersFind(&request->headers, "Connection");
+
+    server->stats->requests++;
+    server->queue_delay = (server->queue_delay * 7 + conn->sojourn) / 8;
+
+    // body framing anything in front of us could read differently is refused, else a body passes for a request
+    u64 body = 0;
+    if (length && (encoding || HttpHeadersCount(&request->headers, "Content-Length") > 1 ||
+                   !HttpParseContentLength(length->value.data, &body))) {
+        ConnQueueCanned(conn, HTTP_RESPONSE_CODE_BAD_REQUEST);
+        return;
+    }
+
+    // bodies aren't handed to handlers, skip over them to reach next request
+    conn->discard = body;
+
+    // end of a chunked body can't be found without decoding it
+    if (encoding || (connection && connection->value.data && !strcasecmp(connection->value.data, "close"))) {
+        conn->close_after_write = true;
+    }
+
+    // overloaded : fail fast instead of making everyone wait longer
+    if (!LoadShedAdmit(&server->load_shed, conn->sojourn, now)) {
+        ConnQueueCanned(conn, HTTP_RESPONSE_CODE_SERVICE_UNAVAILABLE);
+        return;
+    }
+
+    RateLimiter *limiter = server->config.rate_limiter;
+    if (limiter) {
+        conn->client_key = RateLimitKey(limiter, request, &conn->addr);
+        if (!RateLimitAdmit(limiter, conn->client_key)) {
+            ConnQueueCanned(conn, HTTP_RESPONSE_CODE_TOO_MANY_REQUESTS);
+            return;
+        }
+    }
+
+    server->config.handler(conn, request);
+}
+
+// request was consumed in full : a pipelined one starting in leftover bytes is measured from here, not from its
+// predecessor, one arriving later is measured from its first bytes
+static void server_next_request(Conn *conn, u64 now) {
+    if (conn->in.length) {
+        conn->upload = DataRateMeterInit(now);
+    }
+}
+
+// serve complete requests sitting in input buffer
+static void server_process_input(Server *server, Conn *conn, u64 now) {
+    while (!conn->close_after_write) {
+        // pipelining clients get served as fast as they read, not as fast as they send
+        if (conn->out.bytes >= SERVER_OUTPUT_HIGH_WATER) {
+            conn->backlogged = true;
+            return;
+        }
+
+        if (conn->discard) {
+            u64 n = conn->discard < conn->in.length ? conn->discard : conn->in.length;
+            ConnConsume(conn, n);
+            conn->discard -= n;
+            if (conn->discard) {
+                return;
+            }
+            server_next_request(conn, now);
+        }
+
+        if (!conn->in.length) {
+            return;
+        }
+
+        char *data = RingData(&conn->in);
+        char *end  = memmem(data, conn->in.length, "\r\n\r\n", 4);
+        if (!end) {
+            if (!RingSpace(&conn->in)) {
+                ConnQueueCanned(conn, HTTP_RESPONSE_CODE_REQUEST_HEADER_FIELDS_TOO_LARGE);
+            }
+            return;
+        }
+
+        // parser wants zero-terminated input, end it right after request head
+        u64  head  = (u64)(end - data) + 4;
+        char saved = data[head];
+        data[head] = 0;
+
+        HttpRequest request = HttpRequestInit();
+        bool        parsed  = HttpRequestParse(&request, data) != NULL;
+
+        data[head] = saved;
+        ConnConsume(conn, head);
+
+        if (!parsed) {
+            ConnQueueCanned(conn, HTTP_RESPONSE_CODE_BAD_REQUEST);
+            return;
+        }
+
+        server_dispatch(server, conn, &request, now);
+        HttpRequestDeinit(&request);
+        if (!conn->discard) {
+            server_next_request(conn, now);
+        }
+    }
+}
+
+// connection waiting for I/O can go on
+static void server_resume(Server *server, Conn *conn) {
+    conn->io_wait = false;
+    server_list_remove(server, conn);
+    server_list_push(&server->pending, conn, CONN_LIST_PENDING);
+}
+
+// hand front file chunk to I/O pool, connection resumes once its next part is in page cache
+static void server_offload(Server *server, Conn *conn) {
+    ConnChunk *chunk = ConnFront(conn);
+    u64        left  = chunk->end - chunk->offset;
+    IoJob     *job   = calloc(1, sizeof(IoJob));
+
+    // range is waited for, prefetch policy's window beyond it is only queued
+    u64 length = left < server->config.io_readahead ? left : server->config.io_readahead;
+    u64 window = left < chunk->readahead ? left : chunk->readahead;
+
+    // job may outlive connection and the file it was sending
+    i32 fd = job ? dup(chunk->fd) : -1;
+    if (fd >= 0) {
+        job->fd     = fd;
+        job->offset = chunk->offset;
+        job->length = length;
+        job->ahead  = window > length ? window - length : 0;
+        job->data   = conn;
+        job->tag    = conn->id;
+        job->done   = &server->io_done;
+        if (IoPoolSubmit(server->config.io_pool, job)) {
+            server->io_inflight++;
+            return;
+        }
+        close(fd);
+    }
+    free(job);
+
+    // can't offload : block on disk rather than stall connection forever
+    chunk->cached = chunk->end;
+    server_resume(server, conn);
+}
+
+// keep both buffers of a DIRECT chunk filled, or being filled
+static void server_stream_fill(Server *server, Conn *conn, ConnChunk *chunk) {
+    ConnStream *stream = chunk->stream;
+
+    for (u32 k = 0; k < 2 && !stream->error; k++) {
+        u32 b = stream->cur ^ k;
+        if (stream->busy[b] || stream->len[b] || stream->next >= chunk->end) {
+            continue;
+        }
+
+        // direct reads must cover whole blocks, past end of file they just come up short
+        u64 left   = chunk->end - stream->next;
+        u64 length = left < stream->pool->buffer_size ? left : stream->pool->buffer_size;
+        length     = (length + CONN_DIRECT_ALIGN - 1) & ~(u64)(CONN_DIRECT_ALIGN - 1);
+
+        IoJob *job = calloc(1, sizeof(IoJob));
+        i32    fd  = job ? dup(chunk->fd) : -1;
+        if (fd < 0) {
+            free(job);
+            stream->error = ENOMEM;
+            return;
+        }
+
+        job->kind   = IO_JOB_READ;
+        job->fd     = fd;
+        job->offset = stream->next;
+        job->length = length;
+        job->buf    = stream->buf[b];
+        job->data   = conn;
+        job->tag    = conn->id;
+        job->done   = &server->io_done;
+
+        stream->pos[b]  = stream->next;
+        stream->next   += stream->pool->buffer_size;
+
+        if (IoPoolSubmit(server->config.io_pool, job)) {
+            stream->busy[b] = true;
+            server->io_inflight++;
+            continue;
+        }
+
+        // can't offload : block on disk rather than stall connection forever
+        IoJobRun(job);
+        stream->len[b] = job->result < 0 ? 0 : (u64)job->result;
+        stream->error  = job->result < 0 ? job->error : 0;
+        close(fd);
+        free(job);
+    }
+
+    u32 b = stream->cur;
+    if (conn->io_wait && !stream->busy[b] && (stream->len[b] || stream->error)) {
+        server_resume(server, conn);
+    }
+}
+
+// does read job fill one of this chunk's stream buffers?
+static bool server_stream_owns(ConnChunk *chunk, IoJob *job) {
+    if (!chunk || chunk->kind != CONN_CHUNK_DIRECT) {
+        return false;
+    }
+
+    ConnStream *stream = chunk->stream;
+    for (u32 b = 0; b < 2; b++) {
+        if (stream->busy[b] && stream->buf[b] == job->buf) {
+            stream->busy[b] = false;
+            stream->len[b]  = job->result < 0 ? 0 : (u64)job->result;
+            stream->error   = job->result < 0 ? job->error : stream->error;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// resume connections whose file pages were read in
+static void server_io_complete(Server *server) {
+    for (IoJob *job = IoCompletionsTake(&server->io_done), *next = NULL; job; job = next) {
+        next = job->next;
+        server->io_inflight--;
+
+        // connection may have been closed, and its slab entry reused, in the meantime
+        Conn      *conn  = job->data;
+        bool       alive = conn->fd >= 0 && conn->id == job->tag;
+        ConnChunk *chunk = alive ? ConnFront(conn) : NULL;
+
+        if (job->kind == IO_JOB_READ) {
+            // refilling resumes connection once the buffer it waits on is there
+            if (server_stream_owns(chunk, job)) {
+                server_stream_fill(server, conn, chunk);
+            } else {
+                BufPoolPut(&server->direct_bufs, job->buf);
+            }
+        } else if (alive && conn->io_wait) {
+            // pool read range through, sending it won't touch disk unless it got evicted again meanwhile
+            if (chunk && chunk->kind == CONN_CHUNK_FILE && chunk->cached < job->offset + job->length) {
+                chunk->cached = job->offset + job->length;
+            }
+            server_resume(server, conn);
+        }
+
+        close(job->fd);
+        free(job);
+    }
+}
+
+// write a fair share of queued output, returns false if connection got closed
+static bool server_flush(Server *server, Conn *conn, u64 now) {
+    if (conn->io_wait) {
+        return true;
+    }
+
+    if (conn->out.count && conn->writable) {
+        u64  budget = server->config.write_quantum;
+        u64  rate   = server->config.conn_rate;
+        u64  after  = server->config.conn_rate_after;
+        bool capped = rate && conn->burst_sent >= after;
+
+        if (capped) {
+            if (conn->throttle_tat > now) {
+                server_list_push(&server->throttled, conn, CONN_LIST_THROTTLED);
+                return true;
+            }
+
+            // send in slices so that throttled output stays smooth
+            u64 slice = rate / SERVER_THROTTLE_HZ ? rate / SERVER_THROTTLE_HZ : 1;
+            budget    = slice < budget ? slice : budget;
+        }
+
+        i64 n = ConnWrite(conn, budget);
+        if (n < 0) {
+            server_close(server, conn, true);
+            return false;
+        }
+
+        ConnChunk *front = ConnFront(conn);
+        if (front && front->kind == CONN_CHUNK_DIRECT) {
+            server_stream_fill(server, conn, front);
+        } else if (conn->io_wait) {
+            server_offload(server, conn);
+        }
+
+        if (n) {
+            u64 sent     = (u64)n;
+            u64 uncapped = after > conn->burst_sent ? after - conn->burst_sent : 0;
+            if (rate && sent > uncapped) {
+                u64 from           = conn->throttle_tat > now ? conn->throttle_tat : now;
+                conn->throttle_tat = from + ClockRateIntervalNs(sent - uncapped, rate);
+            }
+
+            conn->burst_sent        += sent;
+            conn->last_active        = now;
+            server->stats->bytes_out += sent;
+            DataRateMeterUpdate(&conn->download, &server->config.data_rate, sent, now);
+            if (server->config.rate_limiter) {
+                RateLimitChargeBytes(server->config.rate_limiter, conn->client_key, sent);
+            }
+        }
+
+        if (conn->out.count) {
+            // quantum used up : let everyone else have a go before coming back
+            if (conn->writable && !conn->io_wait && conn->run_list == CONN_LIST_NONE) {
+                server_list_push(&server->pending, conn, CONN_LIST_PENDING);
+            }
+            return true;
+        }
+    }
+
+    if (conn->out.count) {
+        return true;
+    }
+
+    conn->burst_sent = 0;
+
+    if (conn->close_after_write || conn->peer_closed) {
+        // closing now would reset a connection kernel still sends lent buffers on
+        if (ConnLending(conn)) {
+            if (!conn->lingering) {
+                shutdown(conn->fd, SHUT_WR);
+                conn->lingering         = true;
+                conn->close_after_write = true;
+            }
+            return true;
+        }
+
+        server_close(server, conn, false);
+        return false;
+    }
+
+    // requests held back until output drained can go now
+    if (conn->backlogged) {
+        conn->backlogged = false;
+        server_list_push(&server->pending, conn, CONN_LIST_PENDING);
+    }
+
+    return true;
+}
+
+// read and serve everything connection has sent, output is left for flush phase
+static void server_serve_input(Server *server, Conn *conn, u64 now) {
+    while (!conn->close_after_write && !conn->backlogged) {
+        i64 received = conn->readable ? ConnRead(conn, now) : 0;
+        if (received < 0) {
+            server_close(server, conn, true);
+            return;
+        }
+        server->stats->bytes_in += (u64)received;
+        DataRateMeterUpdate(&conn->upload, &server->config.data_rate, (u64)received, now);
+
+        u64 left = conn->in.length;
+        server_process_input(server, conn, now);
+
+        // a full input buffer may have left data in socket
+        if (!conn->readable || conn->in.length == left) {
+            break;
+        }
+    }
+}
+
+// connection needs a visit in this iteration
+static void server_mark(Server *server, Conn *conn) {
+    if (conn->run_list == CONN_LIST_PENDING) {
+        return;
+    }
+    server_list_remove(server, conn);
+    server_list_push(&server->pending, conn, CONN_LIST_PENDING);
+}
+
+// memory pressure moved, caches and buffers of this loop follow
+static void server_resize(Server *server, u32 keep_pct) {
+    if (server->hot_cache.entries) {
+        HotCacheResize(&server->hot_cache, keep_pct);
+    }
+    if (server->direct_bufs.count) {
+        BufPoolResize(&server->direct_bufs, (u32)((u64)server->direct_bufs.count * keep_pct / 100));
+    }
+
+    // what was just freed sits in malloc arenas otherwise
+    if (keep_pct < server->keep_pct) {
+        malloc_trim(0);
+    }
+    server->keep_pct = keep_pct;
+}
+
+// look for idle connections and clients moving data too slowly
+static void server_sweep(Server *server, u64 now) {
+    u64 keep_alive = server->config.keep_alive_ns;
+
+    // overloaded : idle connections are a luxury
+    if (server->load_shed.shedding) {
+        keep_alive /= 4;
+    }
+
+    DataRateConfig *data_rate = &server->config.data_rate;
+    for (Conn *conn = server->open, *next = NULL; conn; conn = next) {
+        next = conn->next;
+
+        // stuck mid request or response whatever the rate floor, unless it's our disk being waited on
+        bool busy = conn->out.count || conn->in.length || conn->discard;
+        if (busy && !conn->io_wait && now - conn->last_active > server->config.idle_timeout_ns) {
+            server_close(server, conn, true);
+        } else if (conn->out.count) {
+            // only the client is to blame if it doesn't read what we can send
+            if (!conn->writable && DataRateMeterTooSlow(&conn->download, data_rate, now)) {
+                server_close(server, conn, true);
+            }
+        } else if (conn->in.length || conn->discard) {
+            if (DataRateMeterTooSlow(&conn->upload, data_rate, now)) {
+                server_close(server, conn, true);
+            }
+        } else if (now - conn->last_active > keep_alive) {
+            server_close(server, conn, false);
+        }
+    }
+
+    if (server->orphans) {
+        ConnOrphansReap(&server->orphans, now, SERVER_ORPHAN_TIMEOUT_NS);
+    }
+
+    // descriptors may have been freed since, a spare one is needed again before accepting
+    if (server->accept_paused) {
+        if (server->spare_fd < 0) {
+            server->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        }
+        if (server->spare_fd >= 0) {
+            server_listen(server, true);
+        }
+    }
+
+    if (server->tlb.dtlb_fd >= 0 || server->tlb.itlb_fd >= 0) {
+        u64 dtlb = 0;
+        u64 itlb = 0;
+        TlbCountersRead(&server->tlb, &dtlb, &itlb);
+        server->stats->dtlb_misses += dtlb;
+        server->stats->itlb_misses += itlb;
+    }
+
+    if (server->config.memory_keep_pct) {
+        u32 keep_pct = atomic_load_explicit(server->config.memory_keep_pct, memory_order_relaxed);
+        if (keep_pct != server->keep_pct) {
+            server_resize(server, keep_pct);
+        }
+    }
+
+    server->next_sweep = now + SERVER_SWEEP_INTERVAL_NS;
+}
+
+// wake up throttled connections whose rate cap has refilled
+static void server_unthrottle(Server *server, u64 now) {
+    for (Conn *conn = server->throttled.head, *next = NULL; conn; conn = next) {
+        next = conn->run_next;
+        if (conn->throttle_tat <= now) {
+            server_list_remove(server, conn);
+            server_list_push(&server->pending, conn, CONN_LIST_PENDING);
+        }
+    }
+}
+
+static i32 server_timeout(Server *server, u64 now) {
+    if (server->pending.head) {
+        return 0;
+    }
+
+    u64 wake = server->next_sweep;
+    for (Conn *conn = server->throttled.head; conn; conn = conn->run_next) {
+        wake = conn->throttle_tat < wake ? conn->throttle_tat : wake;
+    }
+
+    return wake > now ? (i32)((wake - now + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC) : 0;
+}
+
+// poll without sleeping for as long as spin budget allows, caller sleeps if nothing came
+static i32 server_spin(Server *server) {
+    if (!server->spin.budget_ns) {
+        return 0;
+    }
+
+    u64 until = ClockNowNs() + server->spin.budget_ns;
+    i32 n     = 0;
+    do {
+        n = epoll_wait(server->epoll_fd, server->events, (i32)server->config.max_events, 0);
+        server->stats->spins++;
+    } while (!n && ClockNowNs() < until);
+
+    BusySpinSpun(&server->spin, n > 0);
+    server->stats->spin_hits += n > 0;
+    return n;
+}
+
+Server *ServerInit(Server *server, const ServerConfig *config, i32 listen_fd) {
+    if (!server || !config || listen_fd < 0) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    if (!config->handler || !config->max_conns || !config->max_events || !config->input_size ||
+        !config->write_quantum) {
+        LOG_ERROR("invalid server configuration");
+        return NULL;
+    }
+
+    memset(server, 0, sizeof(*server));
+    server->config    = *config;
+    server->listen_fd = listen_fd;
+    server->epoll_fd  = -1;
+    server->spare_fd  = -1;
+    server->tlb       = TlbCountersInit();
+    server->load_shed = LoadShedInit(config->load_shed);
+    server->stats     = config->stats ? config->stats : &server->own_stats;
+    server->spin      = BusySpinInit(config->busy_poll);
+    server->keep_pct  = 100;
+
+    server->io_done.event_fd = -1;
+
+    i32 flags = fcntl(listen_fd, F_GETFL);
+    if (-1 == flags || -1 == fcntl(listen_fd, F_SETFL, flags | O_NONBLOCK)) {
+        LOG_SYS_ERROR("failed to make listening socket non-blocking");
+        return NULL;
+    }
+
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (-1 == server->epoll_fd) {
+        LOG_SYS_ERROR("epoll_create1() failed");
+        return NULL;
+    }
+
+    // listening socket is the only one registered without a connection
+    struct epoll_event ev = {.events = EPOLLIN | (config->listen_exclusive ? EPOLLEXCLUSIVE : 0), .data.ptr = NULL};
+    if (-1 == epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev)) {
+        LOG_SYS_ERROR("epoll_ctl() failed");
+        close(server->epoll_fd);
+        return NULL;
+    }
+
+    // accepted sockets inherit busy polling from listening socket
+    if (!BusyPollEnable(listen_fd, &config->busy_poll) ||
+        !BusyPollEnableEpoll(server->epoll_fd, &config->busy_poll)) {
+        LOG_ERROR("kernel busy polling not fully enabled, spinning still applies");
+    }
+
+    // peers hand connections over through a queue signalled on this
+    ev.events = EPOLLIN;
+    if (config->balancer) {
+        ev.data.ptr = config->balancer;
+        if (config->worker >= config->balancer->count ||
+            -1 == epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, BalanceEventFd(config->balancer, config->worker), &ev)) {
+            LOG_SYS_ERROR("failed to register handoff queue");
+            close(server->epoll_fd);
+            return NULL;
+        }
+    }
+
+    // without an I/O pool, cold files are simply sent blocking
+    if (config->io_pool && config->io_pool->nthreads && config->io_readahead) {
+        if (!IoCompletionsInit(&server->io_done)) {
+            close(server->epoll_fd);
+            return NULL;
+        }
+
+        ev.data.ptr = &server->io_done;
+        if (-1 == epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->io_done.event_fd, &ev)) {
+            LOG_SYS_ERROR("epoll_ctl() failed");
+            IoCompletionsDeinit(&server->io_done);
+            close(server->epoll_fd);
+            return NULL;
+        }
+
+        // streaming around page cache needs reads done asynchronously, so only with an I/O pool
+        u64 buffer_size = server->config.direct_io_buffer;
+        buffer_size     = (buffer_size + CONN_DIRECT_ALIGN - 1) & ~(u64)(CONN_DIRECT_ALIGN - 1);
+        if (config->direct_io_min && config->direct_io_buffers && buffer_size &&
+            !BufPoolCreate(
+                &server->direct_bufs,
+                buffer_size,
+                config->direct_io_buffers,
+                CONN_DIRECT_ALIGN,
+                config->hugepages
+            )) {
+            LOG_ERROR("direct streaming disabled, no buffers for it");
+        }
+    }
+
+    if (config->prefetch.table_slots && !PrefetchInit(&server->prefetch, &config->prefetch)) {
+        LOG_ERROR("prefetch policy disabled, kernel readahead defaults apply");
+    }
+
+    if (config->hot_cache.slots && !HotCacheInit(&server->hot_cache, &config->hot_cache)) {
+        LOG_ERROR("hot response cache disabled");
+    }
+
+    server->events = calloc(config->max_events, sizeof(struct epoll_event));
+    server->conns  = HugePageAlloc((u64)config->max_conns * sizeof(Conn), config->hugepages);
+    if (!server->events || !server->conns) {
+        free(server->events);
+        HugePageFree(server->conns, (u64)config->max_conns * sizeof(Conn));
+        LOG_ERROR("failed to allocate connection slab");
+        if (server->io_done.event_fd >= 0) {
+            IoCompletionsDeinit(&server->io_done);
+        }
+        if (server->direct_bufs.count) {
+            BufPoolDeinit(&server->direct_bufs);
+        }
+        if (server->prefetch.table) {
+            PrefetchDeinit(&server->prefetch);
+        }
+        if (server->hot_cache.entries) {
+            HotCacheDeinit(&server->hot_cache);
+        }
+        close(server->epoll_fd);
+        return NULL;
+    }
+
+    for (u32 i = config->max_conns; i; i--) {
+        Conn *conn   = &server->conns[i - 1];
+        conn->fd     = -1;
+        conn->in     = RingInit();
+        conn->next   = server->free;
+        server->free = conn;
+    }
+
+    // kept around only to be closed again, making room to turn connections away once out of fds
+    server->spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (server->spare_fd < 0) {
+        LOG_SYS_ERROR("failed to open spare descriptor");
+    }
+
+    // counting is per thread, and it's this one that runs the loop
+    if (config->tlb_counters && !TlbCountersOpen(&server->tlb)) {
+        LOG_ERROR("TLB miss counters disabled");
+    }
+
+    return server;
+}
+
+void ServerDeinit(Server *server) {
+    if (!server) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    while (server->open) {
+        server_close(server, server->open, false);
+    }
+
+    // pool threads still hold jobs pointing into connection slab
+    while (server->io_inflight) {
+        struct pollfd pfd = {.fd = server->io_done.event_fd, .events = POLLIN};
+        poll(&pfd, 1, -1);
+        server_io_complete(server);
+    }
+    if (server->io_done.event_fd >= 0) {
+        IoCompletionsDeinit(&server->io_done);
+    }
+    if (server->direct_bufs.count) {
+        BufPoolDeinit(&server->direct_bufs);
+    }
+    if (server->prefetch.table) {
+        PrefetchDeinit(&server->prefetch);
+    }
+    if (server->hot_cache.entries) {
+        HotCacheDeinit(&server->hot_cache);
+    }
+
+    for (u32 i = 0; server->conns && i < server->config.max_conns; i++) {
+        ConnDeinit(&server->conns[i]);
+    }
+    ConnOrphansReap(&server->orphans, ClockNowNs(), 0);
+    HugePageFree(server->conns, (u64)server->config.max_conns * sizeof(Conn));
+    free(server->events);
+    TlbCountersClose(&server->tlb);
+
+    if (server->spare_fd >= 0) {
+        close(server->spare_fd);
+    }
+    if (server->epoll_fd >= 0) {
+        close(server->epoll_fd);
+    }
+
+    memset(server, 0, sizeof(*server));
+    server->listen_fd        = -1;
+    server->epoll_fd         = -1;
+    server->spare_fd         = -1;
+    server->io_done.event_fd = -1;
+    server->tlb              = TlbCountersInit();
+}
+
+bool ServerRun(Server *server) {
+    if (!server) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    struct epoll_event *events = server->events;
+    server->next_sweep         = ClockNowNs() + SERVER_SWEEP_INTERVAL_NS;
+
+    while (true) {
+        i32 timeout = server_timeout(server, ClockNowNs());
+        i32 n       = timeout ? server_spin(server) : 0;
+        if (!n) {
+            u64 slept = ClockNowNs();
+            n         = epoll_wait(server->epoll_fd, events, (i32)server->config.max_events, timeout);
+            if (timeout && n > 0) {
+                BusySpinWoke(&server->spin, ClockNowNs() - slept);
+            }
+            server->stats->sleeps += timeout != 0;
+        }
+        if (-1 == n) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_SYS_ERROR("epoll_wait() failed");
+            return false;
+        }
+
+        // phase 1 : note what every event says, collect connections needing a visit
+        u64 now = ClockNowNs();
+        for (i32 i = 0; i < n; i++) {
+            Conn *conn = events[i].data.ptr;
+            if (!conn) {
+                server_accept(server, now);
+                continue;
+            }
+
+            if (events[i].data.ptr == &server->io_done) {
+                server_io_complete(server);
+                continue;
+            }
+
+            if (events[i].data.ptr == server->config.balancer) {
+                server_take_handoffs(server, now);
+                continue;
+            }
+
+            // closed earlier in this batch
+            if (conn->fd < 0) {
+                continue;
+            }
+
+            // zerocopy completions show up as errors, but aren't any
+            u32 ev = events[i].events;
+            if ((ev & EPOLLERR) && conn->lent) {
+                i64 taken = ConnReapZerocopy(conn);
+                if (taken < 0) {
+                    server_close(server, conn, true);
+                    continue;
+                }
+                if (taken) {
+                    ev &= ~(u32)EPOLLERR;
+                }
+            }
+
+            if (ev & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                conn->readable = true;
+            }
+            if (ev & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+                conn->writable = true;
+            }
+
+            if (ev || conn->lingering) {
+                server_mark(server, conn);
+            }
+        }
+        server_unthrottle(server, now);
+
+        // everything marked so far is visited now, anything marked from here on waits for next iteration
+        server->ready   = server->pending;
+        server->pending = (ConnList) {0};
+        for (Conn *conn = server->ready.head; conn; conn = conn->run_next) {
+            conn->run_list = CONN_LIST_READY;
+        }
+
+        // phase 2 : read and dispatch every request that arrived
+        for (Conn *conn = server->ready.head, *next = NULL; conn; conn = next) {
+            next = conn->run_next;
+            server_serve_input(server, conn, now);
+        }
+
+        // phase 3 : flush all output queued in this iteration, each connection gets one turn
+        while (server->ready.head) {
+            Conn *conn = server->ready.head;
+            server_list_remove(server, conn);
+            server_flush(server, conn, now);
+        }
+
+        if (now >= server->next_sweep) {
+            server_sweep(server, now);
+        }
+
+        if (server->config.balancer) {
+            BalancePublish(server->config.balancer, server->config.worker, server->nconns, server->queue_delay);
+        }
+
+        server->stats->iterations++;
+        server->stats->events += (u64)n;
+        StatsHistogramAdd(&server->stats->loop_us, (ClockNowNs() - now) / NSEC_PER_USEC);
+    }
+}
@@ -0,0 +1,30 @@
+/// file      : shm.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Memory shared with forked worker processes.
+
+#include <sys/mman.h>
+
+#include <Misra.h>
+#include <Beam/Shm.h>
+
+void *ShmAlloc(u64 size) {
+    if (!size) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == mem) {
+        LOG_SYS_ERROR("mmap() failed");
+        return NULL;
+    }
+
+    return mem;
+}
+
+void ShmFree(void *mem, u64 size) {
+    if (mem) {
+        munmap(mem, size);
+    }
+}
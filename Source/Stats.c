@@ -0,0 +1,85 @@
+/// file      : stats.c
+/// author    : Siddharth Mishra (admin@brightprogrammer.in)
+/// copyright : Copyright (c) 2024, Siddharth Mishra, All rights reserved.
+///
+/// Counters kept by an event loop, reported in plain text.
+
+#include <stdio.h>
+
+#include <Misra.h>
+#include <Beam/Stats.h>
+
+// render n / d with three decimals
+static void stats_ratio(Str *out, const char *name, u64 n, u64 d) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.3f", d ? (double)n / (double)d : 0.0);
+    StrWriteFmt(out, "{} {}\n", name, buf);
+}
+
+// cumulative buckets, the way most scrapers expect them
+static void stats_histogram(Str *out, const char *name, const StatsHistogram *histogram) {
+    u64 total = 0;
+    for (u32 i = 0; i < STATS_HISTOGRAM_BUCKETS - 1; i++) {
+        total += histogram->buckets[i];
+        StrWriteFmt(out, "{}_le_{} {}\n", name, (u64)1 << i, total);
+    }
+    StrWriteFmt(out, "{}_le_inf {}\n", name, histogram->count);
+    StrWriteFmt(out, "{}_count {}\n", name, histogram->count);
+    StrWriteFmt(out, "{}_sum {}\n", name, histogram->sum);
+}
+
+void StatsAdd(Stats *total, const Stats *stats) {
+    if (!total || !stats) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    // every field is a u64 counter, histograms included, and has to stay that way
+    u64       *into = (u64 *)total;
+    const u64 *from = (const u64 *)stats;
+    for (u64 i = 0; i < sizeof(Stats) / sizeof(u64); i++) {
+        into[i] += from[i];
+    }
+}
+
+Str *StatsRender(const Stats *stats, Str *out) {
+    if (!stats || !out) {
+        LOG_FATAL("Invalid arguments");
+    }
+
+    StrWriteFmt(out, "accepted {}\n", stats->accepted);
+    StrWriteFmt(out, "accept_misses {}\n", stats->accept_misses);
+    StrWriteFmt(out, "accept_no_fds {}\n", stats->accept_no_fds);
+    StrWriteFmt(out, "handed_off {}\n", stats->handed_off);
+    StrWriteFmt(out, "adopted {}\n", stats->adopted);
+    StrWriteFmt(out, "requests {}\n", stats->requests);
+    StrWriteFmt(out, "read_calls {}\n", stats->read_calls);
+    StrWriteFmt(out, "write_calls {}\n", stats->write_calls);
+    StrWriteFmt(out, "bytes_in {}\n", stats->bytes_in);
+    StrWriteFmt(out, "bytes_out {}\n", stats->bytes_out);
+    StrWriteFmt(out, "iterations {}\n", stats->iterations);
+    StrWriteFmt(out, "events {}\n", stats->events);
+    StrWriteFmt(out, "spins {}\n", stats->spins);
+    StrWriteFmt(out, "spin_hits {}\n", stats->spin_hits);
+    StrWriteFmt(out, "sleeps {}\n", stats->sleeps);
+    StrWriteFmt(out, "restarts {}\n", stats->restarts);
+    StrWriteFmt(out, "zerocopy_sends {}\n", stats->zerocopy_sends);
+    StrWriteFmt(out, "zerocopy_copied {}\n", stats->zerocopy_copied);
+    StrWriteFmt(out, "zerocopy_abandoned {}\n", stats->zerocopy_abandoned);
+    StrWriteFmt(out, "cache_hits {}\n", stats->cache_hits);
+    StrWriteFmt(out, "cache_misses {}\n", stats->cache_misses);
+    StrWriteFmt(out, "cache_stores {}\n", stats->cache_stores);
+    StrWriteFmt(out, "cache_replica_hits {}\n", stats->cache_replica_hits);
+    StrWriteFmt(out, "hot_hits {}\n", stats->hot_hits);
+    StrWriteFmt(out, "hot_stores {}\n", stats->hot_stores);
+    StrWriteFmt(out, "dtlb_misses {}\n", stats->dtlb_misses);
+    StrWriteFmt(out, "itlb_misses {}\n", stats->itlb_misses);
+
+    stats_ratio(out, "read_calls_per_request", stats->read_calls, stats->requests);
+    stats_ratio(out, "write_calls_per_request", stats->write_calls, stats->requests);
+    stats_ratio(out, "events_per_iteration", stats->events, stats->iterations);
+    stats_ratio(out, "dtlb_misses_per_request", stats->dtlb_misses, stats->requests);
+
+    stats_histogram(out, "loop_us", &stats->loop_us);
+
+    return out;
+}